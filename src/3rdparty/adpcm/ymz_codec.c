@@ -13,63 +13,84 @@
 #include <string.h>
 #include <math.h>
 
-#define CLAMP(x, low, high)  (((x) > (high)) ? (high) : (((x) < (low)) ? (low) : (x)))
+#include "ymz_codec.h"
 
-static inline int16_t ymz_step(uint8_t step, int16_t* history, int16_t* step_size)
+/*
+	Quantizer: min(7, 4*|step| / step_size), without the division.
+
+	4*|step| is compared against all seven multiples of step_size at once;
+	none of the comparisons depend on each other, so this is much shorter
+	than a divide on the sample-to-sample dependency chain.
+
+	The original expression was (abs(step)<<16) / (step_size<<14). For
+	|step| >= 32768 that shift overflows into the sign bit, making the
+	quotient zero or negative, and a negative quotient then clamps to 7 as
+	an unsigned value. That is kept as is, since existing data depends on it.
+*/
+static inline unsigned int ymz_quantize(int step, int step_size)
 {
-	static const int step_table[8] = {
-		230, 230, 230, 230, 307, 409, 512, 614
-	};
-
-	int sign = step & 8;
-	int delta = step & 7;
-	int diff = ((1+(delta<<1)) * *step_size) >> 3;
-	int newval = *history;
-	int nstep = (step_table[delta] * *step_size) >> 8;
-	// Only found in the official AICA encoder
-	// but it's possible all chips (including ADPCM-B) does this.
-	diff = CLAMP(diff, 0, 32767);
-	if (sign > 0)
-		newval -= diff;
-	else
-		newval += diff;
-	//*step_size = CLAMP(nstep, 511, 32767);
-	*step_size = CLAMP(nstep, 127, 24576);
-	*history = newval = CLAMP(newval, -32768, 32767);
-	return newval;
+	const int mag = abs(step);
+	if(mag > 32767)
+		return ((65536-mag)*4 < step_size) ? 0 : 7;
+
+	const int t = mag<<2;
+	const int step_size3 = step_size*3;
+	return (t >= step_size) + (t >= step_size*2) + (t >= step_size3) + (t >= step_size*4)
+	     + (t >= step_size*5) + (t >= step_size3*2) + (t >= step_size*7);
 }
 
-void ymz_encode(int16_t *buffer,uint8_t *outbuffer,long len)
+void ymz_encoder_init(ymz_encoder *enc)
+{
+	enc->history = 0;
+	enc->step_size = 127;
+	enc->buf_sample = 0;
+	enc->nibble = 0;
+}
+
+long ymz_encoder_run(ymz_encoder *enc,const int16_t *buffer,uint8_t *outbuffer,long len)
 {
 	long i;
-	int16_t step_size = 127;
-	int16_t history = 0;
-	uint8_t buf_sample = 0, nibble = 0;
+	int step_size = enc->step_size;
+	int history = enc->history;
+	uint8_t buf_sample = enc->buf_sample, nibble = enc->nibble;
 	unsigned int adpcm_sample;
+	uint8_t *out = outbuffer;
 
 	for(i=0;i<len;i++)
 	{
 		// we remove a few bits of accuracy to reduce some noise.
 		int step = ((*buffer++) & -8) - history;
-		adpcm_sample = (abs(step)<<16) / (step_size<<14);
-		adpcm_sample = CLAMP(adpcm_sample, 0, 7);
+		adpcm_sample = ymz_quantize(step, step_size);
 		if(step < 0)
 			adpcm_sample |= 8;
 		if(nibble)
-			*outbuffer++ = buf_sample | (adpcm_sample&15);
+			*out++ = buf_sample | (adpcm_sample&15);
 		else
 			buf_sample = (adpcm_sample&15)<<4;
 		nibble^=1;
 		ymz_step(adpcm_sample, &history, &step_size);
 	}
+
+	enc->step_size = step_size;
+	enc->history = history;
+	enc->buf_sample = buf_sample;
+	enc->nibble = nibble;
+	return out - outbuffer;
+}
+
+void ymz_encode(int16_t *buffer,uint8_t *outbuffer,long len)
+{
+	ymz_encoder enc;
+	ymz_encoder_init(&enc);
+	ymz_encoder_run(&enc, buffer, outbuffer, len);
 }
 
 void ymz_decode(uint8_t *buffer,int16_t *outbuffer,long len)
 {
 	long i;
 
-	int16_t step_size = 127;
-	int16_t history = 0;
+	int step_size = 127;
+	int history = 0;
 	uint8_t nibble = 0;
 
 	for(i=0;i<len;i++)
@@ -87,8 +108,8 @@ void ymz_decode(uint8_t *buffer,int16_t *outbuffer,long len)
 void aica_encode(int16_t *buffer,uint8_t *outbuffer,long len)
 {
 	long i;
-	int16_t step_size = 127;
-	int16_t history = 0;
+	int step_size = 127;
+	int history = 0;
 	uint8_t buf_sample = 0, nibble = 0;
 	unsigned int adpcm_sample;
 
@@ -96,8 +117,7 @@ void aica_encode(int16_t *buffer,uint8_t *outbuffer,long len)
 	{
 		// we remove a few bits of accuracy to reduce some noise.
 		int step = ((*buffer++) & -8) - history;
-		adpcm_sample = (abs(step)<<16) / (step_size<<14);
-		adpcm_sample = CLAMP(adpcm_sample, 0, 7);
+		adpcm_sample = ymz_quantize(step, step_size);
 		if(step < 0)
 			adpcm_sample |= 8;
 		if(!nibble)
@@ -113,8 +133,8 @@ void aica_decode(uint8_t *buffer,int16_t *outbuffer,long len)
 {
 	long i;
 
-	int16_t step_size = 127;
-	int16_t history = 0;
+	int step_size = 127;
+	int history = 0;
 	uint8_t nibble = 4;
 
 	for(i=0;i<len;i++)
@@ -10,6 +10,36 @@
 
 #include <stdint.h>
 
+#define YMZ_CLAMP(x, low, high)  (((x) > (high)) ? (high) : (((x) < (low)) ? (low) : (x)))
+
+/**
+ * Decode one 4-bit code, updating the decoder state.
+ * Returns the new sample value, which is also left in (history).
+ */
+static inline int ymz_step(unsigned int step, int* history, int* step_size)
+{
+	static const int step_table[8] = {
+		230, 230, 230, 230, 307, 409, 512, 614
+	};
+
+	int sign = step & 8;
+	int delta = step & 7;
+	int diff = ((1+(delta<<1)) * *step_size) >> 3;
+	int newval = *history;
+	int nstep = (step_table[delta] * *step_size) >> 8;
+	// Only found in the official AICA encoder
+	// but it's possible all chips (including ADPCM-B) does this.
+	diff = YMZ_CLAMP(diff, 0, 32767);
+	if (sign > 0)
+		newval -= diff;
+	else
+		newval += diff;
+	//*step_size = YMZ_CLAMP(nstep, 511, 32767);
+	*step_size = YMZ_CLAMP(nstep, 127, 24576);
+	*history = newval = YMZ_CLAMP(newval, -32768, 32767);
+	return newval;
+}
+
 /**
  * Given (len) amount of PCM samples in buffer,
  * return encoded ADPCM samples in outbuffer.
@@ -18,6 +48,46 @@
 void ymz_encode(int16_t *buffer,uint8_t *outbuffer,long len);
 void aica_encode(int16_t *buffer,uint8_t *outbuffer,long len);
 
+/**
+ * Encoder state carried between calls, so a long sample
+ * can be encoded in pieces with the same result as ymz_encode.
+ */
+typedef struct ymz_encoder
+{
+	int16_t history;
+	int16_t step_size;
+	uint8_t buf_sample;
+	uint8_t nibble;
+} ymz_encoder;
+
+void ymz_encoder_init(ymz_encoder *enc);
+
+/**
+ * Encode (len) more samples. Returns the number of complete
+ * bytes written to outbuffer, which needs room for (len+1)/2.
+ * A trailing odd nibble is held until the next call.
+ */
+long ymz_encoder_run(ymz_encoder *enc,const int16_t *buffer,uint8_t *outbuffer,long len);
+
+/**
+ * Number of streams advanced together by ymz_encoder_run_multi.
+ */
+#define YMZ_MULTI_LANES 16
+
+/**
+ * Run (count) independent encoders at once, one per SIMD lane.
+ * Equivalent to calling ymz_encoder_run on each stream in turn;
+ * the number of bytes written for stream i is stored in out_bytes[i].
+ * Streams may have different lengths and (count) may exceed the lane count.
+ */
+void ymz_encoder_run_multi(ymz_encoder **enc,const int16_t **buffer,uint8_t **outbuffer,
+                           const long *len,long *out_bytes,int count);
+
+/**
+ * Name of the kernel ymz_encoder_run_multi dispatches to on this CPU.
+ */
+const char *ymz_encoder_multi_isa(void);
+
 /**
  * Given ADPCM samples in (buffer), return (len) amount of
  * decoded PCM samples in (outbuffer).
@@ -0,0 +1,338 @@
+/*
+	Multi-stream YMZ280B ADPCM encoder.
+
+	A single stream can't be vectorized because every sample depends on the
+	decoder state left by the previous one, but independent streams can.
+	Here each SIMD lane carries one stream's history and step size, and all
+	lanes advance in lockstep. The output is bit-identical to ymz_encoder_run.
+
+	The quantizer matches ymz_quantize(), including its emulation of the
+	original encoder's overflowing shift:
+
+	  abs(step) <  32768: n = min(7, 4*abs(step) / step_size)
+	  abs(step) >= 32768: n = ((65536-abs(step))*4 < step_size) ? 0 : 7
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ymz_codec.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define YMZ_MULTI_X86 1
+#include <immintrin.h>
+#endif
+
+// Samples per lane handed to a kernel in one go.
+#define YMZ_MULTI_BLOCK 256
+
+// Below this many streams the scalar encoder is faster than idle lanes.
+#define YMZ_MULTI_MIN_STREAMS 4
+
+// Advances YMZ_MULTI_LANES encoder states by (steps) samples. Input is
+// transposed: in[k*YMZ_MULTI_LANES + lane]. Codes are written the same way.
+typedef void (*ymz_multi_kernel)(int32_t *history, int32_t *step_size,
+                                 const int32_t *in, uint8_t *codes, int steps);
+
+#ifdef YMZ_MULTI_X86
+
+__attribute__((target("avx2")))
+static inline __m256i ymz_lane8_avx2(__m256i x, __m256i *history, __m256i *step_size)
+{
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i two = _mm256_set1_epi32(2);
+	const __m256i four = _mm256_set1_epi32(4);
+	const __m256i seven = _mm256_set1_epi32(7);
+	const __m256i eight = _mm256_set1_epi32(8);
+	const __m256i step_table = _mm256_setr_epi32(230, 230, 230, 230, 307, 409, 512, 614);
+	const __m256i ss = *step_size;
+
+	const __m256i step = _mm256_sub_epi32(_mm256_and_si256(x, _mm256_set1_epi32(-8)), *history);
+	const __m256i a = _mm256_abs_epi32(step);
+
+	// min(7, 4a/ss) by restoring division, three quotient bits.
+	__m256i t = _mm256_slli_epi32(a, 2);
+	const __m256i ss2 = _mm256_slli_epi32(ss, 1);
+	const __m256i ss4 = _mm256_slli_epi32(ss, 2);
+	const __m256i lt8 = _mm256_cmpgt_epi32(_mm256_slli_epi32(ss, 3), t);
+	const __m256i lt4 = _mm256_cmpgt_epi32(ss4, t);
+	t = _mm256_sub_epi32(t, _mm256_andnot_si256(lt4, ss4));
+	const __m256i lt2 = _mm256_cmpgt_epi32(ss2, t);
+	t = _mm256_sub_epi32(t, _mm256_andnot_si256(lt2, ss2));
+	const __m256i lt1 = _mm256_cmpgt_epi32(ss, t);
+	__m256i n = _mm256_or_si256(_mm256_andnot_si256(lt4, four),
+	            _mm256_or_si256(_mm256_andnot_si256(lt2, two), _mm256_andnot_si256(lt1, one)));
+	n = _mm256_or_si256(n, _mm256_andnot_si256(lt8, seven));
+
+	// Overflowed shift for abs(step) >= 32768.
+	const __m256i big = _mm256_cmpgt_epi32(a, _mm256_set1_epi32(32767));
+	const __m256i big_zero = _mm256_cmpgt_epi32(ss,
+	        _mm256_slli_epi32(_mm256_sub_epi32(_mm256_set1_epi32(65536), a), 2));
+	n = _mm256_blendv_epi8(n, _mm256_andnot_si256(big_zero, seven), big);
+
+	// ymz_step(). Both factors fit in 16 bits, so madd gives the exact product.
+	const __m256i sign = _mm256_srai_epi32(step, 31);
+	__m256i diff = _mm256_madd_epi16(_mm256_add_epi32(_mm256_slli_epi32(n, 1), one), ss);
+	diff = _mm256_min_epi32(_mm256_srai_epi32(diff, 3), _mm256_set1_epi32(32767));
+	const __m256i nstep = _mm256_srai_epi32(
+	        _mm256_madd_epi16(_mm256_permutevar8x32_epi32(step_table, n), ss), 8);
+	*step_size = _mm256_min_epi32(_mm256_max_epi32(nstep, _mm256_set1_epi32(127)),
+	                              _mm256_set1_epi32(24576));
+	const __m256i newval = _mm256_add_epi32(*history,
+	        _mm256_sub_epi32(_mm256_xor_si256(diff, sign), sign));
+	*history = _mm256_min_epi32(_mm256_max_epi32(newval, _mm256_set1_epi32(-32768)),
+	                            _mm256_set1_epi32(32767));
+
+	return _mm256_or_si256(n, _mm256_and_si256(sign, eight));
+}
+
+__attribute__((target("avx2")))
+static void ymz_multi_kernel_avx2(int32_t *history, int32_t *step_size,
+                                  const int32_t *in, uint8_t *codes, int steps)
+{
+	// Two independent halves interleave to hide each other's latency.
+	__m256i h0 = _mm256_loadu_si256((const __m256i *)(history + 0));
+	__m256i h1 = _mm256_loadu_si256((const __m256i *)(history + 8));
+	__m256i s0 = _mm256_loadu_si256((const __m256i *)(step_size + 0));
+	__m256i s1 = _mm256_loadu_si256((const __m256i *)(step_size + 8));
+
+	for (int k = 0; k < steps; k++)
+	{
+		const int32_t *x = in + k * YMZ_MULTI_LANES;
+		const __m256i n0 = ymz_lane8_avx2(_mm256_loadu_si256((const __m256i *)(x + 0)), &h0, &s0);
+		const __m256i n1 = ymz_lane8_avx2(_mm256_loadu_si256((const __m256i *)(x + 8)), &h1, &s1);
+		// packs works per 128-bit half; put the quadwords back in lane order.
+		const __m256i n16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(n0, n1), 0xD8);
+		const __m128i n8 = _mm_packus_epi16(_mm256_castsi256_si128(n16),
+		                                    _mm256_extracti128_si256(n16, 1));
+		_mm_storeu_si128((__m128i *)(codes + k * YMZ_MULTI_LANES), n8);
+	}
+
+	_mm256_storeu_si256((__m256i *)(history + 0), h0);
+	_mm256_storeu_si256((__m256i *)(history + 8), h1);
+	_mm256_storeu_si256((__m256i *)(step_size + 0), s0);
+	_mm256_storeu_si256((__m256i *)(step_size + 8), s1);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i ymz_lane4_sse41(__m128i x, __m128i *history, __m128i *step_size)
+{
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i two = _mm_set1_epi32(2);
+	const __m128i four = _mm_set1_epi32(4);
+	const __m128i seven = _mm_set1_epi32(7);
+	const __m128i eight = _mm_set1_epi32(8);
+	// step_table[] as little-endian 16-bit words, for pshufb.
+	const __m128i step_table = _mm_setr_epi16(230, 230, 230, 230, 307, 409, 512, 614);
+	const __m128i ss = *step_size;
+
+	const __m128i step = _mm_sub_epi32(_mm_and_si128(x, _mm_set1_epi32(-8)), *history);
+	const __m128i a = _mm_abs_epi32(step);
+
+	// min(7, 4a/ss) by restoring division, three quotient bits.
+	__m128i t = _mm_slli_epi32(a, 2);
+	const __m128i ss2 = _mm_slli_epi32(ss, 1);
+	const __m128i ss4 = _mm_slli_epi32(ss, 2);
+	const __m128i lt8 = _mm_cmpgt_epi32(_mm_slli_epi32(ss, 3), t);
+	const __m128i lt4 = _mm_cmpgt_epi32(ss4, t);
+	t = _mm_sub_epi32(t, _mm_andnot_si128(lt4, ss4));
+	const __m128i lt2 = _mm_cmpgt_epi32(ss2, t);
+	t = _mm_sub_epi32(t, _mm_andnot_si128(lt2, ss2));
+	const __m128i lt1 = _mm_cmpgt_epi32(ss, t);
+	__m128i n = _mm_or_si128(_mm_andnot_si128(lt4, four),
+	            _mm_or_si128(_mm_andnot_si128(lt2, two), _mm_andnot_si128(lt1, one)));
+	n = _mm_or_si128(n, _mm_andnot_si128(lt8, seven));
+
+	// Overflowed shift for abs(step) >= 32768.
+	const __m128i big = _mm_cmpgt_epi32(a, _mm_set1_epi32(32767));
+	const __m128i big_zero = _mm_cmpgt_epi32(ss,
+	        _mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(65536), a), 2));
+	n = _mm_blendv_epi8(n, _mm_andnot_si128(big_zero, seven), big);
+
+	// Table index bytes {2n, 2n+1, zero, zero} for each 32-bit lane.
+	const __m128i n2 = _mm_slli_epi32(n, 1);
+	const __m128i idx = _mm_or_si128(_mm_or_si128(n2, _mm_slli_epi32(n2, 8)),
+	                                 _mm_set1_epi32((int)0x80800100));
+	const __m128i tbl = _mm_shuffle_epi8(step_table, idx);
+
+	// ymz_step(). Both factors fit in 16 bits, so madd gives the exact product.
+	const __m128i sign = _mm_srai_epi32(step, 31);
+	__m128i diff = _mm_madd_epi16(_mm_add_epi32(n2, one), ss);
+	diff = _mm_min_epi32(_mm_srai_epi32(diff, 3), _mm_set1_epi32(32767));
+	const __m128i nstep = _mm_srai_epi32(_mm_madd_epi16(tbl, ss), 8);
+	*step_size = _mm_min_epi32(_mm_max_epi32(nstep, _mm_set1_epi32(127)),
+	                           _mm_set1_epi32(24576));
+	const __m128i newval = _mm_add_epi32(*history,
+	        _mm_sub_epi32(_mm_xor_si128(diff, sign), sign));
+	*history = _mm_min_epi32(_mm_max_epi32(newval, _mm_set1_epi32(-32768)),
+	                         _mm_set1_epi32(32767));
+
+	return _mm_or_si128(n, _mm_and_si128(sign, eight));
+}
+
+__attribute__((target("sse4.1")))
+static void ymz_multi_kernel_sse41(int32_t *history, int32_t *step_size,
+                                   const int32_t *in, uint8_t *codes, int steps)
+{
+	__m128i h[4], s[4];
+	for (int i = 0; i < 4; i++)
+	{
+		h[i] = _mm_loadu_si128((const __m128i *)(history + i * 4));
+		s[i] = _mm_loadu_si128((const __m128i *)(step_size + i * 4));
+	}
+
+	for (int k = 0; k < steps; k++)
+	{
+		const int32_t *x = in + k * YMZ_MULTI_LANES;
+		const __m128i n0 = ymz_lane4_sse41(_mm_loadu_si128((const __m128i *)(x + 0)), &h[0], &s[0]);
+		const __m128i n1 = ymz_lane4_sse41(_mm_loadu_si128((const __m128i *)(x + 4)), &h[1], &s[1]);
+		const __m128i n2 = ymz_lane4_sse41(_mm_loadu_si128((const __m128i *)(x + 8)), &h[2], &s[2]);
+		const __m128i n3 = ymz_lane4_sse41(_mm_loadu_si128((const __m128i *)(x + 12)), &h[3], &s[3]);
+		const __m128i n8 = _mm_packus_epi16(_mm_packs_epi32(n0, n1), _mm_packs_epi32(n2, n3));
+		_mm_storeu_si128((__m128i *)(codes + k * YMZ_MULTI_LANES), n8);
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		_mm_storeu_si128((__m128i *)(history + i * 4), h[i]);
+		_mm_storeu_si128((__m128i *)(step_size + i * 4), s[i]);
+	}
+}
+
+#endif  // YMZ_MULTI_X86
+
+static ymz_multi_kernel ymz_multi_select(const char **name)
+{
+#ifdef YMZ_MULTI_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		*name = "avx2";
+		return ymz_multi_kernel_avx2;
+	}
+	if (__builtin_cpu_supports("sse4.1"))
+	{
+		*name = "sse4.1";
+		return ymz_multi_kernel_sse41;
+	}
+#endif
+	*name = "scalar";
+	return NULL;
+}
+
+static ymz_multi_kernel ymz_multi_get(const char **name)
+{
+	// Selection is idempotent, so racing threads just do it twice.
+	static ymz_multi_kernel kernel;
+	static const char *kernel_name;
+	static volatile int selected;
+	if (!selected)
+	{
+		kernel = ymz_multi_select(&kernel_name);
+		__sync_synchronize();
+		selected = 1;
+	}
+	if (name)
+		*name = kernel_name;
+	return kernel;
+}
+
+const char *ymz_encoder_multi_isa(void)
+{
+	const char *name;
+	ymz_multi_get(&name);
+	return name;
+}
+
+// Encodes up to YMZ_MULTI_LANES streams with a kernel.
+static void ymz_multi_group(ymz_multi_kernel kernel,ymz_encoder **enc,const int16_t **buffer,
+                            uint8_t **outbuffer,const long *len,long *out_bytes,int count)
+{
+	int32_t history[YMZ_MULTI_LANES];
+	int32_t step_size[YMZ_MULTI_LANES];
+	long pos[YMZ_MULTI_LANES];
+	int32_t in[YMZ_MULTI_BLOCK * YMZ_MULTI_LANES];
+	uint8_t codes[YMZ_MULTI_BLOCK * YMZ_MULTI_LANES];
+
+	// Unused lanes run on silence and are never read back.
+	for (int lane = 0; lane < YMZ_MULTI_LANES; lane++)
+	{
+		history[lane] = (lane < count) ? enc[lane]->history : 0;
+		step_size[lane] = (lane < count) ? enc[lane]->step_size : 127;
+		pos[lane] = 0;
+		if (lane < count)
+			out_bytes[lane] = 0;
+	}
+
+	while (1)
+	{
+		// Advance every unfinished lane by the same amount, so each block ends
+		// exactly where the shortest remaining stream does.
+		long steps = YMZ_MULTI_BLOCK;
+		int active = 0;
+		for (int lane = 0; lane < count; lane++)
+		{
+			const long remaining = len[lane] - pos[lane];
+			if (remaining <= 0)
+				continue;
+			active++;
+			if (remaining < steps)
+				steps = remaining;
+		}
+		if (!active)
+			break;
+
+		for (int lane = 0; lane < YMZ_MULTI_LANES; lane++)
+		{
+			const int live = lane < count && pos[lane] < len[lane];
+			const int16_t *src = live ? buffer[lane] + pos[lane] : NULL;
+			for (long k = 0; k < steps; k++)
+				in[k * YMZ_MULTI_LANES + lane] = live ? src[k] : 0;
+		}
+
+		kernel(history, step_size, in, codes, steps);
+
+		// Pack nibbles per lane, continuing from each encoder's nibble phase.
+		for (int lane = 0; lane < count; lane++)
+		{
+			if (pos[lane] >= len[lane])
+				continue;
+			ymz_encoder *e = enc[lane];
+			uint8_t *out = outbuffer[lane] + out_bytes[lane];
+			uint8_t buf_sample = e->buf_sample, nibble = e->nibble;
+			for (long k = 0; k < steps; k++)
+			{
+				const uint8_t c = codes[k * YMZ_MULTI_LANES + lane];
+				if (nibble)
+					*out++ = buf_sample | c;
+				else
+					buf_sample = c << 4;
+				nibble ^= 1;
+			}
+			out_bytes[lane] = out - outbuffer[lane];
+			e->buf_sample = buf_sample;
+			e->nibble = nibble;
+			e->history = history[lane];
+			e->step_size = step_size[lane];
+			pos[lane] += steps;
+		}
+	}
+}
+
+void ymz_encoder_run_multi(ymz_encoder **enc,const int16_t **buffer,uint8_t **outbuffer,
+                           const long *len,long *out_bytes,int count)
+{
+	ymz_multi_kernel kernel = ymz_multi_get(NULL);
+	if (!kernel || count < YMZ_MULTI_MIN_STREAMS)
+	{
+		for (int i = 0; i < count; i++)
+			out_bytes[i] = ymz_encoder_run(enc[i], buffer[i], outbuffer[i], len[i]);
+		return;
+	}
+
+	for (int i = 0; i < count; i += YMZ_MULTI_LANES)
+	{
+		const int n = (count - i < YMZ_MULTI_LANES) ? count - i : YMZ_MULTI_LANES;
+		ymz_multi_group(kernel, enc + i, buffer + i, outbuffer + i, len + i, out_bytes + i, n);
+	}
+}
@@ -1,7 +1,34 @@
 #include "3rdparty/dr_wav/dr_wav_pcm.h"
+#include "3rdparty/dr_wav/dr_wav_fileops.h"
 #include "3rdparty/dr_wav/dr_wav_init.h"
 #include "3rdparty/dr_wav/dr_wav_util.h"
 
+/* MS-ADPCM and IMA-ADPCM decoding tables. */
+static const drwav_int32_t g_drwavMsAdpcmAdaptationTable[16] = {
+    230, 230, 230, 230, 307, 409, 512, 614,
+    768, 614, 512, 409, 307, 230, 230, 230};
+static const drwav_int32_t g_drwavMsAdpcmCoeff1Table[7] = {256, 512, 0,  192,
+                                                           240, 460, 392};
+static const drwav_int32_t g_drwavMsAdpcmCoeff2Table[7] = {0, -256, 0,   64,
+                                                           0, -208, -232};
+
+static const drwav_int32_t g_drwavImaIndexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+static const drwav_int32_t g_drwavImaStepTable[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,
+    16,    17,    19,    21,    23,    25,    28,    31,
+    34,    37,    41,    45,    50,    55,    60,    66,
+    73,    80,    88,    97,    107,   118,   130,   143,
+    157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,
+    724,   796,   876,   963,   1060,  1166,  1282,  1411,
+    1552,  1707,  1878,  2066,  2272,  2499,  2749,  3024,
+    3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,
+    7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767};
+
 drwav_uint64_t drwav_read_pcm_frames_s16__msadpcm(drwav *pWav,
                                                   drwav_uint64_t framesToRead,
                                                   drwav_int16_t *pBufferOut)
@@ -115,14 +142,6 @@ drwav_uint64_t drwav_read_pcm_frames_s16__msadpcm(drwav *pWav,
 			}
 			else
 			{
-				static drwav_int32_t adaptationTable[] = {
-				    230, 230, 230, 230, 307, 409, 512, 614,
-				    768, 614, 512, 409, 307, 230, 230, 230};
-				static drwav_int32_t coeff1Table[] = {256, 512, 0,  192,
-				                                      240, 460, 392};
-				static drwav_int32_t coeff2Table[] = {0, -256, 0,   64,
-				                                      0, -208, -232};
-
 				drwav_uint8_t nibbles;
 				drwav_int32_t nibble0;
 				drwav_int32_t nibble1;
@@ -152,15 +171,15 @@ drwav_uint64_t drwav_read_pcm_frames_s16__msadpcm(drwav *pWav,
 					drwav_int32_t newSample1;
 
 					newSample0 = ((pWav->msadpcm.prevFrames[0][1] *
-					               coeff1Table[pWav->msadpcm.predictor[0]]) +
+					               g_drwavMsAdpcmCoeff1Table[pWav->msadpcm.predictor[0]]) +
 					              (pWav->msadpcm.prevFrames[0][0] *
-					               coeff2Table[pWav->msadpcm.predictor[0]])) >>
+					               g_drwavMsAdpcmCoeff2Table[pWav->msadpcm.predictor[0]])) >>
 					             8;
 					newSample0 += nibble0 * pWav->msadpcm.delta[0];
 					newSample0 = drwav_clamp(newSample0, -32768, 32767);
 
 					pWav->msadpcm.delta[0] =
-					    (adaptationTable[((nibbles & 0xF0) >> 4)] *
+					    (g_drwavMsAdpcmAdaptationTable[((nibbles & 0xF0) >> 4)] *
 					     pWav->msadpcm.delta[0]) >>
 					    8;
 					if (pWav->msadpcm.delta[0] < 16)
@@ -173,15 +192,15 @@ drwav_uint64_t drwav_read_pcm_frames_s16__msadpcm(drwav *pWav,
 					pWav->msadpcm.prevFrames[0][1] = newSample0;
 
 					newSample1 = ((pWav->msadpcm.prevFrames[0][1] *
-					               coeff1Table[pWav->msadpcm.predictor[0]]) +
+					               g_drwavMsAdpcmCoeff1Table[pWav->msadpcm.predictor[0]]) +
 					              (pWav->msadpcm.prevFrames[0][0] *
-					               coeff2Table[pWav->msadpcm.predictor[0]])) >>
+					               g_drwavMsAdpcmCoeff2Table[pWav->msadpcm.predictor[0]])) >>
 					             8;
 					newSample1 += nibble1 * pWav->msadpcm.delta[0];
 					newSample1 = drwav_clamp(newSample1, -32768, 32767);
 
 					pWav->msadpcm.delta[0] =
-					    (adaptationTable[((nibbles & 0x0F) >> 0)] *
+					    (g_drwavMsAdpcmAdaptationTable[((nibbles & 0x0F) >> 0)] *
 					     pWav->msadpcm.delta[0]) >>
 					    8;
 					if (pWav->msadpcm.delta[0] < 16)
@@ -205,15 +224,15 @@ drwav_uint64_t drwav_read_pcm_frames_s16__msadpcm(drwav *pWav,
 
 					/* Left. */
 					newSample0 = ((pWav->msadpcm.prevFrames[0][1] *
-					               coeff1Table[pWav->msadpcm.predictor[0]]) +
+					               g_drwavMsAdpcmCoeff1Table[pWav->msadpcm.predictor[0]]) +
 					              (pWav->msadpcm.prevFrames[0][0] *
-					               coeff2Table[pWav->msadpcm.predictor[0]])) >>
+					               g_drwavMsAdpcmCoeff2Table[pWav->msadpcm.predictor[0]])) >>
 					             8;
 					newSample0 += nibble0 * pWav->msadpcm.delta[0];
 					newSample0 = drwav_clamp(newSample0, -32768, 32767);
 
 					pWav->msadpcm.delta[0] =
-					    (adaptationTable[((nibbles & 0xF0) >> 4)] *
+					    (g_drwavMsAdpcmAdaptationTable[((nibbles & 0xF0) >> 4)] *
 					     pWav->msadpcm.delta[0]) >>
 					    8;
 					if (pWav->msadpcm.delta[0] < 16)
@@ -227,15 +246,15 @@ drwav_uint64_t drwav_read_pcm_frames_s16__msadpcm(drwav *pWav,
 
 					/* Right. */
 					newSample1 = ((pWav->msadpcm.prevFrames[1][1] *
-					               coeff1Table[pWav->msadpcm.predictor[1]]) +
+					               g_drwavMsAdpcmCoeff1Table[pWav->msadpcm.predictor[1]]) +
 					              (pWav->msadpcm.prevFrames[1][0] *
-					               coeff2Table[pWav->msadpcm.predictor[1]])) >>
+					               g_drwavMsAdpcmCoeff2Table[pWav->msadpcm.predictor[1]])) >>
 					             8;
 					newSample1 += nibble1 * pWav->msadpcm.delta[1];
 					newSample1 = drwav_clamp(newSample1, -32768, 32767);
 
 					pWav->msadpcm.delta[1] =
-					    (adaptationTable[((nibbles & 0x0F) >> 0)] *
+					    (g_drwavMsAdpcmAdaptationTable[((nibbles & 0x0F) >> 0)] *
 					     pWav->msadpcm.delta[1]) >>
 					    8;
 					if (pWav->msadpcm.delta[1] < 16)
@@ -363,23 +382,6 @@ drwav_uint64_t drwav_read_pcm_frames_s16__ima(drwav *pWav,
 			}
 			else
 			{
-				static drwav_int32_t indexTable[16] = {
-				    -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
-
-				static drwav_int32_t stepTable[89] = {
-				    7,     8,     9,     10,    11,    12,    13,    14,
-				    16,    17,    19,    21,    23,    25,    28,    31,
-				    34,    37,    41,    45,    50,    55,    60,    66,
-				    73,    80,    88,    97,    107,   118,   130,   143,
-				    157,   173,   190,   209,   230,   253,   279,   307,
-				    337,   371,   408,   449,   494,   544,   598,   658,
-				    724,   796,   876,   963,   1060,  1166,  1282,  1411,
-				    1552,  1707,  1878,  2066,  2272,  2499,  2749,  3024,
-				    3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,
-				    7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
-				    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
-				    32767};
-
 				drwav_uint32_t iChannel;
 
 				/*
@@ -404,7 +406,7 @@ drwav_uint64_t drwav_read_pcm_frames_s16__ima(drwav *pWav,
 						drwav_uint8_t nibble1 = ((nibbles[iByte] & 0xF0) >> 4);
 
 						drwav_int32_t step =
-						    stepTable[pWav->ima.stepIndex[iChannel]];
+						    g_drwavImaStepTable[pWav->ima.stepIndex[iChannel]];
 						drwav_int32_t predictor = pWav->ima.predictor[iChannel];
 
 						drwav_int32_t diff = step >> 3;
@@ -421,15 +423,15 @@ drwav_uint64_t drwav_read_pcm_frames_s16__ima(drwav *pWav,
 						    drwav_clamp(predictor + diff, -32768, 32767);
 						pWav->ima.predictor[iChannel] = predictor;
 						pWav->ima.stepIndex[iChannel] = drwav_clamp(
-						    pWav->ima.stepIndex[iChannel] + indexTable[nibble0],
-						    0, (drwav_int32_t)drwav_countof(stepTable) - 1);
+						    pWav->ima.stepIndex[iChannel] + g_drwavImaIndexTable[nibble0],
+						    0, (drwav_int32_t)drwav_countof(g_drwavImaStepTable) - 1);
 						pWav->ima.cachedFrames
 						    [(drwav_countof(pWav->ima.cachedFrames) -
 						      (pWav->ima.cachedFrameCount * pWav->channels)) +
 						     (iByte * 2 + 0) * pWav->channels + iChannel] =
 						    predictor;
 
-						step = stepTable[pWav->ima.stepIndex[iChannel]];
+						step = g_drwavImaStepTable[pWav->ima.stepIndex[iChannel]];
 						predictor = pWav->ima.predictor[iChannel];
 
 						diff = step >> 3;
@@ -446,8 +448,8 @@ drwav_uint64_t drwav_read_pcm_frames_s16__ima(drwav *pWav,
 						    drwav_clamp(predictor + diff, -32768, 32767);
 						pWav->ima.predictor[iChannel] = predictor;
 						pWav->ima.stepIndex[iChannel] = drwav_clamp(
-						    pWav->ima.stepIndex[iChannel] + indexTable[nibble1],
-						    0, (drwav_int32_t)drwav_countof(stepTable) - 1);
+						    pWav->ima.stepIndex[iChannel] + g_drwavImaIndexTable[nibble1],
+						    0, (drwav_int32_t)drwav_countof(g_drwavImaStepTable) - 1);
 						pWav->ima.cachedFrames
 						    [(drwav_countof(pWav->ima.cachedFrames) -
 						      (pWav->ima.cachedFrameCount * pWav->channels)) +
@@ -469,6 +471,222 @@ drwav__is_compressed_format_tag(drwav_uint16_t formatTag)
 	       formatTag == DR_WAVE_FORMAT_DVI_ADPCM;
 }
 
+/*
+Block-level decoding. Every MS and IMA ADPCM block starts from the decoder
+state in its own header, so these decode one block with no state from the
+stream, giving the same frames drwav_read_pcm_frames_s16() would.
+*/
+
+static drwav_bool32 drwav__decode_block_s16__msadpcm(const drwav_uint8_t *pBlock,
+                                                     drwav_uint32_t blockAlign,
+                                                     drwav_uint32_t channels,
+                                                     drwav_int16_t *pBufferOut)
+{
+	drwav_int32_t predictor[2];
+	drwav_int32_t delta[2];
+	drwav_int32_t prevFrames[2][2];
+	drwav_uint32_t iChannel;
+	drwav_uint32_t iByte;
+
+	if (channels == 1)
+	{
+		predictor[0] = pBlock[0];
+		delta[0] = drwav__bytes_to_s16(pBlock + 1);
+		prevFrames[0][1] = drwav__bytes_to_s16(pBlock + 3);
+		prevFrames[0][0] = drwav__bytes_to_s16(pBlock + 5);
+	}
+	else
+	{
+		predictor[0] = pBlock[0];
+		predictor[1] = pBlock[1];
+		delta[0] = drwav__bytes_to_s16(pBlock + 2);
+		delta[1] = drwav__bytes_to_s16(pBlock + 4);
+		prevFrames[0][1] = drwav__bytes_to_s16(pBlock + 6);
+		prevFrames[1][1] = drwav__bytes_to_s16(pBlock + 8);
+		prevFrames[0][0] = drwav__bytes_to_s16(pBlock + 10);
+		prevFrames[1][0] = drwav__bytes_to_s16(pBlock + 12);
+	}
+
+	/* The header holds the first two frames, oldest first. */
+	for (iChannel = 0; iChannel < channels; ++iChannel)
+	{
+		if (predictor[iChannel] >= (drwav_int32_t)drwav_countof(g_drwavMsAdpcmCoeff1Table))
+		{
+			return DRWAV_FALSE;
+		}
+		pBufferOut[iChannel] = (drwav_int16_t)prevFrames[iChannel][0];
+		pBufferOut[channels + iChannel] = (drwav_int16_t)prevFrames[iChannel][1];
+	}
+	pBufferOut += channels * 2;
+
+	/* Each byte is two frames of mono or one stereo frame, high nibble first. */
+	for (iByte = 7 * channels; iByte < blockAlign; ++iByte)
+	{
+		drwav_uint32_t iNibble;
+		for (iNibble = 0; iNibble < 2; ++iNibble)
+		{
+			const drwav_uint32_t c = (channels == 1) ? 0 : iNibble;
+			const drwav_int32_t code =
+			    (iNibble == 0) ? (pBlock[iByte] >> 4) : (pBlock[iByte] & 0x0F);
+			const drwav_int32_t nibble = (code ^ 8) - 8;
+			drwav_int32_t newSample =
+			    ((prevFrames[c][1] * g_drwavMsAdpcmCoeff1Table[predictor[c]]) +
+			     (prevFrames[c][0] * g_drwavMsAdpcmCoeff2Table[predictor[c]])) >>
+			    8;
+			newSample += nibble * delta[c];
+			newSample = drwav_clamp(newSample, -32768, 32767);
+
+			delta[c] = (g_drwavMsAdpcmAdaptationTable[code] * delta[c]) >> 8;
+			if (delta[c] < 16)
+			{
+				delta[c] = 16;
+			}
+
+			prevFrames[c][0] = prevFrames[c][1];
+			prevFrames[c][1] = newSample;
+			*pBufferOut++ = (drwav_int16_t)newSample;
+		}
+	}
+
+	return DRWAV_TRUE;
+}
+
+static drwav_bool32 drwav__decode_block_s16__ima(const drwav_uint8_t *pBlock,
+                                                 drwav_uint32_t blockAlign,
+                                                 drwav_uint32_t channels,
+                                                 drwav_int16_t *pBufferOut)
+{
+	drwav_int32_t predictor[2];
+	drwav_int32_t stepIndex[2];
+	drwav_uint32_t iChannel;
+	drwav_uint32_t iPos;
+
+	/* The header holds the first frame. */
+	for (iChannel = 0; iChannel < channels; ++iChannel)
+	{
+		predictor[iChannel] = drwav__bytes_to_s16(pBlock + iChannel * 4);
+		stepIndex[iChannel] = pBlock[iChannel * 4 + 2];
+		if (stepIndex[iChannel] >= (drwav_int32_t)drwav_countof(g_drwavImaStepTable))
+		{
+			return DRWAV_FALSE;
+		}
+		pBufferOut[iChannel] = (drwav_int16_t)predictor[iChannel];
+	}
+	pBufferOut += channels;
+
+	/* Then 8 frames at a time: 4 bytes for each channel in turn, low nibble
+	 * first. */
+	for (iPos = 4 * channels; iPos < blockAlign; iPos += 4 * channels)
+	{
+		for (iChannel = 0; iChannel < channels; ++iChannel)
+		{
+			drwav_uint32_t iNibble;
+			for (iNibble = 0; iNibble < 8; ++iNibble)
+			{
+				const drwav_uint8_t nibbles = pBlock[iPos + iChannel * 4 + iNibble / 2];
+				const drwav_uint8_t nibble =
+				    (iNibble & 1) ? (nibbles >> 4) : (nibbles & 0x0F);
+				const drwav_int32_t step = g_drwavImaStepTable[stepIndex[iChannel]];
+
+				drwav_int32_t diff = step >> 3;
+				if (nibble & 1)
+					diff += step >> 2;
+				if (nibble & 2)
+					diff += step >> 1;
+				if (nibble & 4)
+					diff += step;
+				if (nibble & 8)
+					diff = -diff;
+
+				predictor[iChannel] =
+				    drwav_clamp(predictor[iChannel] + diff, -32768, 32767);
+				stepIndex[iChannel] = drwav_clamp(
+				    stepIndex[iChannel] + g_drwavImaIndexTable[nibble], 0,
+				    (drwav_int32_t)drwav_countof(g_drwavImaStepTable) - 1);
+				pBufferOut[iNibble * channels + iChannel] =
+				    (drwav_int16_t)predictor[iChannel];
+			}
+		}
+		pBufferOut += 8 * channels;
+	}
+
+	return DRWAV_TRUE;
+}
+
+drwav_uint64_t drwav_get_block_frame_count(const drwav *pWav)
+{
+	const drwav_uint32_t blockAlign = pWav->fmt.blockAlign;
+	const drwav_uint32_t channels = pWav->channels;
+
+	if (channels < 1 || channels > 2)
+	{
+		return 0;
+	}
+	if (pWav->translatedFormatTag == DR_WAVE_FORMAT_ADPCM)
+	{
+		if (blockAlign < 7 * channels)
+		{
+			return 0;
+		}
+		return 2 + (blockAlign - 7 * channels) * 2 / channels;
+	}
+	if (pWav->translatedFormatTag == DR_WAVE_FORMAT_DVI_ADPCM)
+	{
+		/* The stream decoder reads whole groups of 4 bytes per channel, so
+		 * only blocks made of whole groups decode the same way. */
+		if (blockAlign < 4 * channels || (blockAlign - 4 * channels) % (4 * channels) != 0)
+		{
+			return 0;
+		}
+		return 1 + (blockAlign - 4 * channels) / (4 * channels) * 8;
+	}
+	return 0;
+}
+
+drwav_bool32 drwav_decode_block_s16(const drwav *pWav, const void *pBlock,
+                                    drwav_int16_t *pBufferOut)
+{
+	if (drwav_get_block_frame_count(pWav) == 0)
+	{
+		return DRWAV_FALSE;
+	}
+	if (pWav->translatedFormatTag == DR_WAVE_FORMAT_ADPCM)
+	{
+		return drwav__decode_block_s16__msadpcm((const drwav_uint8_t *)pBlock,
+		                                        pWav->fmt.blockAlign,
+		                                        pWav->channels, pBufferOut);
+	}
+	return drwav__decode_block_s16__ima((const drwav_uint8_t *)pBlock,
+	                                    pWav->fmt.blockAlign, pWav->channels,
+	                                    pBufferOut);
+}
+
+drwav_bool32 drwav_seek_to_block(drwav *pWav, drwav_uint64_t blockIndex)
+{
+	const drwav_uint64_t framesPerBlock = drwav_get_block_frame_count(pWav);
+	const drwav_uint64_t offset = blockIndex * pWav->fmt.blockAlign;
+
+	if (pWav->onWrite != NULL || framesPerBlock == 0 ||
+	    offset > pWav->dataChunkDataSize)
+	{
+		return DRWAV_FALSE;
+	}
+	if (!drwav__seek_from_start(pWav->onSeek, pWav->dataChunkDataPos + offset,
+	                            pWav->pUserData))
+	{
+		return DRWAV_FALSE;
+	}
+
+	/* Nothing cached: the next read starts by loading the block's header. */
+	pWav->compressed.iCurrentPCMFrame = blockIndex * framesPerBlock;
+	pWav->bytesRemaining = pWav->dataChunkDataSize - offset;
+	pWav->msadpcm.cachedFrameCount = 0;
+	pWav->msadpcm.bytesRemainingInBlock = 0;
+	pWav->ima.cachedFrameCount = 0;
+	pWav->ima.bytesRemainingInBlock = 0;
+	return DRWAV_TRUE;
+}
+
 drwav_uint64_t drwav_read_pcm_frames_s16__msadpcm(drwav *pWav,
                                                   drwav_uint64_t samplesToRead,
                                                   drwav_int16_t *pBufferOut);
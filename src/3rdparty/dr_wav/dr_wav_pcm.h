@@ -10,6 +10,29 @@ drwav_uint64_t drwav_read_pcm_frames_s16__ima(drwav *pWav,
                                               drwav_uint64_t framesToRead,
                                               drwav_int16_t *pBufferOut);
 
+/*
+Block-level access to MS and IMA ADPCM streams.
+
+Each block of these formats starts with its own decoder state, so blocks can
+be decoded independently and in any order, with the same result as
+drwav_read_pcm_frames_s16().
+
+drwav_get_block_frame_count() returns the number of PCM frames in each
+fmt.blockAlign-byte block, or 0 if the stream is neither MS nor IMA ADPCM or
+its blocks are laid out in a way the block decoder doesn't handle.
+
+drwav_decode_block_s16() decodes one whole block into pBufferOut, which needs
+room for drwav_get_block_frame_count() frames. Returns false if the block's
+header is invalid.
+
+drwav_seek_to_block() positions the stream at the start of a block, so the
+next read continues from there without decoding anything before it.
+*/
+drwav_uint64_t drwav_get_block_frame_count(const drwav *pWav);
+drwav_bool32 drwav_decode_block_s16(const drwav *pWav, const void *pBlock,
+                                    drwav_int16_t *pBufferOut);
+drwav_bool32 drwav_seek_to_block(drwav *pWav, drwav_uint64_t blockIndex);
+
 /*
 Reads up to the specified number of PCM frames from the WAV file.
 
@@ -1,6 +1,7 @@
 #include "3rdparty/dr_wav/dr_wav_pcm_conv.h"
 #include "3rdparty/dr_wav/dr_wav_init.h"
 #include "3rdparty/dr_wav/dr_wav_pcm.h"
+#include "3rdparty/dr_wav/dr_wav_pcm_simd.h"
 #include "3rdparty/dr_wav/dr_wav_util.h"
 
 #ifndef DR_WAV_NO_CONVERSION_API
@@ -389,8 +390,8 @@ drwav_uint64_t drwav_read_pcm_frames_s16be(drwav *pWav,
 	return framesRead;
 }
 
-void drwav_u8_to_s16(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
-                     size_t sampleCount)
+void drwav__u8_to_s16_scalar(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
+                             size_t sampleCount)
 {
 	int r;
 	size_t i;
@@ -403,8 +404,8 @@ void drwav_u8_to_s16(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
 	}
 }
 
-void drwav_s24_to_s16(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
-                      size_t sampleCount)
+void drwav__s24_to_s16_scalar(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
+                              size_t sampleCount)
 {
 	int r;
 	size_t i;
@@ -422,8 +423,8 @@ void drwav_s24_to_s16(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
 	}
 }
 
-void drwav_s32_to_s16(drwav_int16_t *pOut, const drwav_int32_t *pIn,
-                      size_t sampleCount)
+void drwav__s32_to_s16_scalar(drwav_int16_t *pOut, const drwav_int32_t *pIn,
+                              size_t sampleCount)
 {
 	int r;
 	size_t i;
@@ -435,7 +436,8 @@ void drwav_s32_to_s16(drwav_int16_t *pOut, const drwav_int32_t *pIn,
 	}
 }
 
-void drwav_f32_to_s16(drwav_int16_t *pOut, const float *pIn, size_t sampleCount)
+void drwav__f32_to_s16_scalar(drwav_int16_t *pOut, const float *pIn,
+                              size_t sampleCount)
 {
 	int r;
 	size_t i;
@@ -451,8 +453,8 @@ void drwav_f32_to_s16(drwav_int16_t *pOut, const float *pIn, size_t sampleCount)
 	}
 }
 
-void drwav_f64_to_s16(drwav_int16_t *pOut, const double *pIn,
-                      size_t sampleCount)
+void drwav__f64_to_s16_scalar(drwav_int16_t *pOut, const double *pIn,
+                              size_t sampleCount)
 {
 	int r;
 	size_t i;
@@ -468,6 +470,37 @@ void drwav_f64_to_s16(drwav_int16_t *pOut, const double *pIn,
 	}
 }
 
+/* The public converters use the fastest kernels the CPU supports. */
+
+void drwav_u8_to_s16(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
+                     size_t sampleCount)
+{
+	drwav_pcm_kernels_get()->u8_to_s16(pOut, pIn, sampleCount);
+}
+
+void drwav_s24_to_s16(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
+                      size_t sampleCount)
+{
+	drwav_pcm_kernels_get()->s24_to_s16(pOut, pIn, sampleCount);
+}
+
+void drwav_s32_to_s16(drwav_int16_t *pOut, const drwav_int32_t *pIn,
+                      size_t sampleCount)
+{
+	drwav_pcm_kernels_get()->s32_to_s16(pOut, pIn, sampleCount);
+}
+
+void drwav_f32_to_s16(drwav_int16_t *pOut, const float *pIn, size_t sampleCount)
+{
+	drwav_pcm_kernels_get()->f32_to_s16(pOut, pIn, sampleCount);
+}
+
+void drwav_f64_to_s16(drwav_int16_t *pOut, const double *pIn,
+                      size_t sampleCount)
+{
+	drwav_pcm_kernels_get()->f64_to_s16(pOut, pIn, sampleCount);
+}
+
 void drwav_alaw_to_s16(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
                        size_t sampleCount)
 {
@@ -0,0 +1,445 @@
+/*
+Vectorized sample format conversion.
+
+Each kernel handles whole vectors and leaves the tail to the scalar version,
+so any table is bit-exact with the scalar one. The float conversions mirror
+the scalar expression step by step: the clamp is done with compares rather
+than min/max so NaN passes through to the truncating convert as it does in C,
+and the result is truncated to 16 bits rather than saturated.
+*/
+
+#include "3rdparty/dr_wav/dr_wav_pcm_simd.h"
+#include "3rdparty/dr_wav/dr_wav_util.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define DRWAV_PCM_X86 1
+#include <immintrin.h>
+#endif
+
+static void drwav__bswap16_scalar(void *pSamples, drwav_uint64_t sampleCount)
+{
+	drwav_uint16_t *p = (drwav_uint16_t *)pSamples;
+	drwav_uint64_t i;
+	for (i = 0; i < sampleCount; ++i) { p[i] = drwav__bswap16(p[i]); }
+}
+
+static void drwav__bswap32_scalar(void *pSamples, drwav_uint64_t sampleCount)
+{
+	drwav_uint32_t *p = (drwav_uint32_t *)pSamples;
+	drwav_uint64_t i;
+	for (i = 0; i < sampleCount; ++i) { p[i] = drwav__bswap32(p[i]); }
+}
+
+static void drwav__bswap64_scalar(void *pSamples, drwav_uint64_t sampleCount)
+{
+	drwav_uint64_t *p = (drwav_uint64_t *)pSamples;
+	drwav_uint64_t i;
+	for (i = 0; i < sampleCount; ++i) { p[i] = drwav__bswap64(p[i]); }
+}
+
+static const drwav_pcm_kernels g_drwavPcmKernelsScalar = {
+	"scalar",
+	drwav__u8_to_s16_scalar,
+	drwav__s24_to_s16_scalar,
+	drwav__s32_to_s16_scalar,
+	drwav__f32_to_s16_scalar,
+	drwav__f64_to_s16_scalar,
+	drwav__bswap16_scalar,
+	drwav__bswap32_scalar,
+	drwav__bswap64_scalar,
+};
+
+#ifdef DRWAV_PCM_X86
+
+/* SSE2 */
+
+/* Keeps the low 16 bits of each 32-bit lane, sign-extended, so that packing
+ * truncates like a cast to short instead of saturating. */
+static DRWAV_INLINE __m128i drwav__trunc16_sse2(__m128i x)
+{
+	return _mm_srai_epi32(_mm_slli_epi32(x, 16), 16);
+}
+
+static DRWAV_INLINE __m128i drwav__bswap16_x8_sse2(__m128i x)
+{
+	return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+
+static void drwav__u8_to_s16_sse2(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
+                                  size_t sampleCount)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	size_t i = 0;
+	for (; i + 16 <= sampleCount; i += 16)
+	{
+		const __m128i x = _mm_loadu_si128((const __m128i *)(pIn + i));
+		/* (x << 8) - 32768, which for 16 bits is flipping the sign bit. */
+		_mm_storeu_si128((__m128i *)(pOut + i), _mm_xor_si128(_mm_unpacklo_epi8(zero, x), bias));
+		_mm_storeu_si128((__m128i *)(pOut + i + 8), _mm_xor_si128(_mm_unpackhi_epi8(zero, x), bias));
+	}
+	drwav__u8_to_s16_scalar(pOut + i, pIn + i, sampleCount - i);
+}
+
+static void drwav__s32_to_s16_sse2(drwav_int16_t *pOut, const drwav_int32_t *pIn,
+                                   size_t sampleCount)
+{
+	size_t i = 0;
+	for (; i + 8 <= sampleCount; i += 8)
+	{
+		const __m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(pIn + i)), 16);
+		const __m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(pIn + i + 4)), 16);
+		_mm_storeu_si128((__m128i *)(pOut + i), _mm_packs_epi32(a, b));
+	}
+	drwav__s32_to_s16_scalar(pOut + i, pIn + i, sampleCount - i);
+}
+
+static DRWAV_INLINE __m128i drwav__f32x4_to_s32_sse2(__m128 x)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 minus_one = _mm_set1_ps(-1.0f);
+	const __m128 below = _mm_cmplt_ps(x, minus_one);
+	const __m128 above = _mm_cmpgt_ps(x, one);
+	__m128 c = _mm_or_ps(_mm_andnot_ps(above, x), _mm_and_ps(above, one));
+	c = _mm_or_ps(_mm_andnot_ps(below, c), _mm_and_ps(below, minus_one));
+	c = _mm_add_ps(c, one);
+	const __m128i r = _mm_cvttps_epi32(_mm_mul_ps(c, _mm_set1_ps(32767.5f)));
+	return drwav__trunc16_sse2(_mm_sub_epi32(r, _mm_set1_epi32(32768)));
+}
+
+static void drwav__f32_to_s16_sse2(drwav_int16_t *pOut, const float *pIn, size_t sampleCount)
+{
+	size_t i = 0;
+	for (; i + 8 <= sampleCount; i += 8)
+	{
+		const __m128i a = drwav__f32x4_to_s32_sse2(_mm_loadu_ps(pIn + i));
+		const __m128i b = drwav__f32x4_to_s32_sse2(_mm_loadu_ps(pIn + i + 4));
+		_mm_storeu_si128((__m128i *)(pOut + i), _mm_packs_epi32(a, b));
+	}
+	drwav__f32_to_s16_scalar(pOut + i, pIn + i, sampleCount - i);
+}
+
+/* Two doubles to two ints, in the low half. */
+static DRWAV_INLINE __m128i drwav__f64x2_to_s32_sse2(__m128d x)
+{
+	const __m128d one = _mm_set1_pd(1.0);
+	const __m128d minus_one = _mm_set1_pd(-1.0);
+	const __m128d below = _mm_cmplt_pd(x, minus_one);
+	const __m128d above = _mm_cmpgt_pd(x, one);
+	__m128d c = _mm_or_pd(_mm_andnot_pd(above, x), _mm_and_pd(above, one));
+	c = _mm_or_pd(_mm_andnot_pd(below, c), _mm_and_pd(below, minus_one));
+	c = _mm_add_pd(c, one);
+	return _mm_cvttpd_epi32(_mm_mul_pd(c, _mm_set1_pd(32767.5)));
+}
+
+static void drwav__f64_to_s16_sse2(drwav_int16_t *pOut, const double *pIn, size_t sampleCount)
+{
+	const __m128i bias = _mm_set1_epi32(32768);
+	size_t i = 0;
+	for (; i + 8 <= sampleCount; i += 8)
+	{
+		__m128i a = _mm_unpacklo_epi64(drwav__f64x2_to_s32_sse2(_mm_loadu_pd(pIn + i)),
+		                               drwav__f64x2_to_s32_sse2(_mm_loadu_pd(pIn + i + 2)));
+		__m128i b = _mm_unpacklo_epi64(drwav__f64x2_to_s32_sse2(_mm_loadu_pd(pIn + i + 4)),
+		                               drwav__f64x2_to_s32_sse2(_mm_loadu_pd(pIn + i + 6)));
+		a = drwav__trunc16_sse2(_mm_sub_epi32(a, bias));
+		b = drwav__trunc16_sse2(_mm_sub_epi32(b, bias));
+		_mm_storeu_si128((__m128i *)(pOut + i), _mm_packs_epi32(a, b));
+	}
+	drwav__f64_to_s16_scalar(pOut + i, pIn + i, sampleCount - i);
+}
+
+static void drwav__bswap16_sse2(void *pSamples, drwav_uint64_t sampleCount)
+{
+	drwav_uint16_t *p = (drwav_uint16_t *)pSamples;
+	drwav_uint64_t i = 0;
+	for (; i + 8 <= sampleCount; i += 8)
+	{
+		const __m128i x = _mm_loadu_si128((const __m128i *)(p + i));
+		_mm_storeu_si128((__m128i *)(p + i), drwav__bswap16_x8_sse2(x));
+	}
+	drwav__bswap16_scalar(p + i, sampleCount - i);
+}
+
+static void drwav__bswap32_sse2(void *pSamples, drwav_uint64_t sampleCount)
+{
+	drwav_uint32_t *p = (drwav_uint32_t *)pSamples;
+	drwav_uint64_t i = 0;
+	for (; i + 4 <= sampleCount; i += 4)
+	{
+		/* Swap the bytes of each half, then the halves. */
+		__m128i x = drwav__bswap16_x8_sse2(_mm_loadu_si128((const __m128i *)(p + i)));
+		x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+		x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+		_mm_storeu_si128((__m128i *)(p + i), x);
+	}
+	drwav__bswap32_scalar(p + i, sampleCount - i);
+}
+
+static void drwav__bswap64_sse2(void *pSamples, drwav_uint64_t sampleCount)
+{
+	drwav_uint64_t *p = (drwav_uint64_t *)pSamples;
+	drwav_uint64_t i = 0;
+	for (; i + 2 <= sampleCount; i += 2)
+	{
+		__m128i x = drwav__bswap16_x8_sse2(_mm_loadu_si128((const __m128i *)(p + i)));
+		x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+		x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+		_mm_storeu_si128((__m128i *)(p + i), x);
+	}
+	drwav__bswap64_scalar(p + i, sampleCount - i);
+}
+
+static const drwav_pcm_kernels g_drwavPcmKernelsSse2 = {
+	"sse2",
+	drwav__u8_to_s16_sse2,
+	drwav__s24_to_s16_scalar, /* Needs a byte shuffle; see SSSE3. */
+	drwav__s32_to_s16_sse2,
+	drwav__f32_to_s16_sse2,
+	drwav__f64_to_s16_sse2,
+	drwav__bswap16_sse2,
+	drwav__bswap32_sse2,
+	drwav__bswap64_sse2,
+};
+
+/* SSSE3: SSE2 plus byte shuffles for the 24-bit unpacking. */
+
+__attribute__((target("ssse3")))
+static void drwav__s24_to_s16_ssse3(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
+                                    size_t sampleCount)
+{
+	/* The result is the top two bytes of each sample. Each 16-byte load
+	 * covers four samples and reads four bytes past them. */
+	const __m128i pick = _mm_setr_epi8(1, 2, 4, 5, 7, 8, 10, 11,
+	                                   -1, -1, -1, -1, -1, -1, -1, -1);
+	size_t i = 0;
+	for (; (i + 8) * 3 + 4 <= sampleCount * 3; i += 8)
+	{
+		const __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pIn + i * 3)), pick);
+		const __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(pIn + i * 3 + 12)), pick);
+		_mm_storeu_si128((__m128i *)(pOut + i), _mm_unpacklo_epi64(a, b));
+	}
+	drwav__s24_to_s16_scalar(pOut + i, pIn + i * 3, sampleCount - i);
+}
+
+static const drwav_pcm_kernels g_drwavPcmKernelsSsse3 = {
+	"ssse3",
+	drwav__u8_to_s16_sse2,
+	drwav__s24_to_s16_ssse3,
+	drwav__s32_to_s16_sse2,
+	drwav__f32_to_s16_sse2,
+	drwav__f64_to_s16_sse2,
+	drwav__bswap16_sse2,
+	drwav__bswap32_sse2,
+	drwav__bswap64_sse2,
+};
+
+/* AVX2 */
+
+/* packs works within 128-bit lanes; this puts the four quarters back in
+ * order. */
+#define DRWAV_AVX2_UNLANE(x) _mm256_permute4x64_epi64((x), _MM_SHUFFLE(3, 1, 2, 0))
+
+__attribute__((target("avx2")))
+static void drwav__u8_to_s16_avx2(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
+                                  size_t sampleCount)
+{
+	const __m256i bias = _mm256_set1_epi16((short)0x8000);
+	size_t i = 0;
+	for (; i + 32 <= sampleCount; i += 32)
+	{
+		const __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pIn + i)));
+		const __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pIn + i + 16)));
+		_mm256_storeu_si256((__m256i *)(pOut + i), _mm256_xor_si256(_mm256_slli_epi16(a, 8), bias));
+		_mm256_storeu_si256((__m256i *)(pOut + i + 16), _mm256_xor_si256(_mm256_slli_epi16(b, 8), bias));
+	}
+	drwav__u8_to_s16_scalar(pOut + i, pIn + i, sampleCount - i);
+}
+
+__attribute__((target("avx2")))
+static void drwav__s24_to_s16_avx2(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
+                                   size_t sampleCount)
+{
+	/* As the SSSE3 version, with two loads per register. */
+	const __m256i pick = _mm256_setr_epi8(1, 2, 4, 5, 7, 8, 10, 11,
+	                                      -1, -1, -1, -1, -1, -1, -1, -1,
+	                                      1, 2, 4, 5, 7, 8, 10, 11,
+	                                      -1, -1, -1, -1, -1, -1, -1, -1);
+	size_t i = 0;
+	for (; (i + 16) * 3 + 4 <= sampleCount * 3; i += 16)
+	{
+		const drwav_uint8_t *p = pIn + i * 3;
+		__m256i a = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p));
+		a = _mm256_inserti128_si256(a, _mm_loadu_si128((const __m128i *)(p + 12)), 1);
+		__m256i b = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p + 24)));
+		b = _mm256_inserti128_si256(b, _mm_loadu_si128((const __m128i *)(p + 36)), 1);
+		/* Samples 0-3 8-11 | 4-7 12-15 */
+		const __m256i x = _mm256_unpacklo_epi64(_mm256_shuffle_epi8(a, pick),
+		                                        _mm256_shuffle_epi8(b, pick));
+		_mm256_storeu_si256((__m256i *)(pOut + i), DRWAV_AVX2_UNLANE(x));
+	}
+	drwav__s24_to_s16_scalar(pOut + i, pIn + i * 3, sampleCount - i);
+}
+
+__attribute__((target("avx2")))
+static void drwav__s32_to_s16_avx2(drwav_int16_t *pOut, const drwav_int32_t *pIn,
+                                   size_t sampleCount)
+{
+	size_t i = 0;
+	for (; i + 16 <= sampleCount; i += 16)
+	{
+		const __m256i a = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)(pIn + i)), 16);
+		const __m256i b = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)(pIn + i + 8)), 16);
+		_mm256_storeu_si256((__m256i *)(pOut + i), DRWAV_AVX2_UNLANE(_mm256_packs_epi32(a, b)));
+	}
+	drwav__s32_to_s16_scalar(pOut + i, pIn + i, sampleCount - i);
+}
+
+__attribute__((target("avx2")))
+static DRWAV_INLINE __m256i drwav__f32x8_to_s32_avx2(__m256 x)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+	const __m256 minus_one = _mm256_set1_ps(-1.0f);
+	__m256 c = _mm256_blendv_ps(x, one, _mm256_cmp_ps(x, one, _CMP_GT_OQ));
+	c = _mm256_blendv_ps(c, minus_one, _mm256_cmp_ps(x, minus_one, _CMP_LT_OQ));
+	c = _mm256_add_ps(c, one);
+	const __m256i r = _mm256_cvttps_epi32(_mm256_mul_ps(c, _mm256_set1_ps(32767.5f)));
+	const __m256i s = _mm256_sub_epi32(r, _mm256_set1_epi32(32768));
+	return _mm256_srai_epi32(_mm256_slli_epi32(s, 16), 16);
+}
+
+__attribute__((target("avx2")))
+static void drwav__f32_to_s16_avx2(drwav_int16_t *pOut, const float *pIn, size_t sampleCount)
+{
+	size_t i = 0;
+	for (; i + 16 <= sampleCount; i += 16)
+	{
+		const __m256i a = drwav__f32x8_to_s32_avx2(_mm256_loadu_ps(pIn + i));
+		const __m256i b = drwav__f32x8_to_s32_avx2(_mm256_loadu_ps(pIn + i + 8));
+		_mm256_storeu_si256((__m256i *)(pOut + i), DRWAV_AVX2_UNLANE(_mm256_packs_epi32(a, b)));
+	}
+	drwav__f32_to_s16_scalar(pOut + i, pIn + i, sampleCount - i);
+}
+
+/* Four doubles to four ints. */
+__attribute__((target("avx2")))
+static DRWAV_INLINE __m128i drwav__f64x4_to_s32_avx2(__m256d x)
+{
+	const __m256d one = _mm256_set1_pd(1.0);
+	const __m256d minus_one = _mm256_set1_pd(-1.0);
+	__m256d c = _mm256_blendv_pd(x, one, _mm256_cmp_pd(x, one, _CMP_GT_OQ));
+	c = _mm256_blendv_pd(c, minus_one, _mm256_cmp_pd(x, minus_one, _CMP_LT_OQ));
+	c = _mm256_add_pd(c, one);
+	const __m128i r = _mm256_cvttpd_epi32(_mm256_mul_pd(c, _mm256_set1_pd(32767.5)));
+	const __m128i s = _mm_sub_epi32(r, _mm_set1_epi32(32768));
+	return _mm_srai_epi32(_mm_slli_epi32(s, 16), 16);
+}
+
+__attribute__((target("avx2")))
+static void drwav__f64_to_s16_avx2(drwav_int16_t *pOut, const double *pIn, size_t sampleCount)
+{
+	size_t i = 0;
+	for (; i + 16 <= sampleCount; i += 16)
+	{
+		const __m128i a = drwav__f64x4_to_s32_avx2(_mm256_loadu_pd(pIn + i));
+		const __m128i b = drwav__f64x4_to_s32_avx2(_mm256_loadu_pd(pIn + i + 4));
+		const __m128i c = drwav__f64x4_to_s32_avx2(_mm256_loadu_pd(pIn + i + 8));
+		const __m128i d = drwav__f64x4_to_s32_avx2(_mm256_loadu_pd(pIn + i + 12));
+		_mm_storeu_si128((__m128i *)(pOut + i), _mm_packs_epi32(a, b));
+		_mm_storeu_si128((__m128i *)(pOut + i + 8), _mm_packs_epi32(c, d));
+	}
+	drwav__f64_to_s16_scalar(pOut + i, pIn + i, sampleCount - i);
+}
+
+/* Byte swaps are a single shuffle per register. */
+__attribute__((target("avx2")))
+static DRWAV_INLINE void drwav__bswap_avx2(drwav_uint8_t *p, drwav_uint64_t bytes, __m256i order)
+{
+	drwav_uint64_t i;
+	for (i = 0; i + 32 <= bytes; i += 32)
+	{
+		const __m256i x = _mm256_loadu_si256((const __m256i *)(p + i));
+		_mm256_storeu_si256((__m256i *)(p + i), _mm256_shuffle_epi8(x, order));
+	}
+}
+
+__attribute__((target("avx2")))
+static void drwav__bswap16_avx2(void *pSamples, drwav_uint64_t sampleCount)
+{
+	const __m256i order = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+	                                       1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	const drwav_uint64_t done = sampleCount & ~(drwav_uint64_t)15;
+	drwav__bswap_avx2((drwav_uint8_t *)pSamples, done * 2, order);
+	drwav__bswap16_scalar((drwav_uint16_t *)pSamples + done, sampleCount - done);
+}
+
+__attribute__((target("avx2")))
+static void drwav__bswap32_avx2(void *pSamples, drwav_uint64_t sampleCount)
+{
+	const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+	                                       3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	const drwav_uint64_t done = sampleCount & ~(drwav_uint64_t)7;
+	drwav__bswap_avx2((drwav_uint8_t *)pSamples, done * 4, order);
+	drwav__bswap32_scalar((drwav_uint32_t *)pSamples + done, sampleCount - done);
+}
+
+__attribute__((target("avx2")))
+static void drwav__bswap64_avx2(void *pSamples, drwav_uint64_t sampleCount)
+{
+	const __m256i order = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+	                                       7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	const drwav_uint64_t done = sampleCount & ~(drwav_uint64_t)3;
+	drwav__bswap_avx2((drwav_uint8_t *)pSamples, done * 8, order);
+	drwav__bswap64_scalar((drwav_uint64_t *)pSamples + done, sampleCount - done);
+}
+
+static const drwav_pcm_kernels g_drwavPcmKernelsAvx2 = {
+	"avx2",
+	drwav__u8_to_s16_avx2,
+	drwav__s24_to_s16_avx2,
+	drwav__s32_to_s16_avx2,
+	drwav__f32_to_s16_avx2,
+	drwav__f64_to_s16_avx2,
+	drwav__bswap16_avx2,
+	drwav__bswap32_avx2,
+	drwav__bswap64_avx2,
+};
+
+#endif /* DRWAV_PCM_X86 */
+
+static const drwav_pcm_kernels *g_drwavPcmKernelsAll[4];
+static size_t g_drwavPcmKernelsCount;
+
+static void drwav__pcm_kernels_select(void)
+{
+	size_t count = 0;
+	g_drwavPcmKernelsAll[count++] = &g_drwavPcmKernelsScalar;
+#ifdef DRWAV_PCM_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) g_drwavPcmKernelsAll[count++] = &g_drwavPcmKernelsSse2;
+	if (__builtin_cpu_supports("ssse3")) g_drwavPcmKernelsAll[count++] = &g_drwavPcmKernelsSsse3;
+	if (__builtin_cpu_supports("avx2")) g_drwavPcmKernelsAll[count++] = &g_drwavPcmKernelsAvx2;
+#endif
+	g_drwavPcmKernelsCount = count;
+}
+
+const drwav_pcm_kernels *const *drwav_pcm_kernels_all(size_t *pCount)
+{
+	/* Selection is idempotent, so racing threads just do it twice. */
+	static volatile int selected;
+	if (!selected)
+	{
+		drwav__pcm_kernels_select();
+		__sync_synchronize();
+		selected = 1;
+	}
+	if (pCount) *pCount = g_drwavPcmKernelsCount;
+	return g_drwavPcmKernelsAll;
+}
+
+const drwav_pcm_kernels *drwav_pcm_kernels_get(void)
+{
+	size_t count;
+	const drwav_pcm_kernels *const *all = drwav_pcm_kernels_all(&count);
+	return all[count - 1];
+}
@@ -0,0 +1,50 @@
+#ifndef DR_WAV_PCM_SIMD_H
+#define DR_WAV_PCM_SIMD_H
+
+#include "3rdparty/dr_wav/dr_wav_types.h"
+
+/*
+Sample format conversion kernels.
+
+drwav_u8_to_s16() and friends, and the byte swaps applied to big-endian files,
+go through a table of kernels picked once for the CPU the program runs on.
+Every table produces exactly the same output as the scalar one, including for
+out-of-range and NaN float input.
+*/
+
+typedef struct
+{
+	const char *name;
+	void (*u8_to_s16)(drwav_int16_t *pOut, const drwav_uint8_t *pIn, size_t sampleCount);
+	void (*s24_to_s16)(drwav_int16_t *pOut, const drwav_uint8_t *pIn, size_t sampleCount);
+	void (*s32_to_s16)(drwav_int16_t *pOut, const drwav_int32_t *pIn, size_t sampleCount);
+	void (*f32_to_s16)(drwav_int16_t *pOut, const float *pIn, size_t sampleCount);
+	void (*f64_to_s16)(drwav_int16_t *pOut, const double *pIn, size_t sampleCount);
+	/* In-place byte swaps of 16-, 32- and 64-bit samples. */
+	void (*bswap16)(void *pSamples, drwav_uint64_t sampleCount);
+	void (*bswap32)(void *pSamples, drwav_uint64_t sampleCount);
+	void (*bswap64)(void *pSamples, drwav_uint64_t sampleCount);
+} drwav_pcm_kernels;
+
+/* The kernels in use: the fastest table this CPU supports. */
+const drwav_pcm_kernels *drwav_pcm_kernels_get(void);
+
+/*
+Every table this CPU supports, scalar first and the one drwav_pcm_kernels_get()
+returns last. Sets *pCount to the number of tables.
+*/
+const drwav_pcm_kernels *const *drwav_pcm_kernels_all(size_t *pCount);
+
+/* The portable versions, used by the scalar table and for loop tails. */
+void drwav__u8_to_s16_scalar(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
+                             size_t sampleCount);
+void drwav__s24_to_s16_scalar(drwav_int16_t *pOut, const drwav_uint8_t *pIn,
+                              size_t sampleCount);
+void drwav__s32_to_s16_scalar(drwav_int16_t *pOut, const drwav_int32_t *pIn,
+                              size_t sampleCount);
+void drwav__f32_to_s16_scalar(drwav_int16_t *pOut, const float *pIn,
+                              size_t sampleCount);
+void drwav__f64_to_s16_scalar(drwav_int16_t *pOut, const double *pIn,
+                              size_t sampleCount);
+
+#endif
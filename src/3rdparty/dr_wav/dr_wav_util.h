@@ -2,6 +2,7 @@
 #define DR_WAV_UTIL_H
 
 #include "3rdparty/dr_wav/dr_wav_types.h"
+#include "3rdparty/dr_wav/dr_wav_pcm_simd.h"
 
 #include <limits.h> /* For INT_MAX */
 #include <stdlib.h>
@@ -190,11 +191,7 @@ static DRWAV_INLINE drwav_int16_t drwav__bswap_s16(drwav_int16_t n)
 static DRWAV_INLINE void drwav__bswap_samples_s16(drwav_int16_t *pSamples,
                                                   drwav_uint64_t sampleCount)
 {
-	drwav_uint64_t iSample;
-	for (iSample = 0; iSample < sampleCount; iSample += 1)
-	{
-		pSamples[iSample] = drwav__bswap_s16(pSamples[iSample]);
-	}
+	drwav_pcm_kernels_get()->bswap16(pSamples, sampleCount);
 }
 
 static DRWAV_INLINE void drwav__bswap_s24(drwav_uint8_t *p)
@@ -224,11 +221,7 @@ static DRWAV_INLINE drwav_int32_t drwav__bswap_s32(drwav_int32_t n)
 static DRWAV_INLINE void drwav__bswap_samples_s32(drwav_int32_t *pSamples,
                                                   drwav_uint64_t sampleCount)
 {
-	drwav_uint64_t iSample;
-	for (iSample = 0; iSample < sampleCount; iSample += 1)
-	{
-		pSamples[iSample] = drwav__bswap_s32(pSamples[iSample]);
-	}
+	drwav_pcm_kernels_get()->bswap32(pSamples, sampleCount);
 }
 
 static DRWAV_INLINE float drwav__bswap_f32(float n)
@@ -247,11 +240,7 @@ static DRWAV_INLINE float drwav__bswap_f32(float n)
 static DRWAV_INLINE void drwav__bswap_samples_f32(float *pSamples,
                                                   drwav_uint64_t sampleCount)
 {
-	drwav_uint64_t iSample;
-	for (iSample = 0; iSample < sampleCount; iSample += 1)
-	{
-		pSamples[iSample] = drwav__bswap_f32(pSamples[iSample]);
-	}
+	drwav_pcm_kernels_get()->bswap32(pSamples, sampleCount);
 }
 
 static DRWAV_INLINE double drwav__bswap_f64(double n)
@@ -270,11 +259,7 @@ static DRWAV_INLINE double drwav__bswap_f64(double n)
 static DRWAV_INLINE void drwav__bswap_samples_f64(double *pSamples,
                                                   drwav_uint64_t sampleCount)
 {
-	drwav_uint64_t iSample;
-	for (iSample = 0; iSample < sampleCount; iSample += 1)
-	{
-		pSamples[iSample] = drwav__bswap_f64(pSamples[iSample]);
-	}
+	drwav_pcm_kernels_get()->bswap64(pSamples, sampleCount);
 }
 
 static DRWAV_INLINE void drwav__bswap_samples_pcm(void *pSamples,
@@ -0,0 +1,214 @@
+#include "alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The lowest address at or above `addr` that suits `item`, as far as its
+// alignment and bank go. May be past the limit.
+static uint64_t alloc_fit(const AllocItem *item, const AllocParams *p, uint64_t addr)
+{
+	const uint64_t align = item->align > 1 ? item->align : 1;
+	addr = (addr + align - 1) & ~(align - 1);
+	if (item->within_bank && p->bank_size > 0 && item->size > 0 && item->size <= p->bank_size)
+	{
+		const uint64_t bank_end = (addr / p->bank_size + 1) * p->bank_size;
+		if (addr + item->size > bank_end)
+		{
+			addr = (bank_end + align - 1) & ~(align - 1);
+		}
+	}
+	return addr;
+}
+
+const char *alloc_item_problem(const AllocItem *item, const AllocParams *p)
+{
+	const uint64_t end = (uint64_t)item->addr + item->size;
+	if (end > p->limit) return "doesn't fit below the address limit";
+	if (item->align > 1 && (item->addr & (item->align - 1)) != 0) return "isn't aligned";
+	if (item->within_bank && item->size > 0)
+	{
+		if (p->bank_size == 0) return "is to stay within a bank, but no bank_size is set";
+		if (item->size > p->bank_size) return "is bigger than a bank";
+		if (item->addr / p->bank_size != (end - 1) / p->bank_size) return "crosses a bank boundary";
+	}
+	return NULL;
+}
+
+// Places items in turn, each after the one before.
+static void alloc_place_in_order(AllocItem *items, int count, const AllocParams *p)
+{
+	uint64_t next = 0;
+	for (int i = 0; i < count; i++)
+	{
+		AllocItem *item = &items[i];
+		if (!item->pinned)
+		{
+			const uint64_t addr = alloc_fit(item, p, next);
+			item->addr = (addr > UINT32_MAX) ? UINT32_MAX : addr;
+		}
+		next = (uint64_t)item->addr + item->size;
+	}
+}
+
+typedef struct AllocSpan
+{
+	uint64_t start;
+	uint64_t end;
+} AllocSpan;
+
+// What the comparators need of an item, carried with its index so that
+// sorting needs no state outside the array.
+typedef struct AllocSortKey
+{
+	uint32_t size;
+	uint32_t addr;
+	int index;
+} AllocSortKey;
+
+static AllocSortKey alloc_sort_key(const AllocItem *items, int i)
+{
+	return (AllocSortKey){items[i].size, items[i].addr, i};
+}
+
+// Largest first; earliest first among equals, so the result is repeatable.
+static int alloc_size_cmp(const void *a, const void *b)
+{
+	const AllocSortKey *x = (const AllocSortKey *)a;
+	const AllocSortKey *y = (const AllocSortKey *)b;
+	if (x->size != y->size) return (x->size < y->size) ? 1 : -1;
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+static int alloc_span_cmp(const void *a, const void *b)
+{
+	const AllocSpan *x = (const AllocSpan *)a;
+	const AllocSpan *y = (const AllocSpan *)b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+// Places pinned items first, then the rest in order, or largest first, each
+// in the lowest gap between those already placed that it fits.
+static bool alloc_place_first_fit(AllocItem *items, int count, const AllocParams *p, bool by_size)
+{
+	AllocSpan *spans = malloc(sizeof(*spans) * (count ? count : 1));  // Taken, by start.
+	AllocSortKey *order = malloc(sizeof(*order) * (count ? count : 1));
+	if (!spans || !order)
+	{
+		free(spans);
+		free(order);
+		return false;
+	}
+
+	int span_count = 0;
+	int loose = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (!items[i].pinned)
+		{
+			order[loose++] = alloc_sort_key(items, i);
+			continue;
+		}
+		if (items[i].size == 0) continue;
+		spans[span_count].start = items[i].addr;
+		spans[span_count].end = (uint64_t)items[i].addr + items[i].size;
+		span_count++;
+	}
+	qsort(spans, span_count, sizeof(*spans), alloc_span_cmp);
+	if (by_size) qsort(order, loose, sizeof(*order), alloc_size_cmp);
+
+	for (int n = 0; n < loose; n++)
+	{
+		AllocItem *item = &items[order[n].index];
+
+		// Walk the gaps from the bottom. Past the last span, the gap runs to
+		// the limit; an item that doesn't fit anywhere ends up there anyway.
+		uint64_t taken = 0;  // Everything below this is spoken for.
+		uint64_t addr = 0;
+		int at = 0;          // Span the item goes before.
+		for (; at <= span_count; at++)
+		{
+			addr = alloc_fit(item, p, taken);
+			const uint64_t gap_end = (at < span_count) ? spans[at].start : p->limit;
+			if (addr + item->size <= gap_end) break;
+			if (at == span_count) break;
+			if (spans[at].end > taken) taken = spans[at].end;
+		}
+		item->addr = (addr > UINT32_MAX) ? UINT32_MAX : addr;
+		if (item->size == 0) continue;
+
+		memmove(&spans[at + 1], &spans[at], sizeof(*spans) * (span_count - at));
+		spans[at].start = item->addr;
+		spans[at].end = (uint64_t)item->addr + item->size;
+		span_count++;
+	}
+
+	free(spans);
+	free(order);
+	return true;
+}
+
+void alloc_place(AllocItem *items, int count, const AllocParams *p)
+{
+	if (p->order != ALLOC_IN_ORDER && alloc_place_first_fit(items, count, p, p->order == ALLOC_BY_SIZE))
+	{
+		return;
+	}
+	// Out of memory, or asked to: one after another.
+	alloc_place_in_order(items, count, p);
+}
+
+static int alloc_addr_cmp(const void *a, const void *b)
+{
+	const AllocSortKey *x = (const AllocSortKey *)a;
+	const AllocSortKey *y = (const AllocSortKey *)b;
+	if (x->addr != y->addr) return (x->addr > y->addr) - (x->addr < y->addr);
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+int alloc_survey(const AllocItem *items, int count, int *by_addr, AllocSurvey *survey,
+                 int *overlap_a, int *overlap_b)
+{
+	memset(survey, 0, sizeof(*survey));
+	*overlap_a = -1;
+	*overlap_b = -1;
+
+	AllocSortKey *keys = malloc(sizeof(*keys) * (count ? count : 1));
+	if (!keys) return -1;
+	int sized = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (items[i].size > 0) keys[sized++] = alloc_sort_key(items, i);
+	}
+	qsort(keys, sized, sizeof(*keys), alloc_addr_cmp);
+	for (int n = 0; n < sized; n++) by_addr[n] = keys[n].index;
+	free(keys);
+	if (sized == 0) return 0;
+
+	survey->base = items[by_addr[0]].addr;
+	uint64_t end = survey->base;
+	int end_item = by_addr[0];
+	for (int n = 0; n < sized; n++)
+	{
+		const AllocItem *item = &items[by_addr[n]];
+		if (item->addr < end && *overlap_a < 0)
+		{
+			*overlap_a = end_item;
+			*overlap_b = by_addr[n];
+		}
+		if (item->addr > end)
+		{
+			const uint64_t gap = item->addr - end;
+			survey->gaps++;
+			survey->gap_bytes += gap;
+			if (gap > survey->largest_gap) survey->largest_gap = gap;
+		}
+		survey->used += item->size;
+		if ((uint64_t)item->addr + item->size > end)
+		{
+			end = (uint64_t)item->addr + item->size;
+			end_item = by_addr[n];
+		}
+	}
+	survey->end = end;
+	return sized;
+}
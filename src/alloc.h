@@ -0,0 +1,67 @@
+#pragma once
+
+// Placement of payloads in the chip's address space.
+//
+// Payloads get addresses once all of their sizes are known. They either
+// follow one another in the order given, or each go into the lowest gap they
+// fit (first fit), in the order given or largest first (first-fit
+// decreasing). Largest first tends to leave fewer and smaller gaps when some
+// are pinned or aligned. Any payload can be pinned to an address, aligned,
+// or kept from crossing a bank boundary.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// YMZ280B addresses are 24 bits.
+#define ALLOC_ADDRESS_LIMIT (1u << 24)
+
+typedef enum AllocOrder
+{
+	ALLOC_IN_ORDER,   // Each payload follows the one before it.
+	ALLOC_FIRST_FIT,  // First fit, in the order given.
+	ALLOC_BY_SIZE,    // First-fit decreasing.
+} AllocOrder;
+
+typedef struct AllocItem
+{
+	uint32_t size;
+	uint32_t align;    // A power of two; 0 or 1 for none.
+	bool pinned;       // `addr` is given, and kept.
+	bool within_bank;  // Mustn't cross a multiple of the bank size.
+	uint32_t addr;
+} AllocItem;
+
+typedef struct AllocParams
+{
+	AllocOrder order;
+	uint32_t limit;      // Addresses run from 0 up to this.
+	uint32_t bank_size;  // 0 if there are no banks.
+} AllocParams;
+
+// What a placement covers, counting only items with a size.
+typedef struct AllocSurvey
+{
+	uint32_t base;         // Lowest address used.
+	uint64_t end;          // Just past the highest.
+	uint64_t used;         // Bytes in items.
+	int gaps;              // Unused runs between base and end.
+	uint64_t gap_bytes;
+	uint64_t largest_gap;
+} AllocSurvey;
+
+// Gives every item that isn't pinned an address. Pinned items are taken as
+// they are, even if they break their own constraints. In order, a pinned item
+// moves the next address to just past it. An item with no room left below
+// the limit goes past everything else, for alloc_item_problem() to find.
+void alloc_place(AllocItem *items, int count, const AllocParams *p);
+
+// How an item breaks its constraints or goes past the limit, or NULL if it
+// doesn't.
+const char *alloc_item_problem(const AllocItem *item, const AllocParams *p);
+
+// Fills `by_addr` with the indices of the items with a size, in address
+// order, and returns how many there are, or -1 if out of memory. Where two
+// of those overlap, sets *overlap_a and *overlap_b to the first such pair;
+// otherwise to -1.
+int alloc_survey(const AllocItem *items, int count, int *by_addr, AllocSurvey *survey,
+                 int *overlap_a, int *overlap_b);
@@ -0,0 +1,168 @@
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN _Alignof(max_align_t)
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct ArenaBlock
+{
+	ArenaBlock *next;
+	size_t size;  // Usable bytes after the header.
+	size_t pos;   // Bytes handed out.
+};
+
+// Blocks are laid out as the header, then the allocations.
+#define ARENA_HEADER ARENA_ROUND(sizeof(ArenaBlock))
+
+static uint8_t *arena_block_data(ArenaBlock *b)
+{
+	return (uint8_t *)b + ARENA_HEADER;
+}
+
+// Takes a block of `size` usable bytes from the root: a spare one if it is of
+// the shared size, otherwise a new one.
+static ArenaBlock *arena_block_get(Arena *root, size_t size)
+{
+	pthread_mutex_lock(&root->lock);
+	ArenaBlock *b = NULL;
+	if (size == ARENA_BLOCK_SIZE && root->spare)
+	{
+		b = root->spare;
+		root->spare = b->next;
+	}
+	else if (size <= SIZE_MAX - ARENA_HEADER && (b = malloc(ARENA_HEADER + size)))
+	{
+		b->size = size;
+		root->stats.reserved += size;
+		root->stats.blocks++;
+		if (root->stats.reserved > root->stats.peak_reserved)
+		{
+			root->stats.peak_reserved = root->stats.reserved;
+		}
+	}
+	pthread_mutex_unlock(&root->lock);
+	if (b)
+	{
+		b->next = NULL;
+		b->pos = 0;
+	}
+	return b;
+}
+
+void arena_init(Arena *a)
+{
+	memset(a, 0, sizeof(*a));
+	a->root = a;
+	pthread_mutex_init(&a->lock, NULL);
+}
+
+void arena_free(Arena *a)
+{
+	ArenaBlock *lists[] = {a->blocks, a->spare};
+	for (int i = 0; i < 2; i++)
+	{
+		ArenaBlock *b = lists[i];
+		while (b)
+		{
+			ArenaBlock *next = b->next;
+			free(b);
+			b = next;
+		}
+	}
+	a->blocks = NULL;
+	a->spare = NULL;
+	pthread_mutex_destroy(&a->lock);
+}
+
+void arena_sub_init(Arena *sub, Arena *root)
+{
+	sub->blocks = NULL;
+	sub->used = 0;
+	sub->root = root;
+	sub->spare = NULL;
+}
+
+void arena_sub_free(Arena *sub)
+{
+	Arena *root = sub->root;
+	pthread_mutex_lock(&root->lock);
+	ArenaBlock *b = sub->blocks;
+	while (b)
+	{
+		ArenaBlock *next = b->next;
+		if (b->size == ARENA_BLOCK_SIZE)
+		{
+			b->next = root->spare;
+			root->spare = b;
+		}
+		else
+		{
+			root->stats.reserved -= b->size;
+			free(b);
+		}
+		b = next;
+	}
+	root->stats.allocated += sub->used;
+	pthread_mutex_unlock(&root->lock);
+	sub->blocks = NULL;
+	sub->used = 0;
+}
+
+void *arena_alloc(Arena *a, size_t size)
+{
+	if (size > SIZE_MAX - ARENA_ALIGN) return NULL;
+	size = size ? ARENA_ROUND(size) : ARENA_ALIGN;
+
+	ArenaBlock *b = a->blocks;
+	if (!b || b->size - b->pos < size)
+	{
+		if (size > ARENA_BLOCK_SIZE / 2)
+		{
+			// Too big to share; it gets a block to itself, behind the one
+			// smaller allocations are still coming from.
+			b = arena_block_get(a->root, size);
+			if (!b) return NULL;
+			if (a->blocks)
+			{
+				b->next = a->blocks->next;
+				a->blocks->next = b;
+			}
+			else
+			{
+				a->blocks = b;
+			}
+		}
+		else
+		{
+			b = arena_block_get(a->root, ARENA_BLOCK_SIZE);
+			if (!b) return NULL;
+			b->next = a->blocks;
+			a->blocks = b;
+		}
+	}
+
+	void *p = arena_block_data(b) + b->pos;
+	b->pos += size;
+	a->used += size;
+	return p;
+}
+
+void *arena_calloc(Arena *a, size_t count, size_t size)
+{
+	if (size && count > SIZE_MAX / size) return NULL;
+	void *p = arena_alloc(a, count * size);
+	if (p) memset(p, 0, count * size);
+	return p;
+}
+
+ArenaStats arena_stats(Arena *root)
+{
+	pthread_mutex_lock(&root->lock);
+	ArenaStats stats = root->stats;
+	pthread_mutex_unlock(&root->lock);
+	stats.allocated += root->used;
+	return stats;
+}
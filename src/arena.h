@@ -0,0 +1,61 @@
+#pragma once
+
+// Region allocation for the lifetime of a run, or of a piece of one.
+//
+// Allocations are carved out of large blocks and never freed one at a time;
+// the whole arena goes at once. A root arena lives for the run. Threads take
+// sub-arenas of it for their own work, which draw blocks from the root and
+// hand them back when released, so allocating never contends with another
+// thread. Requests too big to share a block get a block of their own, which
+// goes straight back to the system with its sub-arena.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Size of the blocks allocations share.
+#define ARENA_BLOCK_SIZE (1 << 20)
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct ArenaStats
+{
+	size_t reserved;       // Bytes in blocks taken from the system, now.
+	size_t peak_reserved;  // The most `reserved` has been.
+	size_t allocated;      // Bytes handed out over the run, in released sub-arenas and the root.
+	size_t blocks;         // Blocks taken from the system over the run.
+} ArenaStats;
+
+typedef struct Arena Arena;
+struct Arena
+{
+	ArenaBlock *blocks;  // Newest first; allocations come from the first.
+	size_t used;         // Bytes handed out from this arena.
+	Arena *root;         // Where blocks come from; this arena itself for a root.
+
+	// Root only: blocks given back by sub-arenas, and the totals.
+	pthread_mutex_t lock;
+	ArenaBlock *spare;
+	ArenaStats stats;
+};
+
+void arena_init(Arena *a);
+
+// Frees every block of a root arena. Its sub-arenas must be released first.
+void arena_free(Arena *a);
+
+// Starts a sub-arena of `root`, for use by one thread at a time.
+void arena_sub_init(Arena *sub, Arena *root);
+
+// Gives a sub-arena's blocks back to its root. Everything allocated from it
+// goes with them.
+void arena_sub_free(Arena *sub);
+
+// Returns `size` bytes aligned for any type, or NULL if out of memory.
+void *arena_alloc(Arena *a, size_t size);
+
+// As arena_alloc(), zeroed, for `count` items of `size` bytes.
+void *arena_calloc(Arena *a, size_t count, size_t size);
+
+// A snapshot of the root arena's totals.
+ArenaStats arena_stats(Arena *root);
@@ -0,0 +1,656 @@
+#include "bench.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "blockdec.h"
+#include "mapfile.h"
+#include "pool.h"
+#include "segenc.h"
+#include "trellis.h"
+#include "3rdparty/adpcm/ymz_codec.h"
+#include "3rdparty/dr_wav/dr_wav.h"
+#include "3rdparty/dr_wav/dr_wav_pcm_simd.h"
+
+// Minimum time spent repeating each measurement.
+#define BENCH_MIN_SECONDS 0.5
+
+typedef struct BenchInput
+{
+	const char *path;
+	int16_t *pcm;  // Mono 16-bit source.
+	long len;
+} BenchInput;
+
+typedef struct Bench
+{
+	const char *name;
+	bool (*func)(const BenchInput *in);
+} Bench;
+
+static double bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_report(const char *what, double samples, double seconds)
+{
+	printf("  %-28s %10.2f Msamples/s\n", what, samples / seconds * 1e-6);
+}
+
+// Runs `stmt` repeatedly for at least BENCH_MIN_SECONDS and reports the rate.
+#define BENCH_RATE(label, samples, stmt) \
+	do \
+	{ \
+		int reps_ = 0; \
+		double t0_ = bench_now(), t1_; \
+		do \
+		{ \
+			stmt; \
+			reps_++; \
+		} while ((t1_ = bench_now()) - t0_ < BENCH_MIN_SECONDS); \
+		bench_report(label, (double)(samples) * reps_, t1_ - t0_); \
+	} while (0)
+
+//
+// ADPCM: the division-based quantizer the codec used to have, kept here as a
+// reference for speed and bit-exactness.
+//
+
+#define BENCH_CLAMP(x, low, high)  (((x) > (high)) ? (high) : (((x) < (low)) ? (low) : (x)))
+
+static inline void bench_ref_step(uint8_t step, int16_t *history, int16_t *step_size)
+{
+	static const int step_table[8] = {
+		230, 230, 230, 230, 307, 409, 512, 614
+	};
+
+	const int delta = step & 7;
+	int diff = ((1+(delta<<1)) * *step_size) >> 3;
+	int newval = *history;
+	const int nstep = (step_table[delta] * *step_size) >> 8;
+	diff = BENCH_CLAMP(diff, 0, 32767);
+	if (step & 8) newval -= diff;
+	else newval += diff;
+	*step_size = BENCH_CLAMP(nstep, 127, 24576);
+	*history = BENCH_CLAMP(newval, -32768, 32767);
+}
+
+static void bench_ref_encode(const int16_t *buffer, uint8_t *outbuffer, long len, bool aica)
+{
+	int16_t step_size = 127;
+	int16_t history = 0;
+	uint8_t buf_sample = 0, nibble = 0;
+	for (long i = 0; i < len; i++)
+	{
+		const int step = ((*buffer++) & -8) - history;
+		unsigned int adpcm_sample = (abs(step)<<16) / (step_size<<14);
+		adpcm_sample = BENCH_CLAMP(adpcm_sample, 0, 7);
+		if (step < 0) adpcm_sample |= 8;
+		if (aica)
+		{
+			if (!nibble) *outbuffer++ = buf_sample | (adpcm_sample<<4);
+			else buf_sample = (adpcm_sample&15);
+		}
+		else
+		{
+			if (nibble) *outbuffer++ = buf_sample | (adpcm_sample&15);
+			else buf_sample = (adpcm_sample&15)<<4;
+		}
+		nibble ^= 1;
+		bench_ref_step(adpcm_sample, &history, &step_size);
+	}
+}
+
+static void bench_ref_decode(const uint8_t *buffer, int16_t *outbuffer, long len, bool aica)
+{
+	int16_t step_size = 127;
+	int16_t history = 0;
+	uint8_t nibble = aica ? 4 : 0;
+	for (long i = 0; i < len; i++)
+	{
+		int8_t step = (*(const int8_t *)buffer) << nibble;
+		step >>= 4;
+		if (aica ? !nibble : nibble) buffer++;
+		nibble ^= 4;
+		history = history * 254 / 256; // High pass
+		bench_ref_step(step, &history, &step_size);
+		*outbuffer++ = history;
+	}
+}
+
+// Whether both decoders give the reference's samples for `len` codes.
+static bool bench_adpcm_decode_check(uint8_t *codes, long len, int16_t *ref, int16_t *out)
+{
+	bench_ref_decode(codes, ref, len, false);
+	ymz_decode(codes, out, len);
+	bool ok = memcmp(ref, out, sizeof(*ref) * len) == 0;
+	bench_ref_decode(codes, ref, len, true);
+	aica_decode(codes, out, len);
+	return ok && memcmp(ref, out, sizeof(*ref) * len) == 0;
+}
+
+static bool bench_adpcm_codec(const BenchInput *in)
+{
+	const long bytes = in->len / 2 + 1;
+	uint8_t *ref = calloc(bytes, 1);
+	uint8_t *out = calloc(bytes, 1);
+	int16_t *dec_out = malloc(sizeof(int16_t) * in->len);
+	bool ok = true;
+
+	BENCH_RATE("ymz_encode (reference)", in->len, bench_ref_encode(in->pcm, ref, in->len, false));
+	BENCH_RATE("ymz_encode", in->len, ymz_encode(in->pcm, out, in->len));
+	if (memcmp(ref, out, bytes) != 0) ok = false;
+	BENCH_RATE("ymz_decode", in->len, ymz_decode(out, dec_out, in->len & ~1));
+
+	BENCH_RATE("aica_encode (reference)", in->len, bench_ref_encode(in->pcm, ref, in->len, true));
+	BENCH_RATE("aica_encode", in->len, aica_encode(in->pcm, out, in->len));
+	if (memcmp(ref, out, bytes) != 0) ok = false;
+	BENCH_RATE("aica_decode", in->len, aica_decode(out, dec_out, in->len & ~1));
+
+	// The decoders, on the encoded source and on arbitrary codes, which reach
+	// step sizes and clamps a real encode rarely does.
+	bool dec_ok = true;
+	int16_t *dec_ref = malloc(sizeof(int16_t) * in->len);
+	if (!bench_adpcm_decode_check(out, in->len & ~1, dec_ref, dec_out)) dec_ok = false;
+	uint32_t seed = 1;
+	for (long i = 0; i < bytes; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		out[i] = seed >> 24;
+	}
+	if (!bench_adpcm_decode_check(out, in->len & ~1, dec_ref, dec_out)) dec_ok = false;
+	free(dec_ref);
+
+	free(ref);
+	free(out);
+	free(dec_out);
+	if (!ok) printf("  MISMATCH against the reference encoder!\n");
+	if (!dec_ok) printf("  MISMATCH against the reference decoder!\n");
+	return ok && dec_ok;
+}
+
+//
+// ADPCM: scalar encoder vs. multi-stream lanes
+//
+
+static bool bench_adpcm_multi(const BenchInput *in)
+{
+	const int streams = YMZ_MULTI_LANES;
+	ymz_encoder enc[YMZ_MULTI_LANES];
+	ymz_encoder *encp[YMZ_MULTI_LANES];
+	const int16_t *bufp[YMZ_MULTI_LANES];
+	uint8_t *ref[YMZ_MULTI_LANES];
+	uint8_t *out[YMZ_MULTI_LANES];
+	long len[YMZ_MULTI_LANES];
+	long out_bytes[YMZ_MULTI_LANES];
+	bool ok = true;
+
+	// Start each stream at a different point so the lanes don't agree.
+	int16_t *pcm = malloc(sizeof(int16_t) * in->len * 2);
+	memcpy(pcm, in->pcm, sizeof(int16_t) * in->len);
+	memcpy(pcm + in->len, in->pcm, sizeof(int16_t) * in->len);
+	for (int i = 0; i < streams; i++)
+	{
+		bufp[i] = pcm + (in->len * i) / streams;
+		len[i] = in->len;
+		ref[i] = malloc(in->len / 2 + 1);
+		out[i] = malloc(in->len / 2 + 1);
+		encp[i] = &enc[i];
+	}
+
+	const double total = (double)streams * in->len;
+	int reps = 0;
+	double t0 = bench_now(), t1;
+	do
+	{
+		for (int i = 0; i < streams; i++)
+		{
+			ymz_encoder_init(&enc[i]);
+			ymz_encoder_run(&enc[i], bufp[i], ref[i], len[i]);
+		}
+		reps++;
+	} while ((t1 = bench_now()) - t0 < BENCH_MIN_SECONDS);
+	bench_report("ymz_encoder_run (scalar)", total * reps, t1 - t0);
+
+	char label[64];
+	snprintf(label, sizeof(label), "ymz_encoder_run_multi (%s)", ymz_encoder_multi_isa());
+	reps = 0;
+	t0 = bench_now();
+	do
+	{
+		for (int i = 0; i < streams; i++) ymz_encoder_init(&enc[i]);
+		ymz_encoder_run_multi(encp, bufp, out, len, out_bytes, streams);
+		reps++;
+	} while ((t1 = bench_now()) - t0 < BENCH_MIN_SECONDS);
+	bench_report(label, total * reps, t1 - t0);
+
+	for (int i = 0; i < streams; i++)
+	{
+		if (out_bytes[i] != in->len / 2 || memcmp(ref[i], out[i], in->len / 2) != 0) ok = false;
+		free(ref[i]);
+		free(out[i]);
+	}
+	free(pcm);
+	if (!ok) printf("  MISMATCH between scalar and multi-stream output!\n");
+	return ok;
+}
+
+//
+// ADPCM: one sample split into segments encoded in parallel
+//
+
+static bool bench_adpcm_segment_check(const BenchInput *in, const uint8_t *ref, uint8_t *out,
+                                      int jobs)
+{
+	SegEncStats stats;
+	segenc_encode(in->pcm, out, in->len, jobs, false, &stats);
+	const bool ok = memcmp(ref, out, in->len / 2) == 0;
+	printf("  %d jobs: %d segments, %d heads fixed up in %d rounds (%ld samples re-encoded)%s\n",
+	       jobs, stats.segments, stats.fixups, stats.rounds, stats.fixup_samples,
+	       ok ? "" : " MISMATCH");
+	return ok;
+}
+
+static bool bench_adpcm_segment(const BenchInput *in)
+{
+	const int jobs = pool_cpu_count();
+	const long bytes = in->len / 2;
+	const long samples = bytes * 2;
+	uint8_t *ref = malloc(bytes + 1);
+	uint8_t *out = malloc(bytes + 1);
+	int16_t *dec_ref = malloc(sizeof(int16_t) * (samples + 1));
+	int16_t *dec_out = malloc(sizeof(int16_t) * (samples + 1));
+	bool ok = true;
+
+	char label[64];
+	BENCH_RATE("ymz_encode", in->len, ymz_encode(in->pcm, ref, in->len));
+	snprintf(label, sizeof(label), "segenc_encode (%d jobs)", jobs);
+	BENCH_RATE(label, in->len, segenc_encode(in->pcm, out, in->len, jobs, false, NULL));
+	snprintf(label, sizeof(label), "segenc_encode fast (%d jobs)", jobs);
+	BENCH_RATE(label, in->len, segenc_encode(in->pcm, out, in->len, jobs, true, NULL));
+
+	// The thread count decides where segments start, so check a few.
+	ok = bench_adpcm_segment_check(in, ref, out, jobs) && ok;
+	ok = bench_adpcm_segment_check(in, ref, out, 4) && ok;
+	ok = bench_adpcm_segment_check(in, ref, out, 16) && ok;
+
+	// Fast mode: how far the decoded result strays from a serial encode.
+	SegEncStats stats;
+	segenc_encode(in->pcm, out, in->len, 16, true, &stats);
+	ymz_decode(ref, dec_ref, samples);
+	ymz_decode(out, dec_out, samples);
+	long differ = 0;
+	int max_err = 0;
+	for (long i = 0; i < samples; i++)
+	{
+		const int err = abs(dec_ref[i] - dec_out[i]);
+		if (err) differ++;
+		if (err > max_err) max_err = err;
+	}
+	printf("  fast, 16 jobs: %d of %d segments inexact; %ld samples differ, max error %d\n",
+	       stats.inexact, stats.segments, differ, max_err);
+
+	free(ref);
+	free(out);
+	free(dec_ref);
+	free(dec_out);
+	if (!ok) printf("  MISMATCH between serial and segmented output!\n");
+	return ok;
+}
+
+//
+// ADPCM: search effort levels, quality against time
+//
+
+// Searching is slow; a few seconds of audio is plenty to compare.
+#define BENCH_TRELLIS_SAMPLES 131072
+
+static bool bench_adpcm_trellis(const BenchInput *in)
+{
+	static const char *const efforts[] =
+	{
+		"greedy", "lookahead-1", "lookahead-4", "lookahead-16", "lookahead-64", "trellis",
+	};
+	const long len = in->len < BENCH_TRELLIS_SAMPLES ? in->len : BENCH_TRELLIS_SAMPLES;
+	const int jobs = pool_cpu_count();
+	uint8_t *out = calloc(len / 2 + 1, 1);
+	bool ok = true;
+
+	printf("  %ld samples, %d jobs\n", len, jobs);
+	for (size_t i = 0; i < sizeof(efforts) / sizeof(efforts[0]); i++)
+	{
+		int effort;
+		trellis_parse_effort(efforts[i], &effort);
+		const double t0 = bench_now();
+		if (!trellis_encode(in->pcm, out, len, effort, jobs, NULL)) ok = false;
+		const double t1 = bench_now();
+		printf("  %-16s %10.3f Msamples/s  SNR %6.2f dB\n", efforts[i], len / (t1 - t0) * 1e-6,
+		       trellis_snr(in->pcm, out, len));
+	}
+
+	// Segments are fixed, so any number of threads must give the same codes.
+	const int many = (jobs > 1) ? jobs : 4;
+	uint8_t *serial = calloc(len / 2 + 1, 1);
+	int effort;
+	trellis_parse_effort("lookahead-4", &effort);
+	if (!serial || !trellis_encode(in->pcm, out, len, effort, many, NULL) ||
+	    !trellis_encode(in->pcm, serial, len, effort, 1, NULL))
+	{
+		ok = false;
+	}
+	else if (memcmp(out, serial, len / 2) != 0)
+	{
+		printf("  MISMATCH between %d jobs and 1!\n", many);
+		ok = false;
+	}
+
+	free(serial);
+	free(out);
+	return ok;
+}
+
+//
+// PCM16 output: samples as the chip reads them
+//
+
+// PCM16 entries are read the way conversion reads them, then decoded high
+// byte first, as the YMZ280B does, and compared with the source.
+static bool bench_pcm16_order(const BenchInput *in)
+{
+	drwav wav;
+	if (!drwav_init_file(&wav, in->path, NULL))
+	{
+		fprintf(stderr, "[BENCH] Couldn't open \"%s\"\n", in->path);
+		return false;
+	}
+	const long channels = wav.channels;
+	int16_t *raw = malloc(sizeof(int16_t) * in->len * channels);
+	bool ok = raw != NULL;
+	if (ok)
+	{
+		BENCH_RATE("drwav_read_pcm_frames_s16be", in->len,
+		           drwav_seek_to_pcm_frame(&wav, 0);
+		           ok = drwav_read_pcm_frames_s16be(&wav, in->len, raw) == (drwav_uint64_t)in->len);
+	}
+	if (ok)
+	{
+		const uint8_t *bytes = (const uint8_t *)raw;
+		for (long i = 0; i < in->len; i++)
+		{
+			const uint8_t *b = bytes + i * channels * 2;
+			const int16_t chip = (int16_t)((b[0] << 8) | b[1]);
+			if (chip != in->pcm[i])
+			{
+				printf("  MISMATCH: sample %ld reads back as %d, not %d\n", i, chip, in->pcm[i]);
+				ok = false;
+				break;
+			}
+		}
+	}
+	else
+	{
+		printf("  Couldn't read the samples back\n");
+	}
+	free(raw);
+	drwav_uninit(&wav);
+	return ok;
+}
+
+//
+// Sample format conversion: each dr_wav kernel table against the scalar one
+//
+
+typedef struct BenchPcmFormats
+{
+	long len;
+	uint8_t *u8;
+	uint8_t *s24;
+	int32_t *s32;
+	float *f32;
+	double *f64;
+} BenchPcmFormats;
+
+// Builds each source format from the 16-bit input, with some extra low bits
+// and, every so often, a value a converter has to be careful with.
+static void bench_pcm_formats_init(BenchPcmFormats *f, const BenchInput *in)
+{
+	static const float specials[] = {1.0f, -1.0f, 1.5f, -3.0f, 1e30f, -1e30f, -0.0f,
+	                                 1.0f / 65535.0f, -1.0f / 65535.0f};
+	f->len = in->len;
+	f->u8 = malloc(f->len);
+	f->s24 = malloc(f->len * 3);
+	f->s32 = malloc(sizeof(int32_t) * f->len);
+	f->f32 = malloc(sizeof(float) * f->len);
+	f->f64 = malloc(sizeof(double) * f->len);
+	uint32_t noise = 1;
+	for (long i = 0; i < f->len; i++)
+	{
+		noise = noise * 1664525 + 1013904223;
+		const int32_t x = (int32_t)((uint32_t)in->pcm[i] << 16) | (noise >> 16);
+		f->u8[i] = (uint8_t)((x >> 24) + 128);
+		f->s24[i * 3 + 0] = (uint8_t)(x >> 8);
+		f->s24[i * 3 + 1] = (uint8_t)(x >> 16);
+		f->s24[i * 3 + 2] = (uint8_t)(x >> 24);
+		f->s32[i] = x;
+		f->f32[i] = x / 2147483648.0f;
+		f->f64[i] = x / 2147483648.0;
+		if (i % 61 == 0)
+		{
+			const float special = (i / 61) % 10 == 9 ? NAN : specials[(i / 61) % 10];
+			f->f32[i] = special;
+			f->f64[i] = special;
+		}
+	}
+}
+
+static void bench_pcm_formats_free(BenchPcmFormats *f)
+{
+	free(f->u8);
+	free(f->s24);
+	free(f->s32);
+	free(f->f32);
+	free(f->f64);
+}
+
+static bool bench_pcm_conv(const BenchInput *in)
+{
+	BenchPcmFormats f;
+	bench_pcm_formats_init(&f, in);
+	const long len = f.len;
+	int16_t *ref = malloc(sizeof(int16_t) * len);
+	int16_t *out = malloc(sizeof(int16_t) * len);
+	uint64_t *swap_ref = malloc(sizeof(uint64_t) * len);
+	uint64_t *swap = malloc(sizeof(uint64_t) * len);
+	memcpy(swap_ref, f.f64, sizeof(uint64_t) * len);
+	bool ok = true;
+
+	size_t count;
+	const drwav_pcm_kernels *const *all = drwav_pcm_kernels_all(&count);
+	const drwav_pcm_kernels *scalar = all[0];
+	for (size_t k = 0; k < count; k++)
+	{
+		const drwav_pcm_kernels *kern = all[k];
+		char label[64];
+
+// Times one kernel of this table and compares it with the scalar result.
+#define BENCH_PCM_CONV(fn, src) \
+		do \
+		{ \
+			snprintf(label, sizeof(label), #fn " (%s)", kern->name); \
+			scalar->fn(ref, (src), len); \
+			BENCH_RATE(label, len, kern->fn(out, (src), len)); \
+			if (memcmp(ref, out, sizeof(int16_t) * len) != 0) \
+			{ \
+				printf("  MISMATCH: " #fn " (%s)\n", kern->name); \
+				ok = false; \
+			} \
+		} while (0)
+
+		BENCH_PCM_CONV(u8_to_s16, f.u8);
+		BENCH_PCM_CONV(s24_to_s16, f.s24);
+		BENCH_PCM_CONV(s32_to_s16, f.s32);
+		BENCH_PCM_CONV(f32_to_s16, f.f32);
+		BENCH_PCM_CONV(f64_to_s16, f.f64);
+#undef BENCH_PCM_CONV
+
+		// Byte swaps run in place; an even number of them restores the input.
+		static const int widths[] = {16, 32, 64};
+		for (int w = 0; w < 3; w++)
+		{
+			void (*kswap)(void *, drwav_uint64_t) =
+				w == 0 ? kern->bswap16 : w == 1 ? kern->bswap32 : kern->bswap64;
+			void (*sswap)(void *, drwav_uint64_t) =
+				w == 0 ? scalar->bswap16 : w == 1 ? scalar->bswap32 : scalar->bswap64;
+			const long n = len * 64 / widths[w];
+			memcpy(swap, swap_ref, sizeof(uint64_t) * len);
+			kswap(swap, n);
+			sswap(swap, n);
+			bool same = memcmp(swap, swap_ref, sizeof(uint64_t) * len) == 0;
+			kswap(swap, n);
+			sswap(swap_ref, n);
+			same = same && memcmp(swap, swap_ref, sizeof(uint64_t) * len) == 0;
+			sswap(swap_ref, n);
+			snprintf(label, sizeof(label), "bswap%d (%s)", widths[w], kern->name);
+			BENCH_RATE(label, n, kswap(swap, n));
+			if (!same)
+			{
+				printf("  MISMATCH: bswap%d (%s)\n", widths[w], kern->name);
+				ok = false;
+			}
+		}
+	}
+
+	free(ref);
+	free(out);
+	free(swap_ref);
+	free(swap);
+	bench_pcm_formats_free(&f);
+	return ok;
+}
+
+//
+// Source decoding: MS and IMA ADPCM, block by block across threads
+//
+
+static bool bench_adpcm_source_read(drwav *wav, const MapFile *map, int16_t *out,
+                                    uint32_t frames, int jobs)
+{
+	if (!drwav_init_memory(wav, map->data, map->size, NULL)) return false;
+	if (jobs == 0) drwav_read_pcm_frames_s16(wav, frames, out);
+	else blockdec_read_s16(wav, map->data, map->size, out, frames, jobs);
+	drwav_uninit(wav);
+	return true;
+}
+
+static bool bench_adpcm_source(const BenchInput *in)
+{
+	MapFile map;
+	drwav wav;
+	if (!mapfile_open(&map, in->path) || !drwav_init_memory(&wav, map.data, map.size, NULL))
+	{
+		printf("  couldn't map the source, skipped\n");
+		if (map.data) mapfile_close(&map);
+		return true;
+	}
+	const uint64_t block_frames = drwav_get_block_frame_count(&wav);
+	const uint32_t frames = wav.totalPCMFrameCount < UINT32_MAX ? wav.totalPCMFrameCount : UINT32_MAX;
+	const uint32_t channels = wav.channels;
+	drwav_uninit(&wav);
+	if (block_frames == 0)
+	{
+		printf("  not MS or IMA ADPCM, skipped\n");
+		mapfile_close(&map);
+		return true;
+	}
+
+	const int jobs = pool_cpu_count();
+	int16_t *ref = calloc((size_t)frames * channels + 1, sizeof(int16_t));
+	int16_t *out = calloc((size_t)frames * channels + 1, sizeof(int16_t));
+	bool ok = ref && out;
+
+	char label[64];
+	if (ok)
+	{
+		BENCH_RATE("drwav_read_pcm_frames_s16", frames,
+		           bench_adpcm_source_read(&wav, &map, ref, frames, 0));
+		snprintf(label, sizeof(label), "blockdec_read_s16 (%d jobs)", jobs);
+		BENCH_RATE(label, frames, bench_adpcm_source_read(&wav, &map, out, frames, jobs));
+		ok = memcmp(ref, out, sizeof(int16_t) * frames * channels) == 0;
+
+		// The thread count decides which blocks go together, so check another.
+		bench_adpcm_source_read(&wav, &map, out, frames, 3);
+		ok = ok && memcmp(ref, out, sizeof(int16_t) * frames * channels) == 0;
+	}
+
+	free(ref);
+	free(out);
+	mapfile_close(&map);
+	if (!ok) printf("  MISMATCH between serial and block-parallel decoding!\n");
+	return ok;
+}
+
+static const Bench s_benches[] =
+{
+	{"pcm_conv", bench_pcm_conv},
+	{"pcm16_order", bench_pcm16_order},
+	{"adpcm_codec", bench_adpcm_codec},
+	{"adpcm_multi", bench_adpcm_multi},
+	{"adpcm_segment", bench_adpcm_segment},
+	{"adpcm_trellis", bench_adpcm_trellis},
+	{"adpcm_source", bench_adpcm_source},
+};
+
+int bench_main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		printf("Usage: ymztool bench WAV [NAME...]\n");
+		printf("Benchmarks:");
+		for (size_t i = 0; i < sizeof(s_benches) / sizeof(s_benches[0]); i++)
+		{
+			printf(" %s", s_benches[i].name);
+		}
+		printf("\n");
+		return -1;
+	}
+
+	BenchInput in;
+	in.path = argv[1];
+	unsigned int channels, sample_rate;
+	drwav_uint64_t frames;
+	in.pcm = drwav_open_file_and_read_pcm_frames_s16(argv[1], &channels, &sample_rate,
+	                                                 &frames, NULL);
+	if (!in.pcm)
+	{
+		fprintf(stderr, "[BENCH] Couldn't load \"%s\"\n", argv[1]);
+		return -1;
+	}
+	// Only the first channel is used.
+	for (drwav_uint64_t i = 0; i < frames; i++) in.pcm[i] = in.pcm[i * channels];
+	in.len = frames;
+	printf("%s: %ld samples\n", argv[1], in.len);
+
+	int ret = 0;
+	for (size_t i = 0; i < sizeof(s_benches) / sizeof(s_benches[0]); i++)
+	{
+		bool wanted = argc < 3;
+		for (int j = 2; j < argc; j++)
+		{
+			if (strcmp(argv[j], s_benches[i].name) == 0) wanted = true;
+		}
+		if (!wanted) continue;
+		printf("%s:\n", s_benches[i].name);
+		if (!s_benches[i].func(&in)) ret = -1;
+	}
+
+	drwav_free(in.pcm, NULL);
+	return ret;
+}
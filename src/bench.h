@@ -0,0 +1,5 @@
+#pragma once
+
+// `ymztool bench`: microbenchmarks for the conversion kernels.
+
+int bench_main(int argc, char **argv);
@@ -0,0 +1,84 @@
+#include "blockdec.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "pool.h"
+
+typedef struct BlockDecJob
+{
+	const drwav *wav;
+	const uint8_t *blocks;  // The first block of the data chunk.
+	int16_t *out;
+	uint64_t block_count;
+	uint64_t blocks_per_item;
+	uint32_t block_frames;
+	atomic_bool failed;
+} BlockDecJob;
+
+static void blockdec_item_job(void *user, int idx)
+{
+	BlockDecJob *job = (BlockDecJob *)user;
+	const uint32_t block_bytes = job->wav->fmt.blockAlign;
+	const uint32_t block_samples = job->block_frames * job->wav->channels;
+
+	uint64_t block = (uint64_t)idx * job->blocks_per_item;
+	uint64_t end = block + job->blocks_per_item;
+	if (end > job->block_count) end = job->block_count;
+	for (; block < end; block++)
+	{
+		if (!drwav_decode_block_s16(job->wav, job->blocks + block * block_bytes,
+		                            job->out + block * block_samples))
+		{
+			atomic_store(&job->failed, true);
+			return;
+		}
+	}
+}
+
+uint32_t blockdec_read_s16(drwav *wav, const void *data, size_t size, int16_t *out,
+                           uint32_t frames, int jobs)
+{
+	const uint64_t block_frames = drwav_get_block_frame_count(wav);
+	const uint64_t data_pos = wav->dataChunkDataPos;
+	if (!data || block_frames == 0 || data_pos > size)
+	{
+		return drwav_read_pcm_frames_s16(wav, frames, out);
+	}
+
+	// Only blocks that are all there and all wanted; the reader stops at the
+	// frame count the header gives, even partway into a block.
+	uint64_t data_bytes = size - data_pos;
+	if (data_bytes > wav->dataChunkDataSize) data_bytes = wav->dataChunkDataSize;
+	uint64_t want = frames;
+	if (want > wav->totalPCMFrameCount) want = wav->totalPCMFrameCount;
+	uint64_t block_count = data_bytes / wav->fmt.blockAlign;
+	if (block_count > want / block_frames) block_count = want / block_frames;
+
+	BlockDecJob job;
+	job.wav = wav;
+	job.blocks = (const uint8_t *)data + data_pos;
+	job.out = out;
+	job.block_count = block_count;
+	job.blocks_per_item = (BLOCKDEC_MIN_FRAMES + block_frames - 1) / block_frames;
+	job.block_frames = block_frames;
+	atomic_init(&job.failed, false);
+
+	uint64_t items = (block_count + job.blocks_per_item - 1) / job.blocks_per_item;
+	if (items > INT32_MAX)
+	{
+		job.blocks_per_item = (block_count + INT32_MAX - 1) / INT32_MAX;
+		items = (block_count + job.blocks_per_item - 1) / job.blocks_per_item;
+	}
+	if (items > 0) pool_run(jobs, (int)items, blockdec_item_job, &job);
+
+	// A damaged block header is left for the serial reader to deal with.
+	if (atomic_load(&job.failed)) block_count = 0;
+	if (!drwav_seek_to_block(wav, block_count))
+	{
+		return 0;
+	}
+	const uint32_t done = block_count * block_frames;
+	return done + drwav_read_pcm_frames_s16(wav, frames - done,
+	                                        out + (uint64_t)done * wav->channels);
+}
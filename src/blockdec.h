@@ -0,0 +1,25 @@
+#pragma once
+
+// Block-parallel decoding of MS and IMA ADPCM sources.
+//
+// Every block of these formats starts from the decoder state in its own
+// header, so the whole blocks of a mapped source are decoded concurrently,
+// straight into place. Whatever doesn't fill a whole block at the end is left
+// to dr_wav's serial reader. The result is the same as reading the source with
+// drwav_read_pcm_frames_s16().
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "3rdparty/dr_wav/dr_wav.h"
+
+// Frames decoded by one work item, at the least.
+#define BLOCKDEC_MIN_FRAMES 16384
+
+// Reads up to `frames` frames from a freshly opened `wav` into `out`, like
+// drwav_read_pcm_frames_s16(), using up to `jobs` threads. `data` and `size`
+// are the whole source file the stream was opened on; with no mapping, or a
+// stream that isn't MS or IMA ADPCM, everything is read serially. Returns the
+// number of frames read.
+uint32_t blockdec_read_s16(drwav *wav, const void *data, size_t size, int16_t *out,
+                           uint32_t frames, int jobs);
@@ -0,0 +1,186 @@
+#include "cache.h"
+#include "hash.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC 0x435A4D59  // 'YMZC'
+#define CACHE_VERSION 3
+
+typedef struct CacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	CacheKey key;
+	CacheRecord rec;
+} CacheHeader;
+
+static atomic_uint s_tmp_counter;
+
+bool cache_init(Cache *c, const char *dir)
+{
+	memset(c, 0, sizeof(*c));
+	strncpy(c->dir, dir, sizeof(c->dir));
+	c->dir[sizeof(c->dir)-1] = '\0';
+#ifdef _WIN32
+	const int mkdir_ret = mkdir(c->dir);
+#else
+	const int mkdir_ret = mkdir(c->dir, 0777);
+#endif
+	if (mkdir_ret != 0 && errno != EEXIST)
+	{
+		fprintf(stderr, "[CACHE] Couldn't create \"%s\"\n", c->dir);
+		return false;
+	}
+	return true;
+}
+
+bool cache_key_for_file(const char *fname, const void *params, uint32_t params_len,
+                        CacheKey *out)
+{
+	FILE *f = fopen(fname, "rb");
+	if (!f) return false;
+
+	// Two differently seeded hashes give a 128-bit key.
+	Hash64 h[2];
+	hash64_init(&h[0], 0);
+	hash64_init(&h[1], CACHE_MAGIC);
+
+	uint8_t buf[65536];
+	size_t got;
+	while ((got = fread(buf, 1, sizeof(buf), f)) > 0)
+	{
+		hash64_update(&h[0], buf, got);
+		hash64_update(&h[1], buf, got);
+	}
+	const bool ok = !ferror(f);
+	fclose(f);
+	if (!ok) return false;
+
+	const uint32_t version = CACHE_VERSION;
+	for (int i = 0; i < 2; i++)
+	{
+		hash64_update(&h[i], &version, sizeof(version));
+		hash64_update(&h[i], params, params_len);
+		out->h[i] = hash64_final(&h[i]);
+	}
+	return true;
+}
+
+static void cache_path(const Cache *c, const CacheKey *key, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s/%016llx%016llx.ymzc", c->dir,
+	         (unsigned long long)key->h[0], (unsigned long long)key->h[1]);
+}
+
+FILE *cache_open_payload(Cache *c, const CacheKey *key, CacheRecord *rec)
+{
+	char fname[512];
+	cache_path(c, key, fname, sizeof(fname));
+	FILE *f = fopen(fname, "rb");
+	if (!f) return NULL;
+
+	CacheHeader hdr;
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1) goto bad;
+	if (hdr.magic != CACHE_MAGIC || hdr.version != CACHE_VERSION) goto bad;
+	if (memcmp(&hdr.key, key, sizeof(*key)) != 0) goto bad;
+
+	// The payload must be exactly as long as the header claims.
+	if (fseek(f, 0, SEEK_END) != 0) goto bad;
+	if (ftell(f) != (long)(sizeof(hdr) + hdr.rec.data_bytes)) goto bad;
+	if (fseek(f, sizeof(hdr), SEEK_SET) != 0) goto bad;
+
+	*rec = hdr.rec;
+	return f;
+
+bad:
+	fclose(f);
+	return NULL;
+}
+
+bool cache_lookup(Cache *c, const CacheKey *key, CacheRecord *rec)
+{
+	FILE *f = cache_open_payload(c, key, rec);
+	if (!f)
+	{
+		atomic_fetch_add(&c->misses, 1);
+		return false;
+	}
+	fclose(f);
+	atomic_fetch_add(&c->hits, 1);
+	return true;
+}
+
+bool cache_writer_begin(CacheWriter *w, Cache *c, const CacheKey *key)
+{
+	memset(w, 0, sizeof(*w));
+	w->cache = c;
+	w->key = *key;
+	cache_path(c, key, w->fname, sizeof(w->fname));
+	// Unique per process and per store, so concurrent writers never share a file.
+	snprintf(w->tmp_fname, sizeof(w->tmp_fname), "%s.%ld.%u.tmp", w->fname, (long)getpid(),
+	         atomic_fetch_add(&s_tmp_counter, 1));
+
+	w->f = fopen(w->tmp_fname, "wb");
+	if (!w->f)
+	{
+		fprintf(stderr, "[CACHE] Couldn't open %s for writing\n", w->tmp_fname);
+		return false;
+	}
+
+	// The header is rewritten on commit once the results are known.
+	CacheHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	w->ok = fwrite(&hdr, sizeof(hdr), 1, w->f) == 1;
+	return true;
+}
+
+void cache_writer_write(CacheWriter *w, const void *data, uint32_t len)
+{
+	if (!w->f || !w->ok || len == 0) return;
+	w->ok = fwrite(data, 1, len, w->f) == len;
+}
+
+void cache_writer_commit(CacheWriter *w, const CacheRecord *rec)
+{
+	if (!w->f) return;
+
+	CacheHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = CACHE_MAGIC;
+	hdr.version = CACHE_VERSION;
+	hdr.key = w->key;
+	hdr.rec = *rec;
+	bool ok = w->ok && fseek(w->f, 0, SEEK_SET) == 0;
+	if (ok) ok = fwrite(&hdr, sizeof(hdr), 1, w->f) == 1;
+	if (fclose(w->f) != 0) ok = false;
+	w->f = NULL;
+
+	// rename() replaces atomically, so readers see either nothing or a whole file.
+	if (!ok || rename(w->tmp_fname, w->fname) != 0)
+	{
+		fprintf(stderr, "[CACHE] Couldn't store %s\n", w->fname);
+		remove(w->tmp_fname);
+		return;
+	}
+	atomic_fetch_add(&w->cache->stores, 1);
+}
+
+void cache_writer_abort(CacheWriter *w)
+{
+	if (!w->f) return;
+	fclose(w->f);
+	w->f = NULL;
+	remove(w->tmp_fname);
+}
+
+void cache_report(const Cache *c)
+{
+	printf("[CACHE] %u hits, %u misses, %u stored\n",
+	       atomic_load(&c->hits), atomic_load(&c->misses), atomic_load(&c->stores));
+}
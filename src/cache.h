@@ -0,0 +1,74 @@
+#pragma once
+
+// On-disk conversion cache.
+//
+// Entries are keyed on a hash of the source file's bytes plus whichever
+// conversion parameters affect the output. Each key maps to one file holding
+// the conversion results and the encoded payload. Files are written to a
+// temporary name and renamed into place, so several ymztool processes may
+// share a cache directory.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct CacheKey
+{
+	uint64_t h[2];
+} CacheKey;
+
+// Conversion results stored alongside the payload.
+typedef struct CacheRecord
+{
+	uint32_t sample_rate;
+	uint32_t length;
+	uint32_t channels;
+	int32_t loop_start_pos;
+	int32_t loop_end_pos;
+	uint32_t bits_per_sample;
+	uint32_t data_bytes;
+	uint32_t fn_reg;
+} CacheRecord;
+
+typedef struct Cache
+{
+	char dir[256];
+	atomic_uint hits;
+	atomic_uint misses;
+	atomic_uint stores;
+} Cache;
+
+// Returns false if the directory can't be created.
+bool cache_init(Cache *c, const char *dir);
+
+// Hashes the file at `fname` together with `params`.
+bool cache_key_for_file(const char *fname, const void *params, uint32_t params_len,
+                        CacheKey *out);
+
+// Looks up a key without reading its payload. Fills `rec` on a hit.
+// Updates the hit/miss counters.
+bool cache_lookup(Cache *c, const CacheKey *key, CacheRecord *rec);
+
+// Opens a stored entry positioned at the start of its payload, or returns
+// NULL if it is missing or damaged. Fills `rec` when it succeeds.
+FILE *cache_open_payload(Cache *c, const CacheKey *key, CacheRecord *rec);
+
+// Writes a new entry incrementally. Nothing is visible to other readers until
+// cache_writer_commit() succeeds.
+typedef struct CacheWriter
+{
+	Cache *cache;
+	CacheKey key;
+	FILE *f;
+	char fname[512];
+	char tmp_fname[600];
+	bool ok;
+} CacheWriter;
+
+bool cache_writer_begin(CacheWriter *w, Cache *c, const CacheKey *key);
+void cache_writer_write(CacheWriter *w, const void *data, uint32_t len);
+void cache_writer_commit(CacheWriter *w, const CacheRecord *rec);
+void cache_writer_abort(CacheWriter *w);
+
+void cache_report(const Cache *c);
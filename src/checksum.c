@@ -0,0 +1,142 @@
+#include "checksum.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define CRC32_POLY 0xEDB88320u
+
+// Slicing-by-8: s_crc_table[k][b] is the CRC of byte b followed by k zeros.
+static uint32_t s_crc_table[8][256];
+static pthread_once_t s_crc_once = PTHREAD_ONCE_INIT;
+
+static void crc32_init_tables(void)
+{
+	for (int b = 0; b < 256; b++)
+	{
+		uint32_t c = b;
+		for (int i = 0; i < 8; i++) c = (c & 1) ? (c >> 1) ^ CRC32_POLY : c >> 1;
+		s_crc_table[0][b] = c;
+	}
+	for (int b = 0; b < 256; b++)
+	{
+		for (int k = 1; k < 8; k++)
+		{
+			const uint32_t c = s_crc_table[k - 1][b];
+			s_crc_table[k][b] = (c >> 8) ^ s_crc_table[0][c & 0xFF];
+		}
+	}
+}
+
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+	pthread_once(&s_crc_once, crc32_init_tables);
+	const uint8_t *p = (const uint8_t *)data;
+	uint32_t c = ~crc;
+	for (; len >= 8; len -= 8, p += 8)
+	{
+		const uint32_t lo = c ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+		                         ((uint32_t)p[3] << 24));
+		c = s_crc_table[7][lo & 0xFF] ^ s_crc_table[6][(lo >> 8) & 0xFF] ^
+		    s_crc_table[5][(lo >> 16) & 0xFF] ^ s_crc_table[4][lo >> 24] ^
+		    s_crc_table[3][p[4]] ^ s_crc_table[2][p[5]] ^
+		    s_crc_table[1][p[6]] ^ s_crc_table[0][p[7]];
+	}
+	while (len--) c = (c >> 8) ^ s_crc_table[0][(c ^ *p++) & 0xFF];
+	return ~c;
+}
+
+static inline uint32_t rotl32(uint32_t x, int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+static void sha1_block(Sha1 *s, const uint8_t *p)
+{
+	uint32_t w[80];
+	for (int i = 0; i < 16; i++)
+	{
+		w[i] = ((uint32_t)p[i * 4] << 24) | ((uint32_t)p[i * 4 + 1] << 16) |
+		       ((uint32_t)p[i * 4 + 2] << 8) | (uint32_t)p[i * 4 + 3];
+	}
+	for (int i = 16; i < 80; i++) w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+	uint32_t a = s->h[0], b = s->h[1], c = s->h[2], d = s->h[3], e = s->h[4];
+	for (int i = 0; i < 80; i++)
+	{
+		uint32_t f, k;
+		if (i < 20)
+		{
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		}
+		else if (i < 40)
+		{
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		}
+		else if (i < 60)
+		{
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		}
+		else
+		{
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+		const uint32_t t = rotl32(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = rotl32(b, 30);
+		b = a;
+		a = t;
+	}
+	s->h[0] += a;
+	s->h[1] += b;
+	s->h[2] += c;
+	s->h[3] += d;
+	s->h[4] += e;
+}
+
+void sha1_init(Sha1 *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->h[0] = 0x67452301;
+	s->h[1] = 0xEFCDAB89;
+	s->h[2] = 0x98BADCFE;
+	s->h[3] = 0x10325476;
+	s->h[4] = 0xC3D2E1F0;
+}
+
+void sha1_update(Sha1 *s, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	s->total_len += len;
+	if (s->block_len > 0)
+	{
+		const size_t n = (len < 64 - s->block_len) ? len : 64 - s->block_len;
+		memcpy(s->block + s->block_len, p, n);
+		s->block_len += n;
+		p += n;
+		len -= n;
+		if (s->block_len < 64) return;
+		sha1_block(s, s->block);
+		s->block_len = 0;
+	}
+	for (; len >= 64; len -= 64, p += 64) sha1_block(s, p);
+	memcpy(s->block, p, len);
+	s->block_len = len;
+}
+
+void sha1_final(Sha1 *s, uint8_t digest[20])
+{
+	const uint64_t bits = s->total_len * 8;
+	const uint8_t pad = 0x80;
+	const uint8_t zero[64] = {0};
+	sha1_update(s, &pad, 1);
+	sha1_update(s, zero, (s->block_len <= 56) ? 56 - s->block_len : 120 - s->block_len);
+	uint8_t len_be[8];
+	for (int i = 0; i < 8; i++) len_be[i] = (bits >> (56 - 8 * i)) & 0xFF;
+	sha1_update(s, len_be, 8);
+	for (int i = 0; i < 20; i++) digest[i] = (s->h[i / 4] >> (24 - 8 * (i % 4))) & 0xFF;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// ROM checksums: CRC-32 (as zip and MAME use) and SHA-1, computed
+// incrementally.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Continues `crc` over `data`; start from 0.
+uint32_t crc32_update(uint32_t crc, const void *data, size_t len);
+
+typedef struct Sha1
+{
+	uint32_t h[5];
+	uint64_t total_len;
+	uint8_t block[64];
+	uint32_t block_len;
+} Sha1;
+
+void sha1_init(Sha1 *s);
+void sha1_update(Sha1 *s, const void *data, size_t len);
+void sha1_final(Sha1 *s, uint8_t digest[20]);
@@ -0,0 +1,496 @@
+#include "diff.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "mapfile.h"
+#include "outbuf.h"
+
+#define DIFF_DEFAULT_SECTOR 0x10000
+#define DIFF_PATCH_VERSION 1
+
+// Width of the rolling hash, and so the shortest run of moved data found.
+#define DIFF_WINDOW 32
+#define DIFF_HASH_MUL 0x01000193u
+
+// Shortest run of one byte worth a fill op, rather than giving it.
+#define DIFF_MIN_FILL 16
+
+enum
+{
+	DIFF_OP_COPY = 0x01,
+	DIFF_OP_DATA = 0x02,
+	DIFF_OP_FILL = 0x03,
+};
+
+typedef struct DiffImage
+{
+	MapFile map;
+	uint8_t *owned;  // Read in, where the file couldn't be mapped.
+	const uint8_t *data;
+	uint32_t size;
+} DiffImage;
+
+typedef struct Diff
+{
+	const uint8_t *old_data;
+	uint32_t old_size;
+	const uint8_t *new_data;
+	uint32_t new_size;
+	uint32_t base;
+	uint32_t sector;
+	uint32_t lead;      // Bytes of the first block before the images start.
+	uint8_t *changed;   // Per block, from the one holding the images' start.
+	uint32_t blocks;
+
+	// Windows of the old image at multiples of DIFF_WINDOW, by rolling hash.
+	uint32_t *slot_hash;
+	uint32_t *slot_offs;  // Offset + 1; 0 is free.
+	uint32_t slot_mask;
+	uint32_t mul_top;     // DIFF_HASH_MUL to the power DIFF_WINDOW - 1.
+
+	uint64_t copied;
+	uint64_t filled;
+	uint64_t given;
+} Diff;
+
+static bool diff_load(DiffImage *img, const char *fname)
+{
+	memset(img, 0, sizeof(*img));
+	if (mapfile_open(&img->map, fname))
+	{
+		if (img->map.size > UINT32_MAX)
+		{
+			fprintf(stderr, "[DIFF] %s is too big\n", fname);
+			mapfile_close(&img->map);
+			return false;
+		}
+		img->data = img->map.data;
+		img->size = img->map.size;
+		return true;
+	}
+
+	// Empty, or no mmap(): read it in.
+	FILE *f = fopen(fname, "rb");
+	if (!f)
+	{
+		fprintf(stderr, "[DIFF] Couldn't open %s\n", fname);
+		return false;
+	}
+	bool ok = fseek(f, 0, SEEK_END) == 0;
+	const long size = ok ? ftell(f) : -1;
+	if (size < 0 || (unsigned long)size > UINT32_MAX || fseek(f, 0, SEEK_SET) != 0)
+	{
+		fprintf(stderr, "[DIFF] Couldn't read %s\n", fname);
+		fclose(f);
+		return false;
+	}
+	img->owned = malloc(size ? size : 1);
+	if (!img->owned || fread(img->owned, 1, size, f) != (size_t)size)
+	{
+		fprintf(stderr, "[DIFF] Couldn't read %s\n", fname);
+		free(img->owned);
+		img->owned = NULL;
+		fclose(f);
+		return false;
+	}
+	fclose(f);
+	img->data = img->owned;
+	img->size = size;
+	return true;
+}
+
+static void diff_unload(DiffImage *img)
+{
+	mapfile_close(&img->map);
+	free(img->owned);
+	memset(img, 0, sizeof(*img));
+}
+
+static uint32_t diff_block_of(const Diff *d, uint32_t offs)
+{
+	return ((uint64_t)d->lead + offs) / d->sector;
+}
+
+// Image offsets of block `b`, clipped to the images' start but not their end.
+static uint32_t diff_block_start(const Diff *d, uint32_t b)
+{
+	return b ? (uint64_t)b * d->sector - d->lead : 0;
+}
+
+static uint64_t diff_block_end(const Diff *d, uint32_t b)
+{
+	return ((uint64_t)b + 1) * d->sector - d->lead;
+}
+
+// Just past the run of the old image starting at `offs`, up to `want` bytes
+// long, that a copy into block `block` may read: anything not in a block
+// rewritten before it. `offs` itself if that can't be read.
+static uint32_t diff_source_end(const Diff *d, uint32_t offs, uint32_t block, uint32_t want)
+{
+	const uint64_t limit = (uint64_t)offs + want;
+	uint64_t end = offs;
+	while (end < d->old_size && end < limit)
+	{
+		const uint32_t b = diff_block_of(d, end);
+		if (b < block && d->changed[b]) break;
+		end = diff_block_end(d, b);
+	}
+	if (end > d->old_size) end = d->old_size;
+	return end;
+}
+
+static uint32_t diff_hash(const uint8_t *p)
+{
+	uint32_t h = 0;
+	for (int i = 0; i < DIFF_WINDOW; i++) h = h * DIFF_HASH_MUL + p[i];
+	return h;
+}
+
+static uint32_t diff_hash_roll(const Diff *d, uint32_t h, uint8_t out, uint8_t in)
+{
+	return (h - out * d->mul_top) * DIFF_HASH_MUL + in;
+}
+
+static uint32_t diff_slot(const Diff *d, uint32_t h)
+{
+	return (uint32_t)(((uint64_t)h * 0x9E3779B97F4A7C15ull) >> 32) & d->slot_mask;
+}
+
+static bool diff_index_init(Diff *d)
+{
+	const uint32_t windows = d->old_size / DIFF_WINDOW;
+	uint32_t cap = 1024;
+	while (cap < 2 * (uint64_t)windows) cap *= 2;
+	d->slot_hash = malloc(sizeof(*d->slot_hash) * cap);
+	d->slot_offs = calloc(cap, sizeof(*d->slot_offs));
+	if (!d->slot_hash || !d->slot_offs) return false;
+	d->slot_mask = cap - 1;
+
+	d->mul_top = 1;
+	for (int i = 1; i < DIFF_WINDOW; i++) d->mul_top *= DIFF_HASH_MUL;
+
+	for (uint32_t w = 0; w < windows; w++)
+	{
+		const uint32_t offs = w * DIFF_WINDOW;
+		const uint32_t h = diff_hash(d->old_data + offs);
+		uint32_t slot = diff_slot(d, h);
+		// The earliest window with a given hash is kept.
+		while (d->slot_offs[slot] && d->slot_hash[slot] != h) slot = (slot + 1) & d->slot_mask;
+		if (d->slot_offs[slot]) continue;
+		d->slot_hash[slot] = h;
+		d->slot_offs[slot] = offs + 1;
+	}
+	return true;
+}
+
+// Offset of a window of the old image with hash `h`, or UINT32_MAX.
+static uint32_t diff_index_find(const Diff *d, uint32_t h)
+{
+	for (uint32_t slot = diff_slot(d, h); d->slot_offs[slot]; slot = (slot + 1) & d->slot_mask)
+	{
+		if (d->slot_hash[slot] == h) return d->slot_offs[slot] - 1;
+	}
+	return UINT32_MAX;
+}
+
+// Whether the window of the new image at `offs` can be copied from `src`
+// into block `block`.
+static bool diff_window_matches(const Diff *d, uint32_t offs, uint32_t src, uint32_t block)
+{
+	if (src > d->old_size || d->old_size - src < DIFF_WINDOW) return false;
+	if (diff_source_end(d, src, block, DIFF_WINDOW) < src + DIFF_WINDOW) return false;
+	return memcmp(d->new_data + offs, d->old_data + src, DIFF_WINDOW) == 0;
+}
+
+static void diff_put_u32(OutBuf *patch, uint32_t x)
+{
+	uint8_t *p = outbuf_write(patch, NULL, 4);
+	if (!p) return;
+	p[0] = (x>>24) & 0xFF;
+	p[1] = (x>>16) & 0xFF;
+	p[2] = (x>>8) & 0xFF;
+	p[3] = x & 0xFF;
+}
+
+static void diff_put_u64(OutBuf *patch, uint64_t x)
+{
+	diff_put_u32(patch, x >> 32);
+	diff_put_u32(patch, x & 0xFFFFFFFF);
+}
+
+static void diff_put_op(OutBuf *patch, uint8_t op, uint32_t len)
+{
+	outbuf_write(patch, &op, 1);
+	diff_put_u32(patch, len);
+}
+
+// Gives new bytes [lo, hi), with long runs of one byte as fills.
+static void diff_put_given(Diff *d, OutBuf *patch, uint32_t lo, uint32_t hi)
+{
+	const uint8_t *data = d->new_data;
+	uint32_t pending = lo;
+	uint32_t i = lo;
+	while (i < hi)
+	{
+		uint32_t run = i + 1;
+		while (run < hi && data[run] == data[i]) run++;
+		if (run - i < DIFF_MIN_FILL)
+		{
+			i = run;
+			continue;
+		}
+		if (i > pending)
+		{
+			diff_put_op(patch, DIFF_OP_DATA, i - pending);
+			outbuf_write(patch, data + pending, i - pending);
+			d->given += i - pending;
+		}
+		diff_put_op(patch, DIFF_OP_FILL, run - i);
+		outbuf_write(patch, &data[i], 1);
+		d->filled += run - i;
+		pending = i = run;
+	}
+	if (hi > pending)
+	{
+		diff_put_op(patch, DIFF_OP_DATA, hi - pending);
+		outbuf_write(patch, data + pending, hi - pending);
+		d->given += hi - pending;
+	}
+}
+
+// Writes the ops that rebuild new bytes [lo, hi) of block `block`: copies of
+// whatever can be found in the old image, rsync-style, and the rest given.
+static void diff_encode(Diff *d, OutBuf *patch, uint32_t block, uint32_t lo, uint32_t hi)
+{
+	const uint8_t *data = d->new_data;
+	uint32_t pending = lo;
+	uint32_t offs = lo;
+	uint32_t h = 0;
+	bool hashed = false;
+	while (hi - offs >= DIFF_WINDOW)
+	{
+		if (!hashed) h = diff_hash(data + offs);
+		hashed = true;
+
+		// Unchanged data most often stays where it was, so look there first.
+		uint32_t src = UINT32_MAX;
+		if (diff_window_matches(d, offs, offs, block))
+		{
+			src = offs;
+		}
+		else
+		{
+			const uint32_t found = diff_index_find(d, h);
+			if (found != UINT32_MAX && diff_window_matches(d, offs, found, block)) src = found;
+		}
+		if (src == UINT32_MAX)
+		{
+			if (hi - offs > DIFF_WINDOW) h = diff_hash_roll(d, h, data[offs], data[offs + DIFF_WINDOW]);
+			offs++;
+			continue;
+		}
+
+		// Grow the match both ways.
+		uint32_t start = offs;
+		uint32_t from = src;
+		while (start > pending && from > 0 && data[start - 1] == d->old_data[from - 1] &&
+		       diff_source_end(d, from - 1, block, 1) > from - 1)
+		{
+			start--;
+			from--;
+		}
+		const uint32_t src_end = diff_source_end(d, src, block, hi - offs);
+		uint32_t end = offs + DIFF_WINDOW;
+		for (uint32_t s = src + DIFF_WINDOW; end < hi && s < src_end && data[end] == d->old_data[s]; s++)
+		{
+			end++;
+		}
+
+		diff_put_given(d, patch, pending, start);
+		diff_put_op(patch, DIFF_OP_COPY, d->base + from);
+		diff_put_u32(patch, end - start);
+		d->copied += end - start;
+		pending = offs = end;
+		hashed = false;
+	}
+	diff_put_given(d, patch, pending, hi);
+}
+
+static bool diff_parse_u32(const char *arg, uint32_t *value)
+{
+	char *end;
+	const unsigned long long x = strtoull(arg, &end, 0);
+	if (*arg == '\0' || *arg == '-' || *end != '\0' || x > UINT32_MAX) return false;
+	*value = x;
+	return true;
+}
+
+static void diff_usage(void)
+{
+	printf("Usage: ymztool diff [--sector SIZE] [--base ADDRESS] [-o PATCH] OLD NEW\n");
+	printf("OLD and NEW are two builds of one .ymz or .dat.\n");
+	printf("  --sector SIZE    Erase block size (default: 0x%X)\n", DIFF_DEFAULT_SECTOR);
+	printf("  --base ADDRESS   Flash address of the images' first byte (default: 0)\n");
+	printf("  -o PATCH         Write a patch that turns OLD into NEW in flash\n");
+}
+
+int diff_main(int argc, char **argv)
+{
+	const char *fnames[2] = {NULL, NULL};
+	const char *patch_fname = NULL;
+	uint32_t sector = DIFF_DEFAULT_SECTOR;
+	uint32_t base = 0;
+	int fname_count = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const bool has_arg = i + 1 < argc;
+		if (strcmp(argv[i], "--sector") == 0 && has_arg)
+		{
+			if (!diff_parse_u32(argv[++i], &sector) || sector == 0 || (sector & (sector - 1)))
+			{
+				fprintf(stderr, "[DIFF] The erase block size must be a power of two\n");
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "--base") == 0 && has_arg)
+		{
+			if (!diff_parse_u32(argv[++i], &base))
+			{
+				fprintf(stderr, "[DIFF] Bad base address \"%s\"\n", argv[i]);
+				return -1;
+			}
+		}
+		else if (strcmp(argv[i], "-o") == 0 && has_arg)
+		{
+			patch_fname = argv[++i];
+		}
+		else if (argv[i][0] == '-' || fname_count == 2)
+		{
+			diff_usage();
+			return -1;
+		}
+		else
+		{
+			fnames[fname_count++] = argv[i];
+		}
+	}
+	if (fname_count < 2)
+	{
+		diff_usage();
+		return -1;
+	}
+
+	DiffImage old_img, new_img;
+	if (!diff_load(&old_img, fnames[0])) return -1;
+	if (!diff_load(&new_img, fnames[1]))
+	{
+		diff_unload(&old_img);
+		return -1;
+	}
+
+	int ret = -1;
+	Diff d;
+	memset(&d, 0, sizeof(d));
+	OutBuf patch;
+	outbuf_init(&patch);
+	d.old_data = old_img.data;
+	d.old_size = old_img.size;
+	d.new_data = new_img.data;
+	d.new_size = new_img.size;
+	d.base = base;
+	d.sector = sector;
+	d.lead = base % sector;
+
+	const uint32_t size = (d.old_size > d.new_size) ? d.old_size : d.new_size;
+	if ((uint64_t)base + size > (uint64_t)UINT32_MAX + 1)
+	{
+		fprintf(stderr, "[DIFF] The images run past the end of the address space\n");
+		goto done;
+	}
+	d.blocks = size ? diff_block_of(&d, size - 1) + 1 : 0;
+	const uint32_t new_blocks = d.new_size ? diff_block_of(&d, d.new_size - 1) + 1 : 0;
+	d.changed = calloc(d.blocks ? d.blocks : 1, 1);
+	if (!d.changed || (patch_fname && !diff_index_init(&d)))
+	{
+		fprintf(stderr, "[DIFF] Out of memory\n");
+		goto done;
+	}
+
+	// Blocks the new image has different bytes in, or any past the old one's
+	// end. Blocks only the old image reaches are left as they are.
+	uint32_t changed = 0;
+	for (uint32_t b = 0; b < new_blocks; b++)
+	{
+		const uint32_t lo = diff_block_start(&d, b);
+		uint64_t hi = diff_block_end(&d, b);
+		if (hi > d.new_size) hi = d.new_size;
+		d.changed[b] = hi > d.old_size || memcmp(d.new_data + lo, d.old_data + lo, hi - lo) != 0;
+		changed += d.changed[b];
+	}
+
+	for (uint32_t b = 0; b < new_blocks; b++)
+	{
+		if (!d.changed[b]) continue;
+		uint32_t run = b + 1;
+		while (run < new_blocks && d.changed[run]) run++;
+		const uint64_t first = (uint64_t)base - d.lead + (uint64_t)b * sector;
+		const uint64_t last = (uint64_t)base - d.lead + (uint64_t)run * sector - 1;
+		printf("[DIFF] $%06llX-$%06llX (%u block%s)\n", (unsigned long long)first,
+		       (unsigned long long)last, run - b, (run - b == 1) ? "" : "s");
+		b = run;
+	}
+	printf("[DIFF] %u of %u erase blocks need rewriting (%llu bytes)\n", changed, new_blocks,
+	       (unsigned long long)changed * sector);
+	if (d.old_size > d.new_size)
+	{
+		printf("[DIFF] The new image is %u bytes shorter; flash past its end is left as it was\n",
+		       d.old_size - d.new_size);
+	}
+
+	if (patch_fname)
+	{
+		outbuf_write(&patch, "YMZP", 4);
+		diff_put_u32(&patch, DIFF_PATCH_VERSION);
+		diff_put_u32(&patch, base);
+		diff_put_u32(&patch, sector);
+		diff_put_u32(&patch, d.old_size);
+		diff_put_u32(&patch, d.new_size);
+		diff_put_u64(&patch, hash64(d.old_data, d.old_size, 0));
+		diff_put_u64(&patch, hash64(d.new_data, d.new_size, 0));
+		diff_put_u32(&patch, changed);
+		for (uint32_t b = 0; b < new_blocks; b++)
+		{
+			if (!d.changed[b]) continue;
+			const uint32_t lo = diff_block_start(&d, b);
+			uint64_t hi = diff_block_end(&d, b);
+			if (hi > d.new_size) hi = d.new_size;
+			diff_put_u32(&patch, base + lo);
+			diff_put_u32(&patch, hi - lo);
+			diff_encode(&d, &patch, b, lo, hi);
+		}
+		if (patch.failed || !outbuf_save(&patch, patch_fname))
+		{
+			fprintf(stderr, "[DIFF] Couldn't write %s\n", patch_fname);
+			goto done;
+		}
+		printf("[DIFF] Wrote %s: %zu bytes; %llu copied from flash, %llu filled and %llu given\n",
+		       patch_fname, patch.len, (unsigned long long)d.copied, (unsigned long long)d.filled,
+		       (unsigned long long)d.given);
+	}
+	ret = 0;
+
+done:
+	outbuf_free(&patch);
+	free(d.changed);
+	free(d.slot_hash);
+	free(d.slot_offs);
+	diff_unload(&old_img);
+	diff_unload(&new_img);
+	return ret;
+}
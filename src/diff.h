@@ -0,0 +1,34 @@
+#pragma once
+
+// `ymztool diff`: what changed between two builds of a flash image.
+//
+// Compares a previous .ymz or .dat with a new one erase block by erase
+// block, lists the blocks that need rewriting, and writes a patch holding
+// just enough to rebuild them from what is already in flash.
+//
+// The patch is big-endian throughout:
+//
+//   "YMZP"  magic
+//   u32     version (1)
+//   u32     base: the flash address of both images' first byte
+//   u32     erase block size
+//   u32     old image size
+//   u32     new image size
+//   u64     XXH64 (seed 0) of the old image
+//   u64     XXH64 (seed 0) of the new image
+//   u32     number of blocks that follow
+//
+// Then, for each block to rewrite, in rising address order:
+//
+//   u32     address of the first byte to program
+//   u32     number of bytes to program
+//   ops, until that many bytes are made:
+//     0x01 u32 src u32 len   copy from flash address `src`
+//     0x02 u32 len bytes     these bytes
+//     0x03 u32 len u8 byte   `len` copies of one byte
+//
+// The bytes to program are the part of the block inside the new image; the
+// rest of the block is left erased. A copy reads flash as it was before the
+// block was erased, and never from a block an earlier record rewrote.
+
+int diff_main(int argc, char **argv);
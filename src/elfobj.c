@@ -0,0 +1,213 @@
+#include "elfobj.h"
+
+#include <string.h>
+
+#define ELF_EM_NONE 0
+#define ELF_EM_386 3
+#define ELF_EM_68K 4
+#define ELF_EM_X86_64 62
+#define ELF_EM_AARCH64 183
+
+#define ELF_SHT_PROGBITS 1
+#define ELF_SHT_SYMTAB 2
+#define ELF_SHT_STRTAB 3
+#define ELF_SHF_ALLOC 0x2
+#define ELF_STB_GLOBAL 1
+#define ELF_STT_OBJECT 1
+
+// Alignment of each blob's section.
+#define ELF_BLOB_ALIGN 4
+
+typedef struct ElfFormat
+{
+	bool is64;
+	bool big_endian;
+	uint16_t machine;
+} ElfFormat;
+
+static ElfFormat elfobj_format(ElfTarget target)
+{
+	ElfFormat f = {false, true, ELF_EM_68K};
+	if (target == ELF_TARGET_M68K) return f;
+
+	const uint16_t probe = 1;
+	f.big_endian = *(const uint8_t *)&probe == 0;
+	f.is64 = sizeof(void *) == 8;
+#if defined(_WIN32) || defined(__APPLE__)
+	f.machine = ELF_EM_NONE;
+#elif defined(__x86_64__)
+	f.machine = ELF_EM_X86_64;
+#elif defined(__i386__)
+	f.machine = ELF_EM_386;
+#elif defined(__aarch64__)
+	f.machine = ELF_EM_AARCH64;
+#elif defined(__m68k__)
+	f.machine = ELF_EM_68K;
+#else
+	f.machine = ELF_EM_NONE;
+#endif
+	return f;
+}
+
+bool elfobj_supported(ElfTarget target)
+{
+	return elfobj_format(target).machine != ELF_EM_NONE;
+}
+
+typedef struct ElfOut
+{
+	OutBuf *b;
+	ElfFormat f;
+	size_t start;  // Where the object begins in `b`.
+} ElfOut;
+
+static void elf_put(ElfOut *o, uint64_t x, int bytes)
+{
+	uint8_t *p = outbuf_write(o->b, NULL, bytes);
+	if (!p) return;
+	for (int i = 0; i < bytes; i++)
+	{
+		const int shift = o->f.big_endian ? 8 * (bytes - 1 - i) : 8 * i;
+		p[i] = (x >> shift) & 0xFF;
+	}
+}
+
+static void elf_u8(ElfOut *o, uint8_t x) { elf_put(o, x, 1); }
+static void elf_u16(ElfOut *o, uint16_t x) { elf_put(o, x, 2); }
+static void elf_u32(ElfOut *o, uint32_t x) { elf_put(o, x, 4); }
+// Addresses, offsets and sizes, as wide as the class has them.
+static void elf_word(ElfOut *o, uint64_t x) { elf_put(o, x, o->f.is64 ? 8 : 4); }
+
+// Pads with zeros up to `offs` into the object.
+static void elf_pad_to(ElfOut *o, uint64_t offs)
+{
+	while (o->b->len - o->start < offs && !o->b->failed) elf_u8(o, 0);
+}
+
+static void elf_section(ElfOut *o, uint32_t name, uint32_t type, uint64_t flags, uint64_t offs,
+                        uint64_t size, uint32_t link, uint32_t info, uint64_t align, uint64_t entsize)
+{
+	elf_u32(o, name);
+	elf_u32(o, type);
+	elf_word(o, flags);
+	elf_word(o, 0);  // Address.
+	elf_word(o, offs);
+	elf_word(o, size);
+	elf_u32(o, link);
+	elf_u32(o, info);
+	elf_word(o, align);
+	elf_word(o, entsize);
+}
+
+static uint64_t elf_align(uint64_t x, uint32_t align)
+{
+	return (x + align - 1) & ~(uint64_t)(align - 1);
+}
+
+// One string table serves for both section and symbol names: each blob's
+// section name, .rodata.SYMBOL, ends with its symbol's.
+static const char s_fixed_names[] = "\0.note.GNU-stack\0.symtab\0.strtab";
+#define ELF_NOTE_NAME 1
+#define ELF_SYMTAB_NAME 17
+#define ELF_STRTAB_NAME 25
+#define ELF_RODATA_PREFIX ".rodata."
+
+// Offset of blob `i`'s section name in the string table.
+static uint32_t elf_blob_name(const ElfBlob *blobs, int i)
+{
+	uint32_t offs = sizeof(s_fixed_names);
+	for (int j = 0; j < i; j++) offs += strlen(ELF_RODATA_PREFIX) + strlen(blobs[j].symbol) + 1;
+	return offs;
+}
+
+void elfobj_write(OutBuf *b, ElfTarget target, const ElfBlob *blobs, int count)
+{
+	ElfOut o = {b, elfobj_format(target), b->len};
+	const uint32_t ehdr_size = o.f.is64 ? 64 : 52;
+	const uint32_t shdr_size = o.f.is64 ? 64 : 40;
+	const uint32_t sym_size = o.f.is64 ? 24 : 16;
+	const uint32_t word = o.f.is64 ? 8 : 4;
+
+	// Sections: the null one, the blobs, then .note.GNU-stack, .symtab and
+	// .strtab.
+	const int strtab_index = count + 3;
+	const int section_count = count + 4;
+
+	// Where everything goes.
+	uint64_t offs = ehdr_size;
+	for (int i = 0; i < count; i++) offs = elf_align(offs, ELF_BLOB_ALIGN) + blobs[i].size;
+	const uint64_t symtab_offs = elf_align(offs, word);
+	const uint64_t strtab_offs = symtab_offs + (uint64_t)(count + 1) * sym_size;
+	const uint32_t strtab_size = elf_blob_name(blobs, count);
+	const uint64_t shoff = elf_align(strtab_offs + strtab_size, word);
+
+	outbuf_write(b, "\x7F" "ELF", 4);
+	elf_u8(&o, o.f.is64 ? 2 : 1);
+	elf_u8(&o, o.f.big_endian ? 2 : 1);
+	elf_u8(&o, 1);  // Version.
+	elf_pad_to(&o, 16);
+	elf_u16(&o, 1);  // Relocatable.
+	elf_u16(&o, o.f.machine);
+	elf_u32(&o, 1);
+	elf_word(&o, 0);  // No entry point,
+	elf_word(&o, 0);  // or program headers.
+	elf_word(&o, shoff);
+	elf_u32(&o, 0);
+	elf_u16(&o, ehdr_size);
+	elf_u16(&o, 0);
+	elf_u16(&o, 0);
+	elf_u16(&o, shdr_size);
+	elf_u16(&o, section_count);
+	elf_u16(&o, strtab_index);
+
+	uint64_t blob_offs = ehdr_size;
+	for (int i = 0; i < count; i++)
+	{
+		blob_offs = elf_align(blob_offs, ELF_BLOB_ALIGN);
+		elf_pad_to(&o, blob_offs);
+		outbuf_write(b, blobs[i].data, blobs[i].size);
+		blob_offs += blobs[i].size;
+	}
+
+	// The null symbol, then a global one spanning each blob.
+	elf_pad_to(&o, symtab_offs + sym_size);
+	for (int i = 0; i < count; i++)
+	{
+		elf_u32(&o, elf_blob_name(blobs, i) + strlen(ELF_RODATA_PREFIX));
+		if (!o.f.is64)
+		{
+			elf_word(&o, 0);
+			elf_word(&o, blobs[i].size);
+		}
+		elf_u8(&o, ELF_STB_GLOBAL << 4 | ELF_STT_OBJECT);
+		elf_u8(&o, 0);
+		elf_u16(&o, 1 + i);
+		if (o.f.is64)
+		{
+			elf_word(&o, 0);
+			elf_word(&o, blobs[i].size);
+		}
+	}
+
+	outbuf_write(b, s_fixed_names, sizeof(s_fixed_names));
+	for (int i = 0; i < count; i++)
+	{
+		outbuf_write(b, ELF_RODATA_PREFIX, strlen(ELF_RODATA_PREFIX));
+		outbuf_write(b, blobs[i].symbol, strlen(blobs[i].symbol) + 1);
+	}
+
+	elf_pad_to(&o, shoff + shdr_size);
+	blob_offs = ehdr_size;
+	for (int i = 0; i < count; i++)
+	{
+		blob_offs = elf_align(blob_offs, ELF_BLOB_ALIGN);
+		elf_section(&o, elf_blob_name(blobs, i), ELF_SHT_PROGBITS, ELF_SHF_ALLOC, blob_offs,
+		            blobs[i].size, 0, 0, ELF_BLOB_ALIGN, 0);
+		blob_offs += blobs[i].size;
+	}
+	// An empty .note.GNU-stack tells the linker no executable stack is needed.
+	elf_section(&o, ELF_NOTE_NAME, ELF_SHT_PROGBITS, 0, strtab_offs, 0, 0, 0, 1, 0);
+	elf_section(&o, ELF_SYMTAB_NAME, ELF_SHT_SYMTAB, 0, symtab_offs, (uint64_t)(count + 1) * sym_size,
+	            strtab_index, 1, word, sym_size);
+	elf_section(&o, ELF_STRTAB_NAME, ELF_SHT_STRTAB, 0, strtab_offs, strtab_size, 0, 0, 1, 0);
+}
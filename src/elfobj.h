@@ -0,0 +1,32 @@
+#pragma once
+
+// Relocatable ELF objects holding binary blobs.
+//
+// Each blob gets a read-only section of its own, .rodata.SYMBOL, and a
+// global object symbol spanning it, so that the linker can take the data
+// straight from ymztool with no C array or incbin step in between.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+
+typedef enum ElfTarget
+{
+	ELF_TARGET_M68K,
+	ELF_TARGET_HOST,  // Whatever ymztool was built for.
+} ElfTarget;
+
+typedef struct ElfBlob
+{
+	const char *symbol;
+	const void *data;
+	uint32_t size;
+} ElfBlob;
+
+// Whether objects can be made for `target`; the host might not be ELF, or
+// might be a machine this doesn't know.
+bool elfobj_supported(ElfTarget target);
+
+// Appends an object holding `blobs` to `b`.
+void elfobj_write(OutBuf *b, ElfTarget target, const ElfBlob *blobs, int count);
@@ -0,0 +1,141 @@
+#include "hash.h"
+
+#include <string.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const uint8_t *p)
+{
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) |
+	       ((uint64_t)p[3] << 24) | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
+	       ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+	       ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static inline uint64_t merge_round64(uint64_t acc, uint64_t val)
+{
+	acc ^= round64(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+void hash64_init(Hash64 *h, uint64_t seed)
+{
+	memset(h, 0, sizeof(*h));
+	h->seed = seed;
+	h->v[0] = seed + PRIME64_1 + PRIME64_2;
+	h->v[1] = seed + PRIME64_2;
+	h->v[2] = seed;
+	h->v[3] = seed - PRIME64_1;
+}
+
+void hash64_update(Hash64 *h, const void *data, size_t len)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	const uint8_t *const end = p + len;
+	h->total_len += len;
+
+	// Top up a partial stripe first.
+	if (h->mem_size + len < 32)
+	{
+		memcpy(h->mem + h->mem_size, p, len);
+		h->mem_size += len;
+		return;
+	}
+	if (h->mem_size)
+	{
+		const uint32_t fill = 32 - h->mem_size;
+		memcpy(h->mem + h->mem_size, p, fill);
+		for (int i = 0; i < 4; i++) h->v[i] = round64(h->v[i], read64(h->mem + i * 8));
+		p += fill;
+		h->mem_size = 0;
+	}
+
+	uint64_t v0 = h->v[0], v1 = h->v[1], v2 = h->v[2], v3 = h->v[3];
+	while (p + 32 <= end)
+	{
+		v0 = round64(v0, read64(p));
+		v1 = round64(v1, read64(p + 8));
+		v2 = round64(v2, read64(p + 16));
+		v3 = round64(v3, read64(p + 24));
+		p += 32;
+	}
+	h->v[0] = v0; h->v[1] = v1; h->v[2] = v2; h->v[3] = v3;
+
+	if (p < end)
+	{
+		memcpy(h->mem, p, end - p);
+		h->mem_size = end - p;
+	}
+}
+
+uint64_t hash64_final(const Hash64 *h)
+{
+	uint64_t acc;
+	if (h->total_len >= 32)
+	{
+		acc = rotl64(h->v[0], 1) + rotl64(h->v[1], 7) + rotl64(h->v[2], 12) + rotl64(h->v[3], 18);
+		for (int i = 0; i < 4; i++) acc = merge_round64(acc, h->v[i]);
+	}
+	else
+	{
+		acc = h->seed + PRIME64_5;
+	}
+	acc += h->total_len;
+
+	const uint8_t *p = h->mem;
+	const uint8_t *const end = p + h->mem_size;
+	while (p + 8 <= end)
+	{
+		acc ^= round64(0, read64(p));
+		acc = rotl64(acc, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end)
+	{
+		acc ^= (uint64_t)read32(p) * PRIME64_1;
+		acc = rotl64(acc, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	while (p < end)
+	{
+		acc ^= (*p) * PRIME64_5;
+		acc = rotl64(acc, 11) * PRIME64_1;
+		p++;
+	}
+
+	acc ^= acc >> 33;
+	acc *= PRIME64_2;
+	acc ^= acc >> 29;
+	acc *= PRIME64_3;
+	acc ^= acc >> 32;
+	return acc;
+}
+
+uint64_t hash64(const void *data, size_t len, uint64_t seed)
+{
+	Hash64 h;
+	hash64_init(&h, seed);
+	hash64_update(&h, data, len);
+	return hash64_final(&h);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// 64-bit non-cryptographic hashing (XXH64).
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Hash64
+{
+	uint64_t v[4];
+	uint64_t total_len;
+	uint8_t mem[32];
+	uint32_t mem_size;
+	uint64_t seed;
+} Hash64;
+
+void hash64_init(Hash64 *h, uint64_t seed);
+void hash64_update(Hash64 *h, const void *data, size_t len);
+uint64_t hash64_final(const Hash64 *h);
+
+// One-shot helper.
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
@@ -0,0 +1,42 @@
+#include "keymap.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+static bool keymap_zone_covers(const KeymapZone *z, int note)
+{
+	if (z->low < 0 && z->high < 0) return false;
+	if (z->low >= 0 && note < z->low) return false;
+	if (z->high >= 0 && note > z->high) return false;
+	return true;
+}
+
+void keymap_assign(const KeymapZone *zones, int count, int zone_of[KEYMAP_NOTES])
+{
+	for (int note = 0; note < KEYMAP_NOTES; note++)
+	{
+		int best = -1;
+		for (int i = 0; i < count && best < 0; i++)
+		{
+			if (keymap_zone_covers(&zones[i], note)) best = i;
+		}
+		if (best < 0)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				const int dist = abs(zones[i].root - note);
+				const int best_dist = (best < 0) ? KEYMAP_NOTES : abs(zones[best].root - note);
+				if (dist < best_dist || (dist == best_dist && zones[i].root < zones[best].root))
+				{
+					best = i;
+				}
+			}
+		}
+		zone_of[note] = best;
+	}
+}
+
+double keymap_note_rate(uint32_t rate, int root, int note)
+{
+	return rate * pow(2.0, (note - root) / 12.0);
+}
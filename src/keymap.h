@@ -0,0 +1,29 @@
+#pragma once
+
+// Multisample keymaps.
+//
+// An instrument is a set of zones, each a sample recorded at some root note
+// and optionally given a range of notes to cover. Every MIDI note is given
+// to one zone, so that a player can look a note up instead of working out
+// which sample to use and how fast to play it.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define KEYMAP_NOTES 128
+
+typedef struct KeymapZone
+{
+	int root;  // MIDI note the sample plays at its own rate.
+	int low;   // Lowest note it covers; -1 if not given.
+	int high;  // Highest note it covers; -1 if not given.
+} KeymapZone;
+
+// Sets zone_of[note] for every note: the first zone whose range holds it, or
+// failing that, the zone whose root is nearest, the lower one on a tie.
+// Zones with only one end of a range given cover everything past it.
+void keymap_assign(const KeymapZone *zones, int count, int zone_of[KEYMAP_NOTES]);
+
+// The rate that plays a sample recorded at `rate` and note `root` at `note`,
+// in equal temperament.
+double keymap_note_rate(uint32_t rate, int root, int note);
@@ -0,0 +1,94 @@
+#include "lockfile.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Reads a $-prefixed 32-bit hex number at *p, skipping spaces around it.
+static bool lockfile_hex(char **p, unsigned long *value)
+{
+	char *s = *p;
+	while (isspace((unsigned char)*s)) s++;
+	if (*s != '$') return false;
+	char *end;
+	*value = strtoul(s + 1, &end, 16);
+	if (end == s + 1 || *value > UINT32_MAX) return false;
+	while (isspace((unsigned char)*end)) end++;
+	*p = end;
+	return true;
+}
+
+bool lockfile_read(const char *fname, LockfileRecordFn fn, void *user)
+{
+	FILE *f = fopen(fname, "r");
+	if (!f)
+	{
+		if (errno == ENOENT) return true;
+		fprintf(stderr, "[LOCK] Couldn't open %s\n", fname);
+		return false;
+	}
+
+	char line[1024];
+	int line_no = 0;
+	bool ok = true;
+	while (fgets(line, sizeof(line), f))
+	{
+		line_no++;
+		const size_t len = strlen(line);
+		if (len == sizeof(line) - 1 && line[len - 1] != '\n' && !feof(f))
+		{
+			fprintf(stderr, "[LOCK] %s:%d: line too long\n", fname, line_no);
+			ok = false;
+			break;
+		}
+
+		char *p = line;
+		while (isspace((unsigned char)*p)) p++;
+		if (*p == '\0' || *p == ';') continue;
+
+		// SYMBOL $ADDRESS $SIZE, with the symbol unescaped in place.
+		char *symbol = p;
+		char *out = p;
+		while (*p && !isspace((unsigned char)*p))
+		{
+			if (*p == '\\' && p[1] != '\0') p++;
+			*out++ = *p++;
+		}
+		if (*p) p++;
+		*out = '\0';
+		unsigned long address, size;
+		if (!lockfile_hex(&p, &address) || !lockfile_hex(&p, &size) || (*p != '\0' && *p != ';'))
+		{
+			fprintf(stderr, "[LOCK] %s:%d: expected SYMBOL $ADDRESS $SIZE\n", fname, line_no);
+			ok = false;
+			break;
+		}
+		fn(user, symbol, address, size);
+	}
+	if (ferror(f))
+	{
+		fprintf(stderr, "[LOCK] Couldn't read %s\n", fname);
+		ok = false;
+	}
+	fclose(f);
+	return ok;
+}
+
+void lockfile_begin(OutBuf *b)
+{
+	outbuf_printf(b, "; ymztool layout lock: where each entry's data was placed.\n");
+	outbuf_printf(b, "; Entries listed here keep their address while their data still fits.\n");
+	outbuf_printf(b, "; SYMBOL $ADDRESS $SIZE\n");
+}
+
+void lockfile_put(OutBuf *b, const char *symbol, uint32_t address, uint32_t size)
+{
+	for (const char *c = symbol; *c; c++)
+	{
+		if (isspace((unsigned char)*c) || *c == '\\' || *c == ';') outbuf_write(b, "\\", 1);
+		outbuf_write(b, c, 1);
+	}
+	outbuf_printf(b, " $%06X $%06X\n", address, size);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// Layout lock files.
+//
+// A lock file records where each entry's data went in the last build: one
+// line per entry, giving its upper-case symbol, then its address and size in
+// hex. In the symbol, a backslash comes before each space, semicolon or
+// backslash, so that any INI section name reads back whole. Entries found in
+// it can keep their addresses from one build to the next, so that adding,
+// removing or growing a sample leaves the rest of the image alone.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+
+typedef void (*LockfileRecordFn)(void *user, const char *symbol, uint32_t address, uint32_t size);
+
+// Calls `fn` for each record in `fname`. A missing file has no records.
+// Returns false, having said why, if the file can't be read or a line isn't
+// a record.
+bool lockfile_read(const char *fname, LockfileRecordFn fn, void *user);
+
+// Starts a lock file in `b`, to be followed by its records.
+void lockfile_begin(OutBuf *b);
+
+void lockfile_put(OutBuf *b, const char *symbol, uint32_t address, uint32_t size);
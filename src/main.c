@@ -1,16 +1,86 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 #include "3rdparty/inih/ini.h"
 #include "3rdparty/dr_wav/dr_wav.h"
 #include "3rdparty/adpcm/ymz_codec.h"
+#include "alloc.h"
+#include "arena.h"
+#include "bench.h"
+#include "blockdec.h"
+#include "cache.h"
+#include "diff.h"
+#include "elfobj.h"
+#include "hash.h"
+#include "keymap.h"
+#include "lockfile.h"
+#include "mapfile.h"
+#include "outbuf.h"
+#include "pack.h"
+#include "pool.h"
+#include "romset.h"
+#include "segenc.h"
+#include "strtab.h"
+#include "trellis.h"
 #include <ctype.h>
 
 #define YMZ280B_CLOCK_NOMINAL 16934400
 
 #define YMZ_BLOB_ENTRY_SIZE 16
 
+// One .dat record, as described by YMZDAT in player/ymz280b.inc.
+// Addresses are big-endian, 24 bits.
+typedef struct YmzDatRecord
+{
+	uint8_t key;  // also fn8
+	uint8_t fn;
+	uint8_t tl;
+	uint8_t pan;
+	uint8_t start_address[3];
+	uint8_t loop_start_address[3];
+	uint8_t loop_end_address[3];
+	uint8_t end_address[3];
+} YmzDatRecord;
+
+_Static_assert(sizeof(YmzDatRecord) == YMZ_BLOB_ENTRY_SIZE, "YMZDAT record must be 16 bytes");
+
+// One note of a keymap, as described by YMZKEY in player/ymz280b.inc. The
+// record is played with this note's fn register in place of its own.
+typedef struct YmzKeyRecord
+{
+	uint8_t blob_offs[2];  // Big-endian offset of the YMZDAT record in the .dat.
+	uint8_t key;           // As the record's, with this note's fn8.
+	uint8_t fn;
+} YmzKeyRecord;
+
+_Static_assert(sizeof(YmzKeyRecord) == 4, "YMZKEY record must be 4 bytes");
+
+// Entries a YMZKEY record's 16-bit blob offset can reach.
+#define YMZKEY_MAX_ENTRIES (0x10000 / YMZ_BLOB_ENTRY_SIZE)
+
+static void ymzdat_put_address(uint8_t *p, uint32_t address)
+{
+	p[0] = (address>>16) & 0xFF;
+	p[1] = (address>>8) & 0xFF;
+	p[2] = address & 0xFF;
+}
+
+// Frames decoded and encoded per step of the conversion loop.
+#define CONV_CHUNK_FRAMES 65536
+#define CONV_CHUNK_BYTES (CONV_CHUNK_FRAMES * sizeof(int16_t))
+
+// ADPCM entries at least this long are split into segments encoded on all
+// threads, instead of taking up a single lane.
+#define CONV_SPLIT_FRAMES (4 * SEGENC_MIN_SEGMENT)
+
 // TODO: Either merge down to mono, create two separate entries for L and R, or
 //       entirely reject Stereo data. The chip has panning support, but does not
 //       really support stereo data per se.
@@ -25,10 +95,10 @@ typedef enum YmzFmt
 
 typedef struct Info
 {
-	// Conversion params
-	char src[256];           // Source filename.
-	char symbol[256];        // Symbol name as enumerated
-	char symbol_upper[256];
+	// Conversion params. Strings are interned in Conv::strings.
+	const char *src;          // Source filename.
+	const char *symbol;       // Symbol name as enumerated
+	const char *symbol_upper;
 
 	// Source information about the file, unused in Conv context.
 	uint32_t sample_rate;   // Sampling rate.
@@ -42,20 +112,30 @@ typedef struct Info
 
 	// YMZ-specific data
 	YmzFmt fmt;          // Target format setting.
+	int effort;          // ADPCM search effort (see trellis.h).
 	uint32_t clock;      // Clock (in Hz)
 	int tl;
 	int panpot;
 	bool loop;
+	uint32_t rate;       // Playback rate of an alias; 0 keeps its source's.
+
+	// Placement of the data; see alloc.h.
+	uint32_t align;      // A power of two; 0 for none.
+	bool within_bank;    // Keep the data within one bank.
+
+	// Keymap zone. Notes are MIDI note numbers; -1 where not given.
+	const char *instrument;  // Keymap this entry is a zone of; NULL if none.
+	const char *instrument_upper;
+	int root_note;
+	int key_low;
+	int key_high;
 } Info;
 
-typedef struct Entry Entry;
-struct Entry
+typedef struct Entry
 {
-	Entry *next;
-	int id;
+	int id;                 // Index in Conv::entries.
 	Info info;
 
-	uint8_t *data;
 	uint32_t data_bytes;
 	uint32_t length;        // Sample count (per channel)
 	int channels;           // Only accepts 1 or 2.  // TODO: Entirely reject 2
@@ -67,22 +147,81 @@ struct Entry
 
 	uint16_t fn_reg;     // fn reg value to play this back (assuming YMZ clock)
 	int bits_per_sample;
-};
+
+	uint64_t file_offs;  // Where the data lands in the .ymz.
+
+	bool data_offs_set;  // data_offs was given for this entry; don't chain from the previous one.
+	bool ok;             // Conversion succeeded.
+
+	CacheKey cache_key;
+	bool cache_keyed;    // cache_key is valid.
+	bool cache_hit;      // Results came from the cache; the WAV was not opened.
+
+	// Entries converting the same source the same way share one payload.
+	uint64_t src_dev;    // Identity of the source file, if src_ino_set.
+	uint64_t src_ino;
+	bool src_ino_set;
+	int payload_of;      // Entry whose payload this one uses; its own id unless shared.
+
+	// Where the layout lock file had this entry's data.
+	bool locked;
+	uint32_t lock_addr;
+	uint32_t lock_size;
+
+	// An alias plays another entry's data with registers of its own, and is
+	// never converted itself.
+	int alias_of;        // Entry aliased, never itself an alias; -1 if not an alias.
+
+	// Searched ADPCM encodes, for the report.
+	double search_seconds;
+	double search_snr;
+	double greedy_snr;
+} Entry;
 
 typedef struct Conv
 {
-	// Linked list of sprites read
-	Entry *entry_head;  // First in the entries link list.
-	Entry *entry_tail;  // Pointer to the end of the entries list.
+	// Entries in INI order. Only grows while the INI is read; pointers to
+	// entries are good from then on.
+	Entry *entries;
+	int entry_count;
+	int entry_cap;
+
+	StrTab strings;      // Sources and symbols.
+	int *symbol_entry;   // By string id: the entry whose upper-case symbol it is, or -1.
+	uint32_t symbol_entry_cap;
 
 	// Config for an entry
 	char out[256];           // Output base filename.
 	Info info;               // Basic info. Some fields might go unused or ignored.
+	bool data_offs_set;      // data_offs was set since the last entry was added.
+	bool loop_start_set;     // loop_start was, likewise.
+	bool loop_end_set;       // loop_end was, likewise.
+
+	AllocParams alloc;       // How payloads are given addresses.
+	const char *lock_fname;  // Layout lock file; NULL for none.
+	bool compact;            // Lay out afresh, ignoring the lock file.
+	uint32_t ymz_base;       // Address of the .ymz's first byte.
+	RomSetParams roms;       // ROM chips to split the samples across.
+	bool object_m68k;        // Write the blobs as a linkable 68000 object,
+	bool object_host;        // and likewise for the machine ymztool runs on.
+	bool object_ymz;         // Put the .ymz in the objects too.
+
+	char cache_dir[256];     // Conversion cache directory; empty disables the cache.
+	Cache cache;
+	bool cache_enabled;
+
+	bool split_fast;         // Let split entries skip all but one fix-up round.
+	bool stream;             // Never hold a whole source in memory to split it.
+	bool arena_stats;        // Report arena usage once converted.
+	bool pack;               // Let payloads that start longer ones share their storage.
+
+	// Entries, and everything conversion allocates, for the whole run.
+	Arena arena;
 } Conv;
 
 bool conv_validate(const Conv *s)
 {
-	if (s->info.symbol[0] == '\0')
+	if (!s->info.symbol || s->info.symbol[0] == '\0')
 	{
 		fprintf(stderr, "[CONV] symbol not set!\n");
 		return false;
@@ -110,40 +249,276 @@ bool conv_validate(const Conv *s)
 	return true;
 }
 
-static bool conv_entry_add(Conv *s)
+// Copies `str` in upper case into `buf`, or into a new allocation if it
+// doesn't fit; free the result if it isn't `buf`. Returns NULL if out of memory.
+static char *conv_upper(const char *str, char *buf, size_t size)
+{
+	const size_t len = strlen(str);
+	char *upper = len < size ? buf : malloc(len + 1);
+	if (!upper) return NULL;
+	for (size_t i = 0; i <= len; i++) upper[i] = toupper((unsigned char)str[i]);
+	return upper;
+}
+
+// Finds the entry for a symbol, in any case; NULL if there is none.
+static Entry *conv_entry_find(const Conv *s, const char *symbol)
+{
+	char buf[256];
+	char *upper = conv_upper(symbol, buf, sizeof(buf));
+	if (!upper) return NULL;
+	const uint32_t id = strtab_find(&s->strings, upper);
+	if (upper != buf) free(upper);
+
+	if (id == STRTAB_NONE || id >= s->symbol_entry_cap || s->symbol_entry[id] < 0) return NULL;
+	return &s->entries[s->symbol_entry[id]];
+}
+
+// Records an entry using the current INI state. No audio is touched here; the
+// WAV is loaded and encoded later by conv_entry_convert(). With `alias_of` set
+// to an entry's id, the new entry is an alias of it instead.
+static bool conv_entry_add(Conv *s, int alias_of)
 {
 	if (!conv_validate(s)) return false;
 
-	Entry *e = NULL;
+	if (alias_of < 0 && s->info.rate != 0)
+	{
+		fprintf(stderr, "[CONV] \"%s\": rate only applies to aliases\n", s->info.symbol);
+		return false;
+	}
+	if (!s->info.instrument && (s->info.root_note >= 0 || s->info.key_low >= 0 || s->info.key_high >= 0))
+	{
+		fprintf(stderr, "[CONV] \"%s\": root_note and key ranges need an instrument\n", s->info.symbol);
+		return false;
+	}
+	if (s->info.instrument && s->info.root_note < 0)
+	{
+		fprintf(stderr, "[CONV] \"%s\": instrument needs a root_note\n", s->info.symbol);
+		return false;
+	}
+	if (s->info.key_low >= 0 && s->info.key_high >= 0 && s->info.key_low > s->info.key_high)
+	{
+		fprintf(stderr, "[CONV] \"%s\": key_low is above key_high\n", s->info.symbol);
+		return false;
+	}
+	if (alias_of >= 0 && s->data_offs_set)
+	{
+		fprintf(stderr, "[CONV] \"%s\": an alias can't have a data_offs\n", s->info.symbol);
+		return false;
+	}
+
+	// The .inc and .h name entries by upper-case symbol, so those must differ.
+	const Entry *dup = conv_entry_find(s, s->info.symbol);
+	if (dup)
+	{
+		fprintf(stderr, "[CONV] Symbol \"%s\" is already used by entry $%03X \"%s\"\n",
+		        s->info.symbol, dup->id, dup->info.symbol);
+		return false;
+	}
 
-	// If this is the first one, create the head
-	if (!s->entry_head)
+	if (s->entry_count == s->entry_cap)
 	{
-		s->entry_head = calloc(sizeof(*e), 1);
-		s->entry_head->id = 0;
-		e = s->entry_head;
-		s->entry_tail = s->entry_head;
+		const int cap = s->entry_cap ? s->entry_cap * 2 : 64;
+		Entry *entries = realloc(s->entries, sizeof(*entries) * cap);
+		if (!entries)
+		{
+			fprintf(stderr, "[CONV] Couldn't allocate entry\n");
+			return false;
+		}
+		s->entries = entries;
+		s->entry_cap = cap;
 	}
-	else
+
+	// Index the entry by its upper-case symbol.
+	const uint32_t sym = strtab_find(&s->strings, s->info.symbol_upper);
+	if (sym >= s->symbol_entry_cap)
 	{
-		e = calloc(sizeof(*e), 1);
-		e->id = s->entry_tail->id + 1;
-		s->entry_tail->next = e;
-		s->entry_tail = e;
+		const uint32_t cap = s->strings.cap;
+		int *symbol_entry = realloc(s->symbol_entry, sizeof(*symbol_entry) * cap);
+		if (!symbol_entry)
+		{
+			fprintf(stderr, "[CONV] Couldn't allocate entry\n");
+			return false;
+		}
+		for (uint32_t i = s->symbol_entry_cap; i < cap; i++) symbol_entry[i] = -1;
+		s->symbol_entry = symbol_entry;
+		s->symbol_entry_cap = cap;
 	}
 
+	Entry *e = &s->entries[s->entry_count];
+	memset(e, 0, sizeof(*e));
+	e->id = s->entry_count++;
+	e->payload_of = e->id;
+	s->symbol_entry[sym] = e->id;
+
 	// Start by adopting whatever properties have been set by the INI.
 	e->info = s->info;
+	e->data_offs_set = s->data_offs_set;
+	e->alias_of = alias_of;
+	if (alias_of >= 0)
+	{
+		// Loop points not given for the alias are its target's, once known.
+		e->info.src = s->entries[alias_of].info.src;
+		if (!s->loop_start_set) e->info.loop_start_pos = -1;
+		if (!s->loop_end_set) e->info.loop_end_pos = -1;
+	}
+	s->data_offs_set = false;
+	s->loop_start_set = false;
+	s->loop_end_set = false;
+	s->info.rate = 0;
+	s->info.instrument = NULL;
+	s->info.instrument_upper = NULL;
+	s->info.root_note = -1;
+	s->info.key_low = -1;
+	s->info.key_high = -1;
+
+	return true;
+}
+
+// Records an alias of the entry for `symbol`, which must come before it.
+static bool conv_alias_add(Conv *s, const char *symbol)
+{
+	const Entry *target = conv_entry_find(s, symbol);
+	if (!target)
+	{
+		fprintf(stderr, "[CONV] \"%s\": no entry \"%s\" before it to alias\n", s->info.symbol, symbol);
+		return false;
+	}
+	if (target->alias_of >= 0) target = &s->entries[target->alias_of];
+	return conv_entry_add(s, target->id);
+}
+
+// Parameters besides the source bytes that affect conversion results.
+typedef struct ConvCacheParams
+{
+	uint32_t fmt;
+	uint32_t clock;
+	int32_t loop_start_pos;  // As given in the INI; smpl loops come from the source bytes.
+	int32_t loop_end_pos;
+	int32_t effort;
+} ConvCacheParams;
+
+static bool conv_entry_cache_key(const Entry *e, CacheKey *key)
+{
+	ConvCacheParams params;
+	memset(&params, 0, sizeof(params));
+	params.fmt = e->info.fmt;
+	params.clock = e->info.clock;
+	params.loop_start_pos = e->info.loop_start_pos;
+	params.loop_end_pos = e->info.loop_end_pos;
+	params.effort = (e->info.fmt == FMT_ADPCM) ? e->info.effort : TRELLIS_EFFORT_GREEDY;
+	return cache_key_for_file(e->info.src, &params, sizeof(params), key);
+}
+
+static void conv_entry_from_record(Entry *e, const CacheRecord *rec)
+{
+	e->info.sample_rate = rec->sample_rate;
+	e->length = rec->length;
+	e->channels = rec->channels;
+	e->info.loop_start_pos = rec->loop_start_pos;
+	e->info.loop_end_pos = rec->loop_end_pos;
+	e->bits_per_sample = rec->bits_per_sample;
+	e->data_bytes = rec->data_bytes;
+	e->fn_reg = rec->fn_reg;
+}
+
+static void conv_entry_to_record(const Entry *e, CacheRecord *rec)
+{
+	memset(rec, 0, sizeof(*rec));
+	rec->sample_rate = e->info.sample_rate;
+	rec->length = e->length;
+	rec->channels = e->channels;
+	rec->loop_start_pos = e->info.loop_start_pos;
+	rec->loop_end_pos = e->info.loop_end_pos;
+	rec->bits_per_sample = e->bits_per_sample;
+	rec->data_bytes = e->data_bytes;
+	rec->fn_reg = e->fn_reg;
+}
+
+// dr_wav allocates from the arena of whichever thread opened the WAV; nothing
+// is freed before the arena is.
+static void *conv_wav_malloc(size_t size, void *user)
+{
+	return arena_alloc((Arena *)user, size);
+}
+
+static void conv_wav_free(void *p, void *user)
+{
+	(void)p;
+	(void)user;
+}
+
+static drwav_allocation_callbacks conv_wav_allocator(Arena *arena)
+{
+	drwav_allocation_callbacks cb;
+	cb.pUserData = arena;
+	cb.onMalloc = conv_wav_malloc;
+	cb.onRealloc = NULL;  // dr_wav falls back on malloc, copy and free.
+	cb.onFree = conv_wav_free;
+	return cb;
+}
+
+// Calculate fn reg value based on clock.
+// FN controls how many 192 cycle steps to process before proceeding to the next sample.
+// ADPCM needs two steps to decode, so it has a more limited range.
+//
+// 4-bit ADPCM: 0.172265626KHz to 44.100KHz
+// 8-bit APDCM: 0.172265626KHz to 88.200KHz
+//
+static uint32_t conv_fn_reg(const Entry *e, uint32_t rate)
+{
+	const float base_freq = (e->info.fmt == FMT_ADPCM) ? 44100 : 88200;
+	const float adjusted_freq = (base_freq * e->info.clock) / (float)YMZ280B_CLOCK_NOMINAL;
+	const int steps = (e->info.fmt == FMT_ADPCM) ? 256 : 512;
+	return (uint32_t)(((steps-1) * rate) / adjusted_freq);
+}
+
+static void conv_entry_set_fn_reg(Entry *e)
+{
+	e->fn_reg = conv_fn_reg(e, e->info.sample_rate);
+}
+
+// The YMZDAT key byte for playing `e` with fn register `fn_reg`.
+static uint8_t conv_entry_key(const Entry *e, uint16_t fn_reg)
+{
+	return 0x80 | (e->info.loop ? 0x10 : 0x00) | (fn_reg>>8) | (e->info.fmt << 5);  // key on, mode bits, loop not set, high fn bit
+}
 
-	//
-	// Load WAV data into buffer as raw PCM and pull basic data
-	//
+// Fills in everything about an entry that can be known without decoding any
+// audio: sizes, loop points and the fn register. Only touches the entry
+// itself, so it is safe to run for several entries at once. dr_wav allocates
+// from `arena`.
+static bool conv_entry_probe(Conv *s, Entry *e, Arena *arena)
+{
+#ifndef _WIN32
+	// Tells apart sources reached by different paths, for sharing payloads.
+	struct stat st;
+	if (stat(e->info.src, &st) == 0)
+	{
+		e->src_dev = st.st_dev;
+		e->src_ino = st.st_ino;
+		e->src_ino_set = true;
+	}
+#endif
+
+	if (s->cache_enabled && conv_entry_cache_key(e, &e->cache_key))
+	{
+		e->cache_keyed = true;
+		CacheRecord rec;
+		if (cache_lookup(&s->cache, &e->cache_key, &rec))
+		{
+			conv_entry_from_record(e, &rec);
+			e->cache_hit = true;
+			return true;
+		}
+	}
+
+	// Pull basic data from the WAV header.
 	const char *fname = e->info.src;
 	drwav wav;
-	if (!drwav_init_file(&wav, fname, NULL))
+	const drwav_allocation_callbacks allocator = conv_wav_allocator(arena);
+	if (!drwav_init_file(&wav, fname, &allocator))
 	{
 		fprintf(stderr, "[CONV] Couldn't load \"%s\"\n", fname);
-		drwav_uninit(&wav);
 		return false;
 	}
 	if (wav.channels > 2 || wav.channels < 1)
@@ -152,23 +527,11 @@ static bool conv_entry_add(Conv *s)
 		drwav_uninit(&wav);
 		return false;
 	}
-
-	// Load data as 16-bit PCM.
-	const int src_pcm_buffer_size = wav.totalPCMFrameCount * wav.channels * sizeof(int16_t);
-	int16_t *srcpcm = malloc(src_pcm_buffer_size);
-	if (!srcpcm)
-	{
-		fprintf(stderr, "[CONV] Couldn't allocate %d frames of buffer\n",
-		        src_pcm_buffer_size);
-		drwav_uninit(&wav);
-		return false;
-	}
-
-	if (!drwav_read_pcm_frames_s16(&wav, wav.totalPCMFrameCount, srcpcm))
+	if (wav.totalPCMFrameCount > UINT32_MAX)
 	{
-		fprintf(stderr, "[CONV] Failed to read PCM frames.\n");
+		fprintf(stderr, "[CONV] \"%s\" is too long (%llu frames)\n", fname,
+		        (unsigned long long)wav.totalPCMFrameCount);
 		drwav_uninit(&wav);
-		free(srcpcm);
 		return false;
 	}
 
@@ -177,8 +540,6 @@ static bool conv_entry_add(Conv *s)
 	e->length = wav.totalPCMFrameCount;
 	e->channels = wav.channels;
 
-	printf("wav rate $%d, pcm frames %d\n", e->info.sample_rate, e->length);
-
 	// YMZ-specific data is either set from the INI or calculated later.
 	// Playback information
 	const bool has_smpl_loop = wav.smpl.numSampleLoops > 0;
@@ -191,7 +552,7 @@ static bool conv_entry_add(Conv *s)
 	if (e->info.loop_start_pos <= 0) e->info.loop_start_pos = 0;
 	if (e->info.loop_end_pos <= 0) e->info.loop_end_pos = e->length;
 
-	// Done with the WAV file now.
+	// Done with the WAV file for now.
 	drwav_uninit(&wav);
 
 	// TODO: Handle more gracefully in the future.
@@ -218,346 +579,2116 @@ static bool conv_entry_add(Conv *s)
 			break;
 	}
 
-	e->data_bytes = (e->bits_per_sample * e->length) / 8;
-	printf("$%03X %s: %d samples * %d channels @ fmt %d --> %d bits per sample; total %d ($%X) bytes\n",
-	       e->id, e->info.symbol_upper,
-	       e->length, e->channels, e->info.fmt, e->bits_per_sample, e->data_bytes, e->data_bytes);
-
-	e->data = malloc(e->data_bytes);
-	if (!e->data)
+	const uint64_t data_bytes = ((uint64_t)e->bits_per_sample * e->length) / 8;
+	if (data_bytes > UINT32_MAX)
 	{
-		fprintf(stderr, "[CONV] Couldn't allocate %d frames of output buffer\n",
-		        e->data_bytes);
-		free(srcpcm);
+		fprintf(stderr, "[CONV] \"%s\" needs %llu bytes of sample data\n", fname,
+		        (unsigned long long)data_bytes);
 		return false;
 	}
-
-	// Calculate addresses. Start and end points are specified not by sample
-	// index but by address.
-	e->start_address = e->info.data_offs;
-	e->end_address = e->start_address + e->data_bytes;
-
-	e->loop_start_address = e->start_address + (e->bits_per_sample * e->info.loop_start_pos) / 8;
-	e->loop_end_address =  e->info.data_offs + (e->bits_per_sample * e->info.loop_end_pos) / 8;
-	printf("  sample count:       %d ($%06X)\n", e->length, e->length);
-	printf("  loop start pos:     %d ($%06X)\n", e->info.loop_start_pos, e->info.loop_start_pos);
-	printf("  loop end pos:       %d ($%06X)\n", e->info.loop_end_pos, e->info.loop_end_pos);
-	printf("  start address:      %d ($%06X)\n", e->start_address, e->start_address);
-	printf("  end address:        %d ($%06X)\n", e->end_address, e->end_address);
-	printf("  loop start address: %d ($%06X)\n", e->loop_start_address, e->loop_start_address);
-	printf("  loop end address:   %d ($%06X)\n", e->loop_end_address, e->loop_end_address);
-
-	// Copy data.
-	switch (e->info.fmt)
-	{
-		default:
-			fprintf(stderr, "[CONV] Format NG!\n");
-			return false;
-		case FMT_ADPCM:
-			ymz_encode(srcpcm, e->data, e->length);
-			break;
-		case FMT_PCM8:
-			// Shift down to 8-bit.
-			for (uint32_t i = 0; i < e->channels * e->length; i++)
-			{
-				e->data[i] = srcpcm[i] >> 8;
-			}
-			break;
-		case FMT_PCM16:
-			// Copy as-is.
-			memcpy(e->data, srcpcm, e->data_bytes);
-			break;
-	}
-	free(srcpcm);
-
-	// Calculate fn reg value based on clock.
-	// FN controls how many 192 cycle steps to process before proceeding to the next sample.
-	// ADPCM needs two steps to decode, so it has a more limited range.
-	//
-	// 4-bit ADPCM: 0.172265626KHz to 44.100KHz
-	// 8-bit APDCM: 0.172265626KHz to 88.200KHz
-	//
-	const float base_freq = (e->info.fmt == FMT_ADPCM) ? 44100 : 88200;
-	const float adjusted_freq = (base_freq * e->info.clock) / (float)YMZ280B_CLOCK_NOMINAL;
-	printf("Base freq @ %fHz = %fHz\n", base_freq, adjusted_freq);
-	const int steps = (e->info.fmt == FMT_ADPCM) ? 256 : 512;
-	printf("  fmt %d : fn %d steps\n", e->info.fmt, steps);
-	e->fn_reg = (uint16_t)(((steps-1) * e->info.sample_rate) / adjusted_freq);
-	printf("  src freq %dHz = fn $%03X\n", e->info.sample_rate, e->fn_reg);
-
-	// Advance data block position for next file.
-	s->info.data_offs += e->data_bytes;
+	e->data_bytes = data_bytes;
+	conv_entry_set_fn_reg(e);
 
 	return true;
 }
 
-static void conv_shutdown(Conv *s)
+// Fills in an alias from the entry it aliases, once that has been probed.
+static void conv_alias_resolve(Conv *s, Entry *e)
 {
-	Entry *e = s->entry_head;
-	while (e)
+	const Entry *target = &s->entries[e->alias_of];
+	e->ok = target->ok;
+	e->info.fmt = target->info.fmt;
+	e->info.effort = target->info.effort;
+	e->info.sample_rate = e->info.rate ? e->info.rate : target->info.sample_rate;
+	e->length = target->length;
+	e->channels = target->channels;
+	e->bits_per_sample = target->bits_per_sample;
+	e->data_bytes = target->data_bytes;
+
+	if (!e->ok)
 	{
-		if (e->data) free(e->data);
-		Entry *next = e->next;
-		free(e);
-		e = next;
+		e->info.loop_start_pos = 0;
+		e->info.loop_end_pos = 0;
+		return;
 	}
+	if (e->info.loop_start_pos < 0) e->info.loop_start_pos = target->info.loop_start_pos;
+	if (e->info.loop_end_pos < 0) e->info.loop_end_pos = target->info.loop_end_pos;
+	else if (e->info.loop_end_pos == 0) e->info.loop_end_pos = e->length;
+	conv_entry_set_fn_reg(e);
 }
 
-
 //
-// Configuration parsing
+// Encoded data output
 //
 
-static int handler(void *user, const char *section, const char *name, const char *value)
+// Writes all of `len` bytes at `offs`, independent of the file position.
+static bool file_write_at(int fd, const void *data, size_t len, uint64_t offs)
 {
-	Conv *s = (Conv *)user;
-
-	// New section - copy in name
-	if (strcmp(section, s->info.symbol) != 0)
+	const uint8_t *p = (const uint8_t *)data;
+#ifdef _WIN32
+	// No pwrite(); serialize seek + write instead.
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	pthread_mutex_lock(&lock);
+	bool ok = _lseeki64(fd, offs, SEEK_SET) == (__int64)offs;
+	while (ok && len > 0)
 	{
-		memset(s->info.symbol, 0, sizeof(s->info.symbol));
-		strncpy(s->info.symbol, section, sizeof(s->info.symbol));
-		s->info.symbol[sizeof(s->info.symbol)-1] = '\0';
-		memset(s->info.symbol_upper, 0, sizeof(s->info.symbol_upper));
-		for (int i = 0; i < strlen(s->info.symbol); i++)
-		{
-			s->info.symbol_upper[i] = toupper(s->info.symbol[i]);
-		}
+		const int wrote = write(fd, p, len);
+		if (wrote <= 0) ok = false;
+		else { p += wrote; len -= wrote; }
+	}
+	pthread_mutex_unlock(&lock);
+	return ok;
+#else
+	while (len > 0)
+	{
+		const ssize_t wrote = pwrite(fd, p, len, offs);
+		if (wrote < 0 && errno == EINTR) continue;
+		if (wrote <= 0) return false;
+		p += wrote;
+		len -= wrote;
+		offs += wrote;
 	}
+	return true;
+#endif
+}
 
-	// Setting the source is what kicks it off
-	if (strcmp("src", name) == 0)
+// Writes `len` zeros at `offs`.
+static bool file_zero_at(int fd, uint64_t len, uint64_t offs)
+{
+	static const uint8_t zero[CONV_CHUNK_BYTES];
+	for (uint64_t done = 0; done < len; done += sizeof(zero))
 	{
-		strncpy(s->info.src, value, sizeof(s->info.src));
-		s->info.src[sizeof(s->info.src)-1] = '\0';
-		if (!conv_entry_add(s)) return 0;
+		const size_t n = (len - done < sizeof(zero)) ? len - done : sizeof(zero);
+		if (!file_write_at(fd, zero, n, offs + done)) return false;
 	}
-	else if (strcmp("out", name) == 0)
+	return true;
+}
+
+// Sizes a file to `len` bytes and, where the system allows, reserves its
+// blocks, so a full disk shows up here rather than halfway through a write.
+static bool file_preallocate(int fd, uint64_t len)
+{
+	if (ftruncate(fd, len) != 0) return false;
+#ifdef __linux__
+	if (len > 0 && posix_fallocate(fd, 0, len) == ENOSPC) return false;
+#endif
+	return true;
+}
+
+// Destination for one entry's encoded bytes: its slot in the .ymz.
+// Optionally mirrored into the cache.
+typedef struct ConvSink
+{
+	int fd;
+	uint64_t file_offs;
+	uint32_t capacity;
+	uint32_t written;
+	CacheWriter *cache;
+} ConvSink;
+
+static bool conv_sink_write(ConvSink *sink, const uint8_t *data, uint32_t len)
+{
+	if (len > sink->capacity - sink->written)
 	{
-		strncpy(s->out, value, sizeof(s->out));
-		s->out[sizeof(s->out)-1] = '\0';
+		fprintf(stderr, "[CONV] Encoded data overran its reserved %u bytes\n", sink->capacity);
+		return false;
 	}
-	else if (strcmp("format", name) == 0)
+	if (!file_write_at(sink->fd, data, len, sink->file_offs + sink->written))
 	{
-		if (strcmp("adpcm", value) == 0) s->info.fmt = FMT_ADPCM;
-		else if (strcmp("pcm8", value) == 0) s->info.fmt = FMT_PCM8;
-		else if (strcmp("pcm16", value) == 0) s->info.fmt = FMT_PCM16;
+		fprintf(stderr, "[CONV] Couldn't write sample data\n");
+		return false;
 	}
-	else if (strcmp("loop_start", name) == 0)
+	if (sink->cache) cache_writer_write(sink->cache, data, len);
+	sink->written += len;
+	return true;
+}
+
+// Copies a cached payload into the sink a chunk at a time.
+static bool conv_entry_copy_cached(Conv *s, const Entry *e, ConvSink *sink)
+{
+	CacheRecord rec;
+	FILE *f = cache_open_payload(&s->cache, &e->cache_key, &rec);
+	if (!f) return false;
+
+	bool ok = rec.data_bytes == e->data_bytes;
+	uint8_t buf[CONV_CHUNK_BYTES];
+	uint32_t remaining = e->data_bytes;
+	while (ok && remaining > 0)
 	{
-		s->info.loop_start_pos = strtoul(value, NULL, 0);
+		const uint32_t n = remaining < sizeof(buf) ? remaining : sizeof(buf);
+		ok = fread(buf, 1, n, f) == n && conv_sink_write(sink, buf, n);
+		remaining -= n;
 	}
-	else if (strcmp("loop_end", name) == 0)
+	fclose(f);
+	return ok;
+}
+
+//
+// PCM8 straight from the source samples
+//
+
+// Turns `frames` samples, as read into the start of `buf`, into PCM8 in place.
+// Each gives the same result as converting to 16 bits with dr_wav and
+// keeping the top byte.
+typedef void (*ConvNarrow)(uint8_t *buf, uint32_t frames);
+
+static void conv_narrow_u8(uint8_t *buf, uint32_t frames)
+{
+	for (uint32_t i = 0; i < frames; i++) buf[i] ^= 0x80;
+}
+
+static void conv_narrow_s16(uint8_t *buf, uint32_t frames)
+{
+	for (uint32_t i = 0; i < frames; i++)
 	{
-		s->info.loop_end_pos = strtoul(value, NULL, 0);
+		int16_t x;
+		memcpy(&x, buf + i * 2, sizeof(x));
+		buf[i] = (uint8_t)(x >> 8);
 	}
-	else if (strcmp("data_offs", name) == 0)
+}
+
+static void conv_narrow_s24(uint8_t *buf, uint32_t frames)
+{
+	// Little-endian, as dr_wav leaves it.
+	for (uint32_t i = 0; i < frames; i++) buf[i] = buf[i * 3 + 2];
+}
+
+static void conv_narrow_s32(uint8_t *buf, uint32_t frames)
+{
+	for (uint32_t i = 0; i < frames; i++)
 	{
-		s->info.data_offs = strtoul(value, NULL, 0);
+		int32_t x;
+		memcpy(&x, buf + i * 4, sizeof(x));
+		buf[i] = (uint8_t)(x >> 24);
 	}
-	else if (strcmp("clock", name) == 0)
+}
+
+// The float conversions follow drwav_f32_to_s16() and drwav_f64_to_s16() up
+// to the truncation to an integer, then take the top byte of that.
+static void conv_narrow_f32(uint8_t *buf, uint32_t frames)
+{
+	for (uint32_t i = 0; i < frames; i++)
 	{
-		s->info.clock = strtoul(value, NULL, 0);
+		float x;
+		memcpy(&x, buf + i * 4, sizeof(x));
+		const float c = ((x < -1) ? -1 : ((x > 1) ? 1 : x)) + 1;
+		buf[i] = (uint8_t)((int16_t)((int)(c * 32767.5f) - 32768) >> 8);
 	}
-	else if (strcmp("tl", name) == 0)
+}
+
+static void conv_narrow_f64(uint8_t *buf, uint32_t frames)
+{
+	for (uint32_t i = 0; i < frames; i++)
 	{
-		s->info.tl = strtoul(value, NULL, 0);
+		double x;
+		memcpy(&x, buf + i * 8, sizeof(x));
+		const double c = ((x < -1) ? -1 : ((x > 1) ? 1 : x)) + 1;
+		buf[i] = (uint8_t)((int16_t)((int)(c * 32767.5) - 32768) >> 8);
 	}
-	else if (strcmp("panpot", name) == 0)
+}
+
+// Picks the narrowing for a source read as raw samples, or NULL if the
+// source has to go through dr_wav's 16-bit conversion first.
+static ConvNarrow conv_narrow_raw(drwav *wav)
+{
+	if (drwav_get_bytes_per_pcm_frame(wav) * 8 != wav->bitsPerSample * wav->channels) return NULL;
+	if (wav->translatedFormatTag == DR_WAVE_FORMAT_PCM)
 	{
-		s->info.panpot = strtoul(value, NULL, 0);
+		switch (wav->bitsPerSample)
+		{
+			case 8: return conv_narrow_u8;
+			case 16: return conv_narrow_s16;
+			case 24: return conv_narrow_s24;
+			case 32: return conv_narrow_s32;
+		}
 	}
-	else if (strcmp("loop", name) == 0)
+	else if (wav->translatedFormatTag == DR_WAVE_FORMAT_IEEE_FLOAT)
 	{
-		s->info.loop = strtoul(value, NULL, 0) ? true : false;
+		switch (wav->bitsPerSample)
+		{
+			case 32: return conv_narrow_f32;
+			case 64: return conv_narrow_f64;
+		}
 	}
+	return NULL;
+}
 
-	return 1;
+// One entry being decoded and encoded, CONV_CHUNK_FRAMES at a time, so memory
+// use does not grow with the length of the source.
+typedef struct ConvLane
+{
+	Entry *e;
+	ConvSink sink;
+	CacheWriter cache_writer;
+	drwav wav;
+	bool wav_open;
+	bool short_read;
+	bool ok;
+	uint32_t remaining;  // Frames left to encode.
+	MapFile map;         // The source, if it could be mapped.
+	const int16_t *direct;    // 16-bit mono source samples in the mapping, if usable as is.
+	uint32_t direct_frames;   // Frames actually present at `direct`.
+	const int16_t *pcm;  // ADPCM: the chunk conv_lane_read() just read.
+	int16_t *srcpcm;     // ADPCM only; PCM targets are converted in outbuf.
+	uint8_t *outbuf;
+	ConvNarrow narrow;   // PCM8: converts raw source samples, if set.
+	ymz_encoder adpcm;   // ADPCM state carries over from one chunk to the next.
+	Arena *arena;        // Buffers and dr_wav's allocations; the lane's thread's own.
+} ConvLane;
+
+// Opens a source WAV, mapped into memory where possible, otherwise through
+// stdio. Close with conv_wav_close().
+static bool conv_wav_open(drwav *wav, MapFile *map, const char *fname, Arena *arena)
+{
+	const drwav_allocation_callbacks allocator = conv_wav_allocator(arena);
+	if (mapfile_open(map, fname))
+	{
+		if (drwav_init_memory(wav, map->data, map->size, &allocator)) return true;
+		mapfile_close(map);
+		return false;
+	}
+	return drwav_init_file(wav, fname, &allocator);
 }
 
-static void conv_init(Conv *conv)
+static void conv_wav_close(drwav *wav, MapFile *map)
 {
-	memset(conv, 0, sizeof(*conv));
-	conv->info.clock = YMZ280B_CLOCK_NOMINAL;
-	conv->info.fmt = FMT_ADPCM;
-	conv->info.tl = 0xFF;
-	conv->info.panpot = 0x08;
-	conv->info.loop = false;
+	drwav_uninit(wav);
+	mapfile_close(map);
 }
 
-int main(int argc, char **argv)
+// Finds a mapped source's samples if they are exactly what the ADPCM encoder
+// takes: 16-bit mono in host order, suitably aligned. Sets `frames` to how
+// many are actually in the file.
+static const int16_t *conv_wav_direct(const drwav *wav, const MapFile *map, uint32_t *frames)
 {
-	int ret = -1;
-	if (argc < 2)
+	const uint16_t probe = 1;
+	const bool little_endian = *(const uint8_t *)&probe == 1;
+	if (!map->data || !little_endian) return NULL;
+	if (wav->translatedFormatTag != DR_WAVE_FORMAT_PCM || wav->bitsPerSample != 16 ||
+	    wav->channels != 1)
 	{
-		printf("Usage: %s CONFIG\n", argv[0]);
-		return -1;
+		return NULL;
 	}
+	const uint64_t pos = wav->dataChunkDataPos;
+	if (pos % sizeof(int16_t) != 0 || pos > map->size) return NULL;
 
-	Conv conv;
-	conv_init(&conv);
-
-	// the actual conversion is kicked off in the INI handler, when `convert` is set.
-	ret = ini_parse(argv[1], &handler, &conv);
-	// TODO: handle INI parser error
+	uint64_t avail = (map->size - pos) / sizeof(int16_t);
+	if (avail > wav->totalPCMFrameCount) avail = wav->totalPCMFrameCount;
+	*frames = avail < UINT32_MAX ? avail : UINT32_MAX;
+	return (const int16_t *)((const uint8_t *)map->data + pos);
+}
 
-	// Now emit a pile of CHR data
-	char fname_buf[512];
+// Prepares a lane for an entry. Entries served from the cache are finished
+// here; everything else has its WAV opened, ready for conv_lanes_encode().
+// The lane's buffers come from `arena`, which has to outlive it.
+static void conv_lane_begin(Conv *s, ConvLane *lane, Entry *e, int ymz_fd, Arena *arena)
+{
+	memset(lane, 0, sizeof(*lane));
+	lane->e = e;
+	lane->ok = true;
+	lane->arena = arena;
 
-	FILE *f_hdr = NULL;
-	FILE *f_inc = NULL;
-	FILE *f_dat = NULL;
-	FILE *f_ymz = NULL;
+	ConvSink *sink = &lane->sink;
+	sink->fd = ymz_fd;
+	sink->file_offs = e->file_offs;
+	sink->capacity = e->data_bytes;
 
-	// YMZ binary data
-	snprintf(fname_buf, sizeof(fname_buf), "%s.ymz", conv.out);
-	f_ymz = fopen(fname_buf, "wb");
-	if (!f_ymz)
+	if (e->cache_hit)
 	{
-		fprintf(stderr, "Couldn't open %s for writing\n", fname_buf);
-		ret = -1;
-		goto done;
+		if (conv_entry_copy_cached(s, e, sink)) return;
+		// The cache entry went away or was damaged since it was probed.
+		sink->written = 0;
 	}
 
-	// DAT
-	snprintf(fname_buf, sizeof(fname_buf), "%s.dat", conv.out);
-	f_dat = fopen(fname_buf, "wb");
-	if (!f_dat)
+	const char *fname = e->info.src;
+	if (!conv_wav_open(&lane->wav, &lane->map, fname, arena))
 	{
-		fprintf(stderr, "Couldn't open %s for writing\n", fname_buf);
-		ret = -1;
-		goto done;
+		fprintf(stderr, "[CONV] Couldn't load \"%s\"\n", fname);
+		lane->ok = false;
+		return;
 	}
+	lane->wav_open = true;
 
-	// INC assembly header
-	snprintf(fname_buf, sizeof(fname_buf), "%s.inc", conv.out);
-	f_inc = fopen(fname_buf, "wb");
-	if (!f_inc)
+	// PCM targets are read straight into the output buffer, which then has to
+	// hold a chunk of raw source samples.
+	size_t out_frame_bytes = sizeof(int16_t);
+	if (e->info.fmt == FMT_ADPCM)
 	{
-		fprintf(stderr, "Couldn't open %s for writing\n", fname_buf);
-		ret = -1;
-		goto done;
+		// The encoder can read a plain 16-bit source where it is mapped.
+		lane->direct = conv_wav_direct(&lane->wav, &lane->map, &lane->direct_frames);
+		if (!lane->direct) lane->srcpcm = arena_alloc(arena, CONV_CHUNK_FRAMES * sizeof(int16_t));
 	}
-
-	// H C header
-	snprintf(fname_buf, sizeof(fname_buf), "%s.h", conv.out);
-	f_hdr = fopen(fname_buf, "wb");
-	if (!f_hdr)
+	else if (e->info.fmt == FMT_PCM8)
 	{
-		fprintf(stderr, "Couldn't open %s for writing\n", fname_buf);
-		ret = -1;
-		goto done;
+		lane->narrow = conv_narrow_raw(&lane->wav);
+		if (lane->narrow && drwav_get_bytes_per_pcm_frame(&lane->wav) > out_frame_bytes)
+		{
+			out_frame_bytes = drwav_get_bytes_per_pcm_frame(&lane->wav);
+		}
 	}
+	lane->outbuf = arena_alloc(arena, CONV_CHUNK_FRAMES * out_frame_bytes);
+	if ((e->info.fmt == FMT_ADPCM && !lane->direct && !lane->srcpcm) || !lane->outbuf)
+	{
+		fprintf(stderr, "[CONV] Couldn't allocate conversion buffers\n");
+		lane->ok = false;
+		return;
+	}
+
+	ymz_encoder_init(&lane->adpcm);
+	lane->remaining = e->length;
+
+	if (e->cache_keyed && !e->cache_hit &&
+	    cache_writer_begin(&lane->cache_writer, &s->cache, &e->cache_key))
+	{
+		sink->cache = &lane->cache_writer;
+	}
+}
+
+// Lets go of the part of a mapped source that has been read, so a long source
+// doesn't stay resident as it streams through.
+static void conv_lane_release(ConvLane *lane)
+{
+	if (!lane->map.data) return;
+	if (lane->direct)
+	{
+		const uint32_t pos = lane->e->length - lane->remaining;
+		mapfile_release(&lane->map, lane->wav.dataChunkDataPos + (uint64_t)pos * sizeof(int16_t));
+	}
+	else
+	{
+		mapfile_release(&lane->map, lane->wav.memoryStream.currentReadPos);
+	}
+}
+
+// Reads the next chunk of a lane's source for the ADPCM encoder, pointing
+// lane->pcm at it: straight into the mapping where possible, otherwise
+// decoded into the srcpcm buffer.
+static uint32_t conv_lane_read(ConvLane *lane)
+{
+	// Everything before this chunk has been encoded.
+	conv_lane_release(lane);
+	const uint32_t frames = lane->remaining < CONV_CHUNK_FRAMES ? lane->remaining : CONV_CHUNK_FRAMES;
+	uint32_t got;
+	if (lane->direct)
+	{
+		const uint32_t pos = lane->e->length - lane->remaining;
+		if (pos + frames <= lane->direct_frames)
+		{
+			lane->pcm = lane->direct + pos;
+			lane->remaining -= frames;
+			return frames;
+		}
+		// The data chunk is cut short; copy what there is and pad the rest.
+		if (!lane->srcpcm) lane->srcpcm = arena_alloc(lane->arena, CONV_CHUNK_FRAMES * sizeof(int16_t));
+		if (!lane->srcpcm)
+		{
+			fprintf(stderr, "[CONV] Couldn't allocate conversion buffers\n");
+			lane->ok = false;
+			lane->remaining = 0;
+			return 0;
+		}
+		got = pos < lane->direct_frames ? lane->direct_frames - pos : 0;
+		memcpy(lane->srcpcm, lane->direct + pos, got * sizeof(int16_t));
+	}
+	else
+	{
+		got = drwav_read_pcm_frames_s16(&lane->wav, frames, lane->srcpcm);
+	}
+	lane->pcm = lane->srcpcm;
+	if (got < frames)
+	{
+		// Pad out whatever the data chunk is missing with silence.
+		memset(lane->srcpcm + got, 0, (frames - got) * sizeof(int16_t));
+		lane->short_read = true;
+	}
+	lane->remaining -= frames;
+	return frames;
+}
+
+// Reads the next chunk of a PCM lane's source, converted to the target format,
+// into its outbuf. Returns the number of bytes produced.
+static uint32_t conv_lane_read_pcm(ConvLane *lane)
+{
+	conv_lane_release(lane);
+	const uint32_t frames = lane->remaining < CONV_CHUNK_FRAMES ? lane->remaining : CONV_CHUNK_FRAMES;
+	uint32_t got;
+	uint32_t frame_bytes;
+	if (lane->e->info.fmt == FMT_PCM16)
+	{
+		// The chip reads 16-bit samples high byte first.
+		got = drwav_read_pcm_frames_s16be(&lane->wav, frames, (int16_t *)lane->outbuf);
+		frame_bytes = sizeof(int16_t);
+	}
+	else
+	{
+		if (lane->narrow)
+		{
+			got = drwav_read_pcm_frames(&lane->wav, frames, lane->outbuf);
+			lane->narrow(lane->outbuf, got);
+		}
+		else
+		{
+			got = drwav_read_pcm_frames_s16(&lane->wav, frames, (int16_t *)lane->outbuf);
+			conv_narrow_s16(lane->outbuf, got);
+		}
+		frame_bytes = 1;
+	}
+	if (got < frames)
+	{
+		// Pad out whatever the data chunk is missing with silence.
+		memset(lane->outbuf + got * frame_bytes, 0, (frames - got) * frame_bytes);
+		lane->short_read = true;
+	}
+	lane->remaining -= frames;
+	return frames * frame_bytes;
+}
+
+// Encodes every open lane to completion. ADPCM lanes are encoded together by
+// ymz_encoder_run_multi(), one SIMD lane per entry.
+static void conv_lanes_encode(ConvLane *lanes, int count)
+{
+	ymz_encoder *adpcm_enc[YMZ_MULTI_LANES];
+	const int16_t *adpcm_in[YMZ_MULTI_LANES];
+	uint8_t *adpcm_out[YMZ_MULTI_LANES];
+	long adpcm_len[YMZ_MULTI_LANES];
+	long adpcm_bytes[YMZ_MULTI_LANES];
+	ConvLane *adpcm_lane[YMZ_MULTI_LANES];
+
+	while (true)
+	{
+		int adpcm_count = 0;
+		bool any = false;
+		for (int i = 0; i < count; i++)
+		{
+			ConvLane *lane = &lanes[i];
+			if (!lane->ok || !lane->wav_open || lane->remaining == 0) continue;
+			any = true;
+
+			if (lane->e->info.fmt == FMT_ADPCM)
+			{
+				adpcm_len[adpcm_count] = conv_lane_read(lane);
+				if (!lane->ok) continue;
+				adpcm_enc[adpcm_count] = &lane->adpcm;
+				adpcm_in[adpcm_count] = lane->pcm;
+				adpcm_out[adpcm_count] = lane->outbuf;
+				adpcm_lane[adpcm_count] = lane;
+				adpcm_count++;
+				continue;
+			}
+			const uint32_t out_bytes = conv_lane_read_pcm(lane);
+			lane->ok = conv_sink_write(&lane->sink, lane->outbuf, out_bytes);
+		}
+		if (!any) break;
+
+		if (adpcm_count == 0) continue;
+		ymz_encoder_run_multi(adpcm_enc, adpcm_in, adpcm_out, adpcm_len, adpcm_bytes, adpcm_count);
+		for (int i = 0; i < adpcm_count; i++)
+		{
+			ConvLane *lane = adpcm_lane[i];
+			lane->ok = conv_sink_write(&lane->sink, lane->outbuf, adpcm_bytes[i]);
+		}
+	}
+}
+
+// Releases a lane and settles its entry's result and cache entry.
+static void conv_lane_end(ConvLane *lane)
+{
+	Entry *e = lane->e;
+	const char *fname = e->info.src;
+
+	if (lane->short_read)
+	{
+		fprintf(stderr, "[CONV] \"%s\" ended early; padded with silence\n", fname);
+	}
+
+	if (lane->wav_open) conv_wav_close(&lane->wav, &lane->map);
+
+	// A trailing odd ADPCM nibble is dropped, so the sizes always agree.
+	if (lane->ok && lane->sink.written != e->data_bytes)
+	{
+		fprintf(stderr, "[CONV] \"%s\" produced %u bytes, expected %u\n", fname,
+		        lane->sink.written, e->data_bytes);
+		lane->ok = false;
+	}
+
+	if (lane->sink.cache)
+	{
+		if (lane->ok)
+		{
+			CacheRecord rec;
+			conv_entry_to_record(e, &rec);
+			cache_writer_commit(&lane->cache_writer, &rec);
+		}
+		else
+		{
+			cache_writer_abort(&lane->cache_writer);
+		}
+	}
+
+	e->ok = lane->ok;
+	if (!e->ok)
+	{
+		fprintf(stderr, "$%03X %s: conversion failed; its data is left blank\n",
+		        e->id, e->info.symbol_upper);
+		// Keep the reserved space, blanked, so the layout stays valid.
+		file_zero_at(lane->sink.fd, e->data_bytes, lane->sink.file_offs);
+	}
+}
+
+static double conv_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Encodes a whole ADPCM source at once, with up to `jobs` threads working on
+// segments of it: split greedy encodes, and every searched one.
+static void conv_entry_encode_whole(Conv *s, Entry *e, const int16_t *pcm, uint8_t *out, int jobs,
+                                    ConvLane *lane)
+{
+	if (e->info.effort == TRELLIS_EFFORT_GREEDY)
+	{
+		SegEncStats stats;
+		segenc_encode(pcm, out, e->length, jobs, s->split_fast, &stats);
+		if (stats.inexact > 0)
+		{
+			fprintf(stderr, "$%03X %s: %d of %d segments differ from a serial encode\n",
+			        e->id, e->info.symbol_upper, stats.inexact, stats.segments);
+		}
+		return;
+	}
+
+	const double t0 = conv_now();
+	if (!trellis_encode(pcm, out, e->length, e->info.effort, jobs, NULL))
+	{
+		lane->ok = false;
+		return;
+	}
+	e->search_seconds = conv_now() - t0;
+	e->search_snr = trellis_snr(pcm, out, e->length);
+
+	// The greedy encode is cheap next to the search; it's only for comparison.
+	uint8_t *greedy = arena_alloc(lane->arena, e->data_bytes);
+	if (greedy)
+	{
+		ymz_encode((int16_t *)pcm, greedy, e->length);
+		e->greedy_snr = trellis_snr(pcm, greedy, e->length);
+	}
+}
+
+// Converts one ADPCM entry with the whole source held in memory.
+static void conv_entry_convert_whole(Conv *s, Entry *e, int jobs, int ymz_fd)
+{
+	Arena arena;
+	arena_sub_init(&arena, &s->arena);
+	ConvLane lane;
+	conv_lane_begin(s, &lane, e, ymz_fd, &arena);
+	if (lane.ok && lane.wav_open)
+	{
+		// A mapped 16-bit source is encoded where it lies.
+		const bool direct = lane.direct && lane.direct_frames >= e->length;
+		int16_t *pcm = direct ? NULL : arena_alloc(&arena, sizeof(int16_t) * e->length);
+		uint8_t *out = arena_calloc(&arena, e->data_bytes, 1);
+		if ((!direct && !pcm) || !out)
+		{
+			fprintf(stderr, "[CONV] Couldn't allocate %u frames to encode \"%s\"\n", e->length,
+			        e->info.src);
+			lane.ok = false;
+		}
+		else
+		{
+			uint32_t pos = 0;
+			if (!direct && lane.map.data && drwav_get_block_frame_count(&lane.wav) > 0)
+			{
+				// MS and IMA ADPCM blocks stand alone, so they are decoded in parallel.
+				pos = blockdec_read_s16(&lane.wav, lane.map.data, lane.map.size, pcm, e->length,
+				                        jobs);
+				if (pos < e->length)
+				{
+					memset(pcm + pos, 0, (e->length - pos) * sizeof(int16_t));
+					lane.short_read = true;
+				}
+				lane.remaining = 0;
+			}
+			while (!direct && lane.ok && lane.remaining > 0)
+			{
+				const uint32_t frames = conv_lane_read(&lane);
+				memcpy(pcm + pos, lane.pcm, frames * sizeof(int16_t));
+				pos += frames;
+			}
+
+			if (lane.ok) conv_entry_encode_whole(s, e, direct ? lane.direct : pcm, out, jobs, &lane);
+			if (lane.ok) lane.ok = conv_sink_write(&lane.sink, out, e->data_bytes);
+		}
+	}
+	conv_lane_end(&lane);
+	arena_sub_free(&arena);
+}
+
+//
+// Conversion stages
+//
+
+typedef struct ConvJob
+{
+	Conv *conv;
+	Entry **entries;
+	int ymz_fd;  // The .ymz, sized up front; entries write to their own slots.
+
+	// Convert stage: entries are handed out in groups encoded side by side.
+	int *group_start;  // Index into entries; one more than there are groups.
+} ConvJob;
+
+static Entry **conv_entry_table(const Conv *s)
+{
+	Entry **entries = malloc(sizeof(*entries) * (s->entry_count ? s->entry_count : 1));
+	if (!entries)
+	{
+		fprintf(stderr, "[CONV] Couldn't allocate entry table\n");
+		return NULL;
+	}
+	int i = 0;
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++) entries[i++] = e;
+	return entries;
+}
+
+static void conv_entry_probe_job(void *user, int idx)
+{
+	ConvJob *job = (ConvJob *)user;
+	Entry *e = job->entries[idx];
+	if (e->alias_of >= 0) return;  // Filled in once its target is done.
+	Arena arena;
+	arena_sub_init(&arena, &job->conv->arena);
+	e->ok = conv_entry_probe(job->conv, e, &arena);
+	arena_sub_free(&arena);
+	if (!e->ok)
+	{
+		// Leave a harmless empty record behind so later IDs don't shift.
+		e->data_bytes = 0;
+		e->length = 0;
+		e->info.loop_start_pos = 0;
+		e->info.loop_end_pos = 0;
+	}
+}
+
+// Reads every entry's header (or cache record) using up to `jobs` threads.
+// Returns false if any entry couldn't be probed.
+static bool conv_probe_all(Conv *s, int jobs)
+{
+	Entry **entries = conv_entry_table(s);
+	if (!entries) return false;
+
+	s->cache_enabled = s->cache_dir[0] != '\0' && cache_init(&s->cache, s->cache_dir);
+
+	ConvJob job;
+	memset(&job, 0, sizeof(job));
+	job.conv = s;
+	job.entries = entries;
+	job.ymz_fd = -1;
+	pool_run(jobs, s->entry_count, conv_entry_probe_job, &job);
+	free(entries);
+
+	bool ok = true;
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		if (e->alias_of >= 0) conv_alias_resolve(s, e);
+		if (!e->ok) ok = false;
+	}
+	return ok;
+}
+
+static void conv_group_convert_job(void *user, int idx)
+{
+	ConvJob *job = (ConvJob *)user;
+	Entry **entries = job->entries + job->group_start[idx];
+	const int count = job->group_start[idx + 1] - job->group_start[idx];
+
+	Arena arena;
+	arena_sub_init(&arena, &job->conv->arena);
+	ConvLane *lanes = arena_alloc(&arena, sizeof(*lanes) * count);
+	if (!lanes)
+	{
+		fprintf(stderr, "[CONV] Couldn't allocate conversion lanes\n");
+		for (int i = 0; i < count; i++) entries[i]->ok = false;
+		arena_sub_free(&arena);
+		return;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		conv_lane_begin(job->conv, &lanes[i], entries[i], job->ymz_fd, &arena);
+	}
+	conv_lanes_encode(lanes, count);
+	for (int i = 0; i < count; i++) conv_lane_end(&lanes[i]);
+	arena_sub_free(&arena);
+}
+
+static void conv_entry_search_job(void *user, int idx)
+{
+	ConvJob *job = (ConvJob *)user;
+	conv_entry_convert_whole(job->conv, job->entries[idx], 1, job->ymz_fd);
+}
+
+// How much encoding work an entry needs, in the order it's scheduled.
+static int conv_entry_work_rank(const Entry *e)
+{
+	if (e->info.fmt != FMT_ADPCM || e->cache_hit) return 2;
+	return e->info.effort == TRELLIS_EFFORT_GREEDY ? 1 : 0;
+}
+
+// Searched ADPCM encodes go first, then greedy ones; longest first, so that
+// entries grouped together finish at about the same time.
+static int conv_entry_group_cmp(const void *a, const void *b)
+{
+	const Entry *ea = *(const Entry **)a;
+	const Entry *eb = *(const Entry **)b;
+	const int ra = conv_entry_work_rank(ea);
+	const int rb = conv_entry_work_rank(eb);
+	if (ra != rb) return ra - rb;
+	if (ea->length != eb->length) return ea->length > eb->length ? -1 : 1;
+	return ea->id - eb->id;
+}
+
+static void conv_report_search(const Conv *s)
+{
+	char effort[32];
+	for (const Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		if (!e->ok || conv_entry_work_rank(e) != 0) continue;
+		printf("$%03X %s: effort %s, %.2f s, SNR %.2f dB (%+.2f dB over greedy)\n",
+		       e->id, e->info.symbol_upper,
+		       trellis_effort_name(e->info.effort, effort, sizeof(effort)),
+		       e->search_seconds, e->search_snr, e->search_snr - e->greedy_snr);
+	}
+}
+
+// Converts every probed entry using up to `jobs` threads. Encoded data is
+// written straight to each entry's place in `ymz_fd` as it is produced.
+// Returns false if any entry failed to convert.
+static bool conv_convert_all(Conv *s, int jobs, int ymz_fd)
+{
+	Entry **entries = conv_entry_table(s);
+	int *group_start = malloc(sizeof(*group_start) * (s->entry_count + 1));
+	if (!entries || !group_start)
+	{
+		fprintf(stderr, "[CONV] Couldn't allocate entry table\n");
+		free(entries);
+		free(group_start);
+		return false;
+	}
+
+	// Remember which entries were fine going in; a failed conversion still
+	// leaves its data in place.
+	bool ok = true;
+	int count = 0;
+	int search_count = 0;
+	int adpcm_count = 0;
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		if (!e->ok)
+		{
+			ok = false;
+			continue;
+		}
+		if (e->payload_of != e->id) continue;
+		entries[count++] = e;
+		const int rank = conv_entry_work_rank(e);
+		if (rank == 0) search_count++;
+		else if (rank == 1) adpcm_count++;
+	}
+	qsort(entries, count, sizeof(*entries), conv_entry_group_cmp);
+
+	ConvJob job;
+	memset(&job, 0, sizeof(job));
+	job.conv = s;
+	job.ymz_fd = ymz_fd;
+
+	// Searched entries come first. Ones long enough to keep every thread busy
+	// are encoded one at a time in segments; the rest one per thread. The
+	// search reads back and forth through the whole source, so these are held
+	// in memory even when streaming.
+	if (s->stream && search_count > 0)
+	{
+		fprintf(stderr, "[CONV] --stream doesn't apply to the %d searched entr%s; %s held in memory whole\n",
+		        search_count, (search_count == 1) ? "y" : "ies", (search_count == 1) ? "it is" : "they are");
+	}
+	int done = 0;
+	while (done < search_count && entries[done]->length >= (uint64_t)TRELLIS_SEGMENT * jobs)
+	{
+		conv_entry_convert_whole(s, entries[done], jobs, ymz_fd);
+		done++;
+	}
+	job.entries = entries + done;
+	pool_run(jobs, search_count - done, conv_entry_search_job, &job);
+	done = search_count;
+
+	// The longest greedy ADPCM entries are split up and encoded one at a time
+	// on every thread. Splitting needs the whole source in memory, so
+	// streaming leaves them to the lanes.
+	if (jobs > 1 && !s->stream)
+	{
+		while (done < search_count + adpcm_count && entries[done]->length >= CONV_SPLIT_FRAMES)
+		{
+			conv_entry_convert_whole(s, entries[done], jobs, ymz_fd);
+			done++;
+			adpcm_count--;
+		}
+	}
+
+	// Group ADPCM entries for the multi-stream encoder, but not so coarsely
+	// that threads go idle. Everything else is converted one at a time.
+	int group_size = (adpcm_count + jobs - 1) / jobs;
+	if (group_size > YMZ_MULTI_LANES) group_size = YMZ_MULTI_LANES;
+	if (group_size < 1) group_size = 1;
+	int groups = 0;
+	for (int i = 0; i < count - done; groups++)
+	{
+		group_start[groups] = i;
+		i += (i < adpcm_count) ? group_size : 1;
+		if (i > adpcm_count && group_start[groups] < adpcm_count) i = adpcm_count;
+	}
+	group_start[groups] = count - done;
+
+	job.entries = entries + done;
+	job.group_start = group_start;
+	pool_run(jobs, groups, conv_group_convert_job, &job);
+	free(entries);
+	free(group_start);
+
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		// An entry sharing another's payload stands or falls with it.
+		if (e->ok && e->payload_of != e->id) e->ok = s->entries[e->payload_of].ok;
+		if (!e->ok) ok = false;
+	}
+
+	conv_report_search(s);
+	if (s->cache_enabled) cache_report(&s->cache);
+	return ok;
+}
+
+// What makes two entries' payloads the same: the source file, and the
+// settings the encoder sees. Loop points, clock, TL and panning only affect
+// the .dat record.
+typedef struct ConvPayloadKey
+{
+	uint64_t src_dev;
+	uint64_t src_ino;
+	const char *src;  // Interned; used where the file's identity is unknown.
+	int32_t fmt;
+	int32_t effort;
+} ConvPayloadKey;
+
+static ConvPayloadKey conv_payload_key(const Entry *e)
+{
+	ConvPayloadKey key;
+	memset(&key, 0, sizeof(key));
+	if (e->src_ino_set)
+	{
+		key.src_dev = e->src_dev;
+		key.src_ino = e->src_ino;
+	}
+	else
+	{
+		key.src = e->info.src;
+	}
+	key.fmt = e->info.fmt;
+	key.effort = (e->info.fmt == FMT_ADPCM) ? e->info.effort : TRELLIS_EFFORT_GREEDY;
+	return key;
+}
+
+// Points every entry whose payload would repeat an earlier entry's at that
+// entry instead. Entries placed with data_offs keep their own copy.
+static void conv_share_payloads(Conv *s)
+{
+	uint32_t cap = 16;
+	while (cap < (uint32_t)s->entry_count * 2) cap *= 2;
+	int *slots = malloc(sizeof(*slots) * cap);  // Entry ids; -1 is free.
+	if (!slots) return;  // Everything simply keeps its own copy.
+	for (uint32_t i = 0; i < cap; i++) slots[i] = -1;
+
+	int shared = 0;
+	uint64_t saved = 0;
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		e->payload_of = e->id;
+		if (e->alias_of >= 0)
+		{
+			// Aliases come after their target, whose payload is settled.
+			e->payload_of = s->entries[e->alias_of].payload_of;
+			continue;
+		}
+		if (!e->ok || e->data_offs_set) continue;
+
+		const ConvPayloadKey key = conv_payload_key(e);
+		uint32_t slot = hash64(&key, sizeof(key), 0) & (cap - 1);
+		for (; slots[slot] >= 0; slot = (slot + 1) & (cap - 1))
+		{
+			const ConvPayloadKey other = conv_payload_key(&s->entries[slots[slot]]);
+			if (memcmp(&key, &other, sizeof(key)) == 0) break;
+		}
+		if (slots[slot] < 0)
+		{
+			slots[slot] = e->id;
+			continue;
+		}
+
+		const Entry *first = &s->entries[slots[slot]];
+		if (first->data_bytes != e->data_bytes) continue;  // The source changed in between.
+		e->payload_of = first->id;
+		shared++;
+		saved += e->data_bytes;
+	}
+	free(slots);
+
+	if (shared > 0)
+	{
+		printf("[DEDUP] %d entries share data with earlier ones; %llu bytes saved\n", shared,
+		       (unsigned long long)saved);
+	}
+}
+
+// Gives every payload an address once every entry's size is known, so the
+// layout does not depend on the order in which entries were probed. Entries
+// sharing a payload take its addresses, whether it comes before or after
+// them. The .ymz holds the addresses from the lowest used up, or from 0 if
+// there is a lock file, with any gaps zeroed. Sets *ymz_bytes to the size
+// of the .ymz. Returns false if payloads overlap or break their
+// constraints. If `report` is set, says why, and reports each entry and how
+// full the address space is.
+static bool conv_layout(Conv *s, bool report, uint64_t *ymz_bytes)
+{
+	const size_t n = s->entry_count ? s->entry_count : 1;
+	AllocItem *items = malloc(sizeof(*items) * n);  // By entry.
+	int *by_addr = malloc(sizeof(*by_addr) * n);
+	int *lock_of = malloc(sizeof(*lock_of) * n);    // By entry: the entry whose lock its payload keeps.
+	if (!items || !by_addr || !lock_of)
+	{
+		fprintf(stderr, "[ALLOC] Couldn't allocate layout\n");
+		free(items);
+		free(by_addr);
+		free(lock_of);
+		*ymz_bytes = 0;
+		return false;
+	}
+
+	// Only payloads take up space. Those in the lock file stay where they
+	// were if they still fit there, and everything else goes around them. A
+	// payload can keep the place of any entry using it, its owner's first.
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		lock_of[e->id] = e->locked ? e->id : -1;
+	}
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		if (e->locked && lock_of[e->payload_of] < 0) lock_of[e->payload_of] = e->id;
+	}
+	AllocParams params = s->alloc;
+	int kept = 0, moved = 0, added = 0;
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		AllocItem *item = &items[e->id];
+		memset(item, 0, sizeof(*item));
+		if (e->payload_of != e->id) continue;
+		item->size = e->data_bytes;
+		item->align = e->info.align;
+		item->within_bank = e->info.within_bank;
+		item->pinned = e->data_offs_set;
+		item->addr = e->info.data_offs;
+		if (item->pinned || item->size == 0 || !s->lock_fname) continue;
+
+		const Entry *lock = (lock_of[e->id] >= 0) ? &s->entries[lock_of[e->id]] : NULL;
+		if (lock && item->size <= lock->lock_size)
+		{
+			item->addr = lock->lock_addr;
+			if (!alloc_item_problem(item, &params))
+			{
+				item->pinned = true;
+				kept++;
+				continue;
+			}
+			item->addr = e->info.data_offs;
+		}
+		if (lock) moved++;
+		else added++;
+	}
+	if (kept > 0 && params.order == ALLOC_IN_ORDER) params.order = ALLOC_FIRST_FIT;
+	alloc_place(items, s->entry_count, &params);
+
+	bool ok = true;
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		const AllocItem *item = &items[e->id];
+		const char *problem = (e->payload_of == e->id) ? alloc_item_problem(item, &params) : NULL;
+		if (!problem) continue;
+		if (report)
+		{
+			fprintf(stderr, "[ALLOC] $%03X %s: %u bytes at $%06X %s\n", e->id, e->info.symbol_upper,
+			        item->size, item->addr, problem);
+		}
+		ok = false;
+	}
+	AllocSurvey survey;
+	int overlap_a, overlap_b;
+	if (alloc_survey(items, s->entry_count, by_addr, &survey, &overlap_a, &overlap_b) < 0)
+	{
+		fprintf(stderr, "[ALLOC] Couldn't allocate layout\n");
+		ok = false;
+	}
+	else if (overlap_a >= 0)
+	{
+		if (report)
+		{
+			fprintf(stderr, "[ALLOC] $%03X %s overlaps $%03X %s\n",
+			        overlap_a, s->entries[overlap_a].info.symbol_upper,
+			        overlap_b, s->entries[overlap_b].info.symbol_upper);
+		}
+		ok = false;
+	}
+
+	// With a lock file, the .ymz starts at address 0 instead, so that entries
+	// keeping their addresses keep their place in the file too, whatever
+	// happens below them.
+	const uint32_t base = s->lock_fname ? 0 : survey.base;
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		if (e->payload_of != e->id) continue;
+		e->info.data_offs = items[e->id].addr;
+		e->file_offs = (e->info.data_offs > base) ? e->info.data_offs - base : 0;
+	}
+	*ymz_bytes = survey.end - base;
+	s->ymz_base = base;
+	free(items);
+	free(by_addr);
+	free(lock_of);
+
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		const Entry *payload = &s->entries[e->payload_of];
+		if (payload != e)
+		{
+			e->info.data_offs = payload->info.data_offs;
+			e->file_offs = payload->file_offs;
+		}
+
+		// Calculate addresses. Start and end points are specified not by sample
+		// index but by address.
+		e->start_address = e->info.data_offs;
+		e->end_address = e->start_address + e->data_bytes;
+
+		e->loop_start_address = e->start_address + ((uint64_t)e->bits_per_sample * e->info.loop_start_pos) / 8;
+		e->loop_end_address =  e->info.data_offs + ((uint64_t)e->bits_per_sample * e->info.loop_end_pos) / 8;
+
+		if (!report) continue;
+
+		if (!e->ok)
+		{
+			fprintf(stderr, "$%03X %s: conversion failed; emitting an empty entry\n",
+			        e->id, e->info.symbol_upper);
+		}
+		else
+		{
+			printf("wav rate $%d, pcm frames %d\n", e->info.sample_rate, e->length);
+			printf("$%03X %s: %d samples * %d channels @ fmt %d --> %d bits per sample; total %d ($%X) bytes\n",
+			       e->id, e->info.symbol_upper,
+			       e->length, e->channels, e->info.fmt, e->bits_per_sample, e->data_bytes, e->data_bytes);
+		}
+
+		if (!e->ok) continue;
+
+		if (e->alias_of >= 0)
+		{
+			printf("  alias of $%03X %s\n", e->alias_of, s->entries[e->alias_of].info.symbol_upper);
+		}
+		else if (payload != e)
+		{
+			printf("  %s $%03X %s\n",
+			       (payload->data_bytes > e->data_bytes) ? "is a prefix of" : "shares data with",
+			       payload->id, payload->info.symbol_upper);
+		}
+
+		printf("  sample count:       %d ($%06X)\n", e->length, e->length);
+		printf("  loop start pos:     %d ($%06X)\n", e->info.loop_start_pos, e->info.loop_start_pos);
+		printf("  loop end pos:       %d ($%06X)\n", e->info.loop_end_pos, e->info.loop_end_pos);
+		printf("  start address:      %d ($%06X)\n", e->start_address, e->start_address);
+		printf("  end address:        %d ($%06X)\n", e->end_address, e->end_address);
+		printf("  loop start address: %d ($%06X)\n", e->loop_start_address, e->loop_start_address);
+		printf("  loop end address:   %d ($%06X)\n", e->loop_end_address, e->loop_end_address);
+
+		const float base_freq = (e->info.fmt == FMT_ADPCM) ? 44100 : 88200;
+		const float adjusted_freq = (base_freq * e->info.clock) / (float)YMZ280B_CLOCK_NOMINAL;
+		printf("Base freq @ %fHz = %fHz\n", base_freq, adjusted_freq);
+		const int steps = (e->info.fmt == FMT_ADPCM) ? 256 : 512;
+		printf("  fmt %d : fn %d steps\n", e->info.fmt, steps);
+		printf("  src freq %dHz = fn $%03X\n", e->info.sample_rate, e->fn_reg);
+	}
+
+	if (report && s->lock_fname)
+	{
+		printf("[LOCK] %d entries kept their addresses, %d moved and %d are new\n", kept, moved, added);
+	}
+	if (report && survey.used > 0)
+	{
+		printf("[ALLOC] %llu bytes of samples from $%06X to $%06llX", (unsigned long long)survey.used,
+		       survey.base, (unsigned long long)survey.end);
+		if (survey.gaps > 0)
+		{
+			printf("; %d gap%s of %llu bytes in all, the largest %llu", survey.gaps,
+			       (survey.gaps == 1) ? "" : "s", (unsigned long long)survey.gap_bytes,
+			       (unsigned long long)survey.largest_gap);
+		}
+		printf("; the .ymz starts at $%06X\n", s->ymz_base);
+	}
+	return ok;
+}
+
+static int conv_entry_offs_cmp(const void *a, const void *b)
+{
+	const Entry *ea = *(const Entry *const *)a;
+	const Entry *eb = *(const Entry *const *)b;
+	if (ea->file_offs != eb->file_offs) return (ea->file_offs < eb->file_offs) ? -1 : 1;
+	return ea->id - eb->id;
+}
+
+// Lets each payload that turned out to be the start of a longer one play from
+// the longer one's storage, then lays everything out again without them and
+// moves the payloads in the converted .ymz, which is `ymz_bytes` long, to
+// match. Entries placed with data_offs keep their own copy, but can still be
+// played from by others. Sets *layout_ok as conv_layout() returns; returns
+// false if the .ymz couldn't be rewritten.
+static bool conv_pack(Conv *s, int ymz_fd, const char *ymz_fname, uint64_t ymz_bytes, bool *layout_ok)
+{
+	MapFile map;
+	const size_t n = s->entry_count ? s->entry_count : 1;
+	const uint8_t **data = malloc(sizeof(*data) * n);
+	uint32_t *len = malloc(sizeof(*len) * n);
+	bool *fixed = malloc(sizeof(*fixed) * n);
+	int *ids = malloc(sizeof(*ids) * n);
+	int *host = malloc(sizeof(*host) * n);
+	uint64_t *old_offs = malloc(sizeof(*old_offs) * n);
+	uint8_t *moving = NULL;
+	bool ok = true;
+	uint64_t new_bytes = ymz_bytes;
+	if (!data || !len || !fixed || !ids || !host || !old_offs || ymz_bytes == 0 ||
+	    !mapfile_open(&map, ymz_fname))
+	{
+		if (ymz_bytes > 0) printf("[PACK] Couldn't read back %s; not packing\n", ymz_fname);
+		*layout_ok = conv_layout(s, true, &new_bytes);
+		goto done;
+	}
+
+	int count = 0;
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		old_offs[e->id] = e->file_offs;
+		if (!e->ok || e->payload_of != e->id || e->data_bytes == 0) continue;
+		data[count] = (const uint8_t *)map.data + e->file_offs;
+		len[count] = e->data_bytes;
+		fixed[count] = e->data_offs_set;
+		ids[count] = e->id;
+		count++;
+	}
+
+	int packed = 0;
+	uint64_t saved = 0;
+	if (pack_find_prefixes(data, len, fixed, count, host))
+	{
+		for (int i = 0; i < count; i++)
+		{
+			if (host[i] < 0) continue;
+			s->entries[ids[i]].payload_of = ids[host[i]];
+			packed++;
+			saved += len[i];
+		}
+	}
+	// Entries that shared a payload which now has a host follow it there.
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		const Entry *payload = &s->entries[e->payload_of];
+		if (payload != e) e->payload_of = payload->payload_of;
+	}
+
+	*layout_ok = conv_layout(s, true, &new_bytes);
+
+	// Payloads can land where others were, so every one that moves is read
+	// before any is written.
+	uint64_t moving_bytes = 0;
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		if (e->payload_of == e->id && e->file_offs != old_offs[e->id]) moving_bytes += e->data_bytes;
+	}
+	moving = malloc(moving_bytes ? moving_bytes : 1);
+	if (!moving)
+	{
+		fprintf(stderr, "[PACK] Couldn't allocate %llu bytes to move data\n",
+		        (unsigned long long)moving_bytes);
+		mapfile_close(&map);
+		ok = false;
+		goto done;
+	}
+	uint64_t pos = 0;
+	for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+	{
+		if (e->payload_of != e->id || e->file_offs == old_offs[e->id]) continue;
+		memcpy(moving + pos, (const uint8_t *)map.data + old_offs[e->id], e->data_bytes);
+		pos += e->data_bytes;
+	}
+	mapfile_close(&map);
+	pos = 0;
+	for (Entry *e = s->entries; ok && e < s->entries + s->entry_count; e++)
+	{
+		if (e->payload_of != e->id || e->file_offs == old_offs[e->id]) continue;
+		ok = file_write_at(ymz_fd, moving + pos, e->data_bytes, e->file_offs);
+		pos += e->data_bytes;
+	}
+	if (ok && new_bytes < ymz_bytes) ok = ftruncate(ymz_fd, new_bytes) == 0;
+
+	// Whatever was left behind where payloads no longer are is cleared, so the
+	// gaps read as zeros just as they do in a .ymz that wasn't packed.
+	Entry **by_offs = ok ? conv_entry_table(s) : NULL;
+	if (by_offs)
+	{
+		int owners = 0;
+		for (Entry *e = s->entries; e < s->entries + s->entry_count; e++)
+		{
+			if (e->payload_of == e->id && e->data_bytes > 0) by_offs[owners++] = e;
+		}
+		qsort(by_offs, owners, sizeof(*by_offs), conv_entry_offs_cmp);
+		uint64_t clear_from = 0;
+		for (int i = 0; ok && i <= owners; i++)
+		{
+			const uint64_t clear_to = (i < owners) ? by_offs[i]->file_offs : new_bytes;
+			if (clear_to > clear_from) ok = file_zero_at(ymz_fd, clear_to - clear_from, clear_from);
+			if (i < owners && by_offs[i]->file_offs + by_offs[i]->data_bytes > clear_from)
+			{
+				clear_from = by_offs[i]->file_offs + by_offs[i]->data_bytes;
+			}
+		}
+		free(by_offs);
+	}
+	else
+	{
+		ok = false;
+	}
+
+	if (packed > 0)
+	{
+		printf("[PACK] %d entries are prefixes of others; %llu bytes saved\n", packed,
+		       (unsigned long long)saved);
+	}
+
+done:
+	free(data);
+	free(len);
+	free(fixed);
+	free(ids);
+	free(host);
+	free(old_offs);
+	free(moving);
+	return ok;
+}
+
+// Adds a table of YMZKEY records, one per MIDI note, to `key` for each
+// instrument, in order of first appearance, with its offset in the .inc and
+// .h. Notes beyond the chip's fn range are clamped to it.
+static bool conv_write_keymaps(Conv *s, OutBuf *key, OutBuf *inc, OutBuf *hdr)
+{
+	bool *done = calloc(s->entry_count ? s->entry_count : 1, sizeof(*done));
+	Entry **zone_entry = malloc(sizeof(*zone_entry) * (s->entry_count ? s->entry_count : 1));
+	KeymapZone *zones = malloc(sizeof(*zones) * (s->entry_count ? s->entry_count : 1));
+	if (!done || !zone_entry || !zones)
+	{
+		fprintf(stderr, "[KEYMAP] Couldn't allocate keymaps\n");
+		free(done);
+		free(zone_entry);
+		free(zones);
+		return false;
+	}
+
+	bool ok = true;
+	for (Entry *first = s->entries; first < s->entries + s->entry_count; first++)
+	{
+		if (!first->info.instrument || done[first->id]) continue;
+
+		int count = 0;
+		bool reachable = true;
+		for (Entry *e = first; e < s->entries + s->entry_count; e++)
+		{
+			if (e->info.instrument != first->info.instrument) continue;
+			done[e->id] = true;
+			if (e->id >= YMZKEY_MAX_ENTRIES)
+			{
+				fprintf(stderr, "[KEYMAP] %s: zone $%03X %s is past the first %d entries, which is as far "
+				        "as a YMZKEY record reaches\n", first->info.instrument, e->id,
+				        e->info.symbol_upper, YMZKEY_MAX_ENTRIES);
+				reachable = false;
+			}
+			zone_entry[count] = e;
+			zones[count].root = e->info.root_note;
+			zones[count].low = e->info.key_low;
+			zones[count].high = e->info.key_high;
+			count++;
+		}
+
+		if (!reachable)
+		{
+			ok = false;
+			continue;
+		}
+
+		int zone_of[KEYMAP_NOTES];
+		keymap_assign(zones, count, zone_of);
+
+		const uint32_t offs = key->len;
+		if (offs == 0) outbuf_printf(hdr, "\n");
+		YmzKeyRecord *rec = (YmzKeyRecord *)outbuf_write(key, NULL, sizeof(*rec) * KEYMAP_NOTES);
+		if (!rec)
+		{
+			ok = false;
+			break;
+		}
+		int clamped = 0;
+		for (int note = 0; note < KEYMAP_NOTES; note++, rec++)
+		{
+			const Entry *e = zone_entry[zone_of[note]];
+			uint32_t fn_reg = e->fn_reg;
+			if (note != e->info.root_note)
+			{
+				const double rate = keymap_note_rate(e->info.sample_rate, e->info.root_note, note);
+				fn_reg = conv_fn_reg(e, (uint32_t)(rate + 0.5));
+			}
+			if (fn_reg > 0x1FF)
+			{
+				fn_reg = 0x1FF;
+				clamped++;
+			}
+			const uint32_t blob_offs = e->id * YMZ_BLOB_ENTRY_SIZE;
+			rec->blob_offs[0] = (blob_offs>>8) & 0xFF;
+			rec->blob_offs[1] = blob_offs & 0xFF;
+			rec->key = conv_entry_key(e, fn_reg);
+			rec->fn = fn_reg & 0xFF;
+		}
+
+		printf("[KEYMAP] %s: %d zone%s", first->info.instrument, count, (count == 1) ? "" : "s");
+		if (clamped > 0) printf("; %d notes above the chip's range play at its highest pitch", clamped);
+		printf("\n");
 
-	fprintf(f_inc, "; ┌────────────────────────────────────────────────────────────────────────────┐\n");
-	fprintf(f_inc, "; │                                                                            │\n");
-	fprintf(f_inc, "; │                               YMZ280B DATA INDEX                           │\n");
-	fprintf(f_inc, "; │                                                                            │\n");
-	fprintf(f_inc, "; └────────────────────────────────────────────────────────────────────────────┘\n");
-	fprintf(f_inc, "\n");
-
-	fprintf(f_hdr, "#pragma once\n");
-	fprintf(f_hdr, "// ┌───────────────────────────────────────────────────────────────────────────┐\n");
-	fprintf(f_hdr, "// │                             YMZ280B CALL OFFSETS                          │\n");
-	fprintf(f_hdr, "// └───────────────────────────────────────────────────────────────────────────┘\n");
-	fprintf(f_hdr, "\n");
+		outbuf_printf(inc, "; Keymap \"%s\": YMZKEY records for MIDI notes 0-%d\n",
+		              first->info.instrument, KEYMAP_NOTES - 1);
+		outbuf_printf(inc, "%s_KEYMAP_OFFS = $%04X\n", first->info.instrument_upper, offs);
+		outbuf_printf(inc, "\n");
+		outbuf_printf(hdr, "#define %s_KEYMAP_OFFS 0x%X\n", first->info.instrument_upper, offs);
+	}
 
-	Entry *e = conv.entry_head;
+	free(done);
+	free(zone_entry);
+	free(zones);
+	return ok;
+}
+
+static void conv_report_arena(Conv *s)
+{
+	const ArenaStats stats = arena_stats(&s->arena);
+	printf("[ARENA] peak %.1f MiB reserved, %.1f MiB allocated in %zu blocks\n",
+	       stats.peak_reserved / 1048576.0, stats.allocated / 1048576.0, stats.blocks);
+}
+
+// Strings and everything conversion allocated go with the arena.
+static void conv_shutdown(Conv *s)
+{
+	if (s->arena_stats) conv_report_arena(s);
+	strtab_free(&s->strings);
+	free(s->symbol_entry);
+	free(s->entries);
+	arena_free(&s->arena);
+	s->entries = NULL;
+	s->entry_count = 0;
+}
 
-	uint32_t blob_bytes = 0;
 
+//
+// Configuration parsing
+//
 
-	while (e)
+// Interns a string from the INI, optionally in upper case. Returns NULL if
+// out of memory.
+static const char *conv_intern(Conv *s, const char *str, bool upper)
+{
+	char buf[256];
+	char *copy = upper ? conv_upper(str, buf, sizeof(buf)) : NULL;
+	const uint32_t id = (upper && !copy) ? STRTAB_NONE : strtab_intern(&s->strings, upper ? copy : str);
+	if (copy != buf) free(copy);
+	if (id == STRTAB_NONE)
 	{
-		// Binary Data
-		const uint8_t reg00_bits = e->fn_reg & 0xFF;  // key on, mode bits, loop not set, high fn bit
-		const uint8_t reg01_bits = 0x80 | (e->info.loop ? 0x10 : 0x00) | (e->fn_reg>>8) | (e->info.fmt << 5);  // key on, mode bits, loop not set, high fn bit
+		fprintf(stderr, "[CONV] Couldn't allocate string \"%s\"\n", str);
+		return NULL;
+	}
+	return strtab_str(&s->strings, id);
+}
+
+// Gives an entry the address the lock file recorded for it. Records for
+// entries no longer in the INI are dropped, freeing their space.
+static void conv_lock_record(void *user, const char *symbol, uint32_t address, uint32_t size)
+{
+	Entry *e = conv_entry_find((Conv *)user, symbol);
+	if (!e) return;
+	e->locked = true;
+	e->lock_addr = address;
+	e->lock_size = size;
+}
+
+static int handler(void *user, const char *section, const char *name, const char *value)
+{
+	Conv *s = (Conv *)user;
+
+	// New section - copy in name
+	if (!s->info.symbol || strcmp(section, s->info.symbol) != 0)
+	{
+		s->info.symbol = conv_intern(s, section, false);
+		s->info.symbol_upper = conv_intern(s, section, true);
+		if (!s->info.symbol || !s->info.symbol_upper) return 0;
+	}
+
+	// Setting the source is what records an entry
+	if (strcmp("src", name) == 0)
+	{
+		s->info.src = conv_intern(s, value, false);
+		if (!s->info.src || !conv_entry_add(s, -1)) return 0;
+	}
+	// As does naming an earlier entry to alias
+	else if (strcmp("alias", name) == 0)
+	{
+		if (!conv_alias_add(s, value)) return 0;
+	}
+	else if (strcmp("out", name) == 0)
+	{
+		strncpy(s->out, value, sizeof(s->out));
+		s->out[sizeof(s->out)-1] = '\0';
+	}
+	else if (strcmp("cache", name) == 0)
+	{
+		strncpy(s->cache_dir, value, sizeof(s->cache_dir));
+		s->cache_dir[sizeof(s->cache_dir)-1] = '\0';
+	}
+	else if (strcmp("format", name) == 0)
+	{
+		if (strcmp("adpcm", value) == 0) s->info.fmt = FMT_ADPCM;
+		else if (strcmp("pcm8", value) == 0) s->info.fmt = FMT_PCM8;
+		else if (strcmp("pcm16", value) == 0) s->info.fmt = FMT_PCM16;
+	}
+	else if (strcmp("effort", name) == 0)
+	{
+		if (!trellis_parse_effort(value, &s->info.effort))
+		{
+			fprintf(stderr, "[CONV] Unknown effort \"%s\"; expected greedy, lookahead-N or trellis\n",
+			        value);
+			return 0;
+		}
+	}
+	else if (strcmp("loop_start", name) == 0)
+	{
+		s->info.loop_start_pos = strtoul(value, NULL, 0);
+		s->loop_start_set = true;
+	}
+	else if (strcmp("loop_end", name) == 0)
+	{
+		s->info.loop_end_pos = strtoul(value, NULL, 0);
+		s->loop_end_set = true;
+	}
+	else if (strcmp("data_offs", name) == 0)
+	{
+		s->info.data_offs = strtoul(value, NULL, 0);
+		s->data_offs_set = true;
+	}
+	else if (strcmp("clock", name) == 0)
+	{
+		s->info.clock = strtoul(value, NULL, 0);
+	}
+	else if (strcmp("tl", name) == 0)
+	{
+		s->info.tl = strtoul(value, NULL, 0);
+	}
+	else if (strcmp("panpot", name) == 0)
+	{
+		s->info.panpot = strtoul(value, NULL, 0);
+	}
+	else if (strcmp("loop", name) == 0)
+	{
+		s->info.loop = strtoul(value, NULL, 0) ? true : false;
+	}
+	else if (strcmp("rate", name) == 0)
+	{
+		s->info.rate = strtoul(value, NULL, 0);
+	}
+	else if (strcmp("lock", name) == 0)
+	{
+		s->lock_fname = NULL;
+		if (value[0] != '\0' && !(s->lock_fname = conv_intern(s, value, false))) return 0;
+	}
+	else if (strcmp("allocate", name) == 0)
+	{
+		if (strcmp("order", value) == 0) s->alloc.order = ALLOC_IN_ORDER;
+		else if (strcmp("size", value) == 0) s->alloc.order = ALLOC_BY_SIZE;
+		else
+		{
+			fprintf(stderr, "[CONV] Unknown allocate \"%s\"; expected order or size\n", value);
+			return 0;
+		}
+	}
+	else if (strcmp("rom_size", name) == 0)
+	{
+		const unsigned long size = strtoul(value, NULL, 0);
+		if (size == 0 || size > ALLOC_ADDRESS_LIMIT)
+		{
+			fprintf(stderr, "[CONV] rom_size must be from 1 to $%X\n", ALLOC_ADDRESS_LIMIT);
+			return 0;
+		}
+		s->alloc.limit = size;
+		s->roms.size = size;
+	}
+	else if (strcmp("bank_size", name) == 0)
+	{
+		s->alloc.bank_size = strtoul(value, NULL, 0);
+	}
+	else if (strcmp("align", name) == 0)
+	{
+		const unsigned long align = strtoul(value, NULL, 0);
+		if ((align & (align - 1)) || align > ALLOC_ADDRESS_LIMIT)
+		{
+			fprintf(stderr, "[CONV] \"%s\": align $%lX isn't a power of two up to $%X\n", s->info.symbol,
+			        align, ALLOC_ADDRESS_LIMIT);
+			return 0;
+		}
+		s->info.align = align;
+	}
+	else if (strcmp("within_bank", name) == 0)
+	{
+		s->info.within_bank = strtoul(value, NULL, 0) ? true : false;
+	}
+	else if (strcmp("object", name) == 0)
+	{
+		s->object_m68k = strcmp("m68k", value) == 0 || strcmp("both", value) == 0;
+		s->object_host = strcmp("host", value) == 0 || strcmp("both", value) == 0;
+		if (!s->object_m68k && !s->object_host && strcmp("none", value) != 0)
+		{
+			fprintf(stderr, "[CONV] Unknown object \"%s\"; expected m68k, host, both or none\n", value);
+			return 0;
+		}
+	}
+	else if (strcmp("object_ymz", name) == 0)
+	{
+		s->object_ymz = strtoul(value, NULL, 0) ? true : false;
+	}
+	else if (strcmp("rom_chip_size", name) == 0)
+	{
+		s->roms.chip_size = strtoul(value, NULL, 0);
+	}
+	else if (strcmp("rom_interleave", name) == 0)
+	{
+		s->roms.interleave = strtol(value, NULL, 0);
+	}
+	else if (strcmp("rom_word", name) == 0)
+	{
+		s->roms.word = strtol(value, NULL, 0);
+	}
+	else if (strcmp("instrument", name) == 0)
+	{
+		s->info.instrument = conv_intern(s, value, false);
+		s->info.instrument_upper = conv_intern(s, value, true);
+		if (!s->info.instrument || !s->info.instrument_upper) return 0;
+	}
+	else if (strcmp("root_note", name) == 0 || strcmp("key_low", name) == 0 ||
+	         strcmp("key_high", name) == 0)
+	{
+		int *dest = (strcmp("root_note", name) == 0) ? &s->info.root_note :
+		            (strcmp("key_low", name) == 0) ? &s->info.key_low : &s->info.key_high;
+		char *end;
+		const long note = strtol(value, &end, 0);
+		if (end == value || note < 0 || note >= KEYMAP_NOTES)
+		{
+			fprintf(stderr, "[CONV] \"%s\": %s must be a MIDI note, 0-%d\n", s->info.symbol, name,
+			        KEYMAP_NOTES - 1);
+			return 0;
+		}
+		*dest = note;
+	}
+
+	return 1;
+}
+
+static void conv_init(Conv *conv)
+{
+	memset(conv, 0, sizeof(*conv));
+	conv->info.clock = YMZ280B_CLOCK_NOMINAL;
+	conv->info.fmt = FMT_ADPCM;
+	conv->info.effort = TRELLIS_EFFORT_GREEDY;
+	conv->info.tl = 0xFF;
+	conv->info.panpot = 0x08;
+	conv->info.loop = false;
+	conv->info.root_note = -1;
+	conv->info.key_low = -1;
+	conv->info.key_high = -1;
+	conv->alloc.order = ALLOC_IN_ORDER;
+	conv->alloc.limit = ALLOC_ADDRESS_LIMIT;
+	conv->roms.interleave = 1;
+	conv->roms.word = 1;
+	arena_init(&conv->arena);
+	strtab_init(&conv->strings, &conv->arena);
+}
+
+static void print_usage(const char *argv0)
+{
+	printf("Usage: %s [-j JOBS] [--cache DIR] [--stream] [--fast-split] [--plan]\n", argv0);
+	printf("       %*s [--arena-stats] [--pack] [--compact] CONFIG\n", (int)strlen(argv0), "");
+	printf("       %s bench WAV [NAME...]\n", argv0);
+	printf("       %s diff [--sector SIZE] [--base ADDRESS] [-o PATCH] OLD NEW\n", argv0);
+	printf("  -j JOBS      Number of conversion threads (default: CPU count)\n");
+	printf("  --cache DIR  Reuse conversion results stored in DIR (overrides the INI)\n");
+	printf("  --stream     Never hold a whole source in memory, keeping memory use\n");
+	printf("               independent of sample length; long entries aren't split,\n");
+	printf("               and entries with a search effort are still read whole\n");
+	printf("  --fast-split Run a single fix-up round on long ADPCM entries split across\n");
+	printf("               threads; the result may then differ from a serial encode\n");
+	printf("  --plan       Only read WAV headers and write the .inc, .h and .dat;\n");
+	printf("               no audio is decoded or encoded and the .ymz is left alone\n");
+	printf("  --arena-stats\n");
+	printf("               Report how much memory conversion allocated\n");
+	printf("  --pack       Let samples whose data is the start of another's play from\n");
+	printf("               its storage, with an earlier end address\n");
+	printf("  --compact    Lay samples out afresh, ignoring the INI's lock file, and\n");
+	printf("               rewrite it\n");
+}
+
+int main(int argc, char **argv)
+{
+	int ret = -1;
+	int jobs = pool_cpu_count();
+	const char *config_fname = NULL;
+	const char *cache_dir = NULL;
+	bool stream = false;
+	bool split_fast = false;
+	bool plan = false;
+	bool arena_stats = false;
+	bool pack = false;
+	bool compact = false;
+
+	if (argc >= 2 && strcmp(argv[1], "bench") == 0)
+	{
+		return bench_main(argc - 1, argv + 1);
+	}
+	if (argc >= 2 && strcmp(argv[1], "diff") == 0)
+	{
+		return diff_main(argc - 1, argv + 1);
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "-j", 2) == 0)
+		{
+			const char *arg = argv[i] + 2;
+			if (*arg == '\0')
+			{
+				if (i + 1 >= argc)
+				{
+					print_usage(argv[0]);
+					return -1;
+				}
+				arg = argv[++i];
+			}
+			jobs = strtol(arg, NULL, 0);
+			if (jobs < 1) jobs = 1;
+		}
+		else if (strcmp(argv[i], "--cache") == 0)
+		{
+			if (i + 1 >= argc)
+			{
+				print_usage(argv[0]);
+				return -1;
+			}
+			cache_dir = argv[++i];
+		}
+		else if (strcmp(argv[i], "--stream") == 0)
+		{
+			stream = true;
+		}
+		else if (strcmp(argv[i], "--fast-split") == 0)
+		{
+			split_fast = true;
+		}
+		else if (strcmp(argv[i], "--plan") == 0)
+		{
+			plan = true;
+		}
+		else if (strcmp(argv[i], "--arena-stats") == 0)
+		{
+			arena_stats = true;
+		}
+		else if (strcmp(argv[i], "--pack") == 0)
+		{
+			pack = true;
+		}
+		else if (strcmp(argv[i], "--compact") == 0)
+		{
+			compact = true;
+		}
+		else if (argv[i][0] == '-' || config_fname)
+		{
+			print_usage(argv[0]);
+			return -1;
+		}
+		else
+		{
+			config_fname = argv[i];
+		}
+	}
+
+	if (!config_fname)
+	{
+		print_usage(argv[0]);
+		return -1;
+	}
+
+	Conv conv;
+	conv_init(&conv);
+
+	// The INI handler only records entries; conversion happens afterwards.
+	ret = ini_parse(config_fname, &handler, &conv);
+	// TODO: handle INI parser error
+
+	conv.split_fast = split_fast;
+	conv.stream = stream;
+	conv.arena_stats = arena_stats;
+	conv.pack = pack;
+	conv.compact = compact;
+
+	const char *roms_problem = romset_params_problem(&conv.roms);
+	if (roms_problem)
+	{
+		fprintf(stderr, "[CONV] %s\n", roms_problem);
+		conv.roms.chip_size = 0;
+		if (ret == 0) ret = -1;
+	}
+
+	if (cache_dir)
+	{
+		strncpy(conv.cache_dir, cache_dir, sizeof(conv.cache_dir));
+		conv.cache_dir[sizeof(conv.cache_dir)-1] = '\0';
+	}
+	// Cache keys hash every source byte, which is more work than reading the
+	// headers a plan needs.
+	if (plan) conv.cache_dir[0] = '\0';
+
+	// Packing needs the encoded bytes, which a plan never has.
+	if (plan && conv.pack)
+	{
+		fprintf(stderr, "[PACK] --pack has no effect with --plan\n");
+		conv.pack = false;
+	}
+	// Nor has it a .ymz to put in objects.
+	if (plan && conv.object_ymz)
+	{
+		fprintf(stderr, "[ELF] object_ymz has no effect with --plan\n");
+		conv.object_ymz = false;
+	}
+	if (conv.object_host && !elfobj_supported(ELF_TARGET_HOST))
+	{
+		fprintf(stderr, "[ELF] This system's objects aren't ELF, or its machine is unknown\n");
+		conv.object_host = false;
+		if (ret == 0) ret = -1;
+	}
+
+	// Entries keep the addresses the lock file gives them, unless compacting.
+	// A lock file that can't be read is left as it is.
+	bool lock_ok = true;
+	if (conv.lock_fname && !conv.compact)
+	{
+		lock_ok = lockfile_read(conv.lock_fname, conv_lock_record, &conv);
+		if (!lock_ok && ret == 0) ret = -1;
+	}
+
+	if (!conv_probe_all(&conv, jobs) && ret == 0) ret = -1;
+	conv_share_payloads(&conv);
+	// When packing, addresses are only final once the payloads are encoded.
+	uint64_t ymz_bytes;
+	bool layout_ok = conv_layout(&conv, !conv.pack, &ymz_bytes);
+
+	// Now emit a pile of CHR data
+	char fname_buf[512];
+	char tmp_fname[1024];
+
+	// YMZ binary data. The layout above only needed the headers, so a plan
+	// stops short of decoding anything. It is written under a temporary name
+	// and renamed once complete, like the other outputs.
+	if (!plan)
+	{
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+		snprintf(fname_buf, sizeof(fname_buf), "%s.ymz", conv.out);
+		outbuf_temp_name(tmp_fname, sizeof(tmp_fname), fname_buf);
+		const int ymz_fd = open(tmp_fname, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0666);
+		if (ymz_fd < 0)
+		{
+			fprintf(stderr, "Couldn't open %s for writing\n", tmp_fname);
+			ret = -1;
+			goto done;
+		}
+		// Size the file up front; each entry then fills in its own slot as
+		// soon as it is encoded.
+		bool ymz_ok = file_preallocate(ymz_fd, ymz_bytes);
+		if (ymz_ok && !conv_convert_all(&conv, jobs, ymz_fd) && ret == 0) ret = -1;
+		if (ymz_ok && conv.pack) ymz_ok = conv_pack(&conv, ymz_fd, tmp_fname, ymz_bytes, &layout_ok);
+		if (close(ymz_fd) != 0) ymz_ok = false;
+		if (!ymz_ok || rename(tmp_fname, fname_buf) != 0)
+		{
+			fprintf(stderr, "Couldn't write %s\n", fname_buf);
+			remove(tmp_fname);
+			ret = -1;
+			goto done;
+		}
+
+		// ROM chip images, from one more pass over the .ymz while it is
+		// still in the page cache.
+		if (conv.roms.chip_size > 0)
+		{
+			MapFile map;
+			const bool mapped = mapfile_open(&map, fname_buf);
+			OutBuf manifest;
+			outbuf_init(&manifest);
+			snprintf(fname_buf, sizeof(fname_buf), "%s_roms.txt", conv.out);
+			if (!mapped && ymz_bytes > 0)
+			{
+				fprintf(stderr, "[ROM] Couldn't read back the .ymz\n");
+				ret = -1;
+			}
+			else if (!romset_write(&conv.roms, conv.out, map.data, map.size, conv.ymz_base, &manifest) ||
+			         manifest.failed || !outbuf_save(&manifest, fname_buf))
+			{
+				fprintf(stderr, "Couldn't write %s\n", fname_buf);
+				ret = -1;
+			}
+			outbuf_free(&manifest);
+			mapfile_close(&map);
+		}
+	}
+	if (!layout_ok && ret == 0) ret = -1;
+
+	OutBuf dat, inc, hdr, key;
+	outbuf_init(&dat);
+	outbuf_init(&inc);
+	outbuf_init(&hdr);
+	outbuf_init(&key);
+
+	// Replace slashes in name with underscores to make palette name
+	char *sym_buf = malloc(strlen(conv.out)+1);
+	strcpy(sym_buf, conv.out);
+	char *sym_buf_walk = sym_buf;
+	while (*sym_buf_walk)
+	{
+		if (*sym_buf_walk == '/') *sym_buf_walk = '_';
+		sym_buf_walk++;
+	}
+
+	outbuf_printf(&inc, "; ┌────────────────────────────────────────────────────────────────────────────┐\n");
+	outbuf_printf(&inc, "; │                                                                            │\n");
+	outbuf_printf(&inc, "; │                               YMZ280B DATA INDEX                           │\n");
+	outbuf_printf(&inc, "; │                                                                            │\n");
+	outbuf_printf(&inc, "; └────────────────────────────────────────────────────────────────────────────┘\n");
+	outbuf_printf(&inc, "\n");
+
+	outbuf_printf(&hdr, "#pragma once\n");
+	outbuf_printf(&hdr, "// ┌───────────────────────────────────────────────────────────────────────────┐\n");
+	outbuf_printf(&hdr, "// │                             YMZ280B CALL OFFSETS                          │\n");
+	outbuf_printf(&hdr, "// └───────────────────────────────────────────────────────────────────────────┘\n");
+	outbuf_printf(&hdr, "\n");
+
+	// The .ymz's first byte goes at this chip address; it isn't always 0.
+	char sym_upper_buf[256];
+	char *sym_upper = conv_upper(sym_buf, sym_upper_buf, sizeof(sym_upper_buf));
+	if (sym_upper)
+	{
+		outbuf_printf(&inc, "; Chip address of the .ymz's first byte.\n");
+		outbuf_printf(&inc, "%s_YMZ_BASE = $%06X\n", sym_upper, conv.ymz_base);
+		outbuf_printf(&inc, "\n");
+		outbuf_printf(&hdr, "// Chip address of the .ymz's first byte.\n");
+		outbuf_printf(&hdr, "#define %s_YMZ_BASE 0x%X\n", sym_upper, conv.ymz_base);
+		outbuf_printf(&hdr, "\n");
+		if (sym_upper != sym_upper_buf) free(sym_upper);
+	}
+	else
+	{
+		fprintf(stderr, "[CONV] Out of memory\n");
+		ret = -1;
+	}
+
+	// All the binary records at once; filled in below.
+	YmzDatRecord *rec = (YmzDatRecord *)outbuf_write(&dat, NULL, sizeof(*rec) * conv.entry_count);
+
+	uint32_t blob_bytes = 0;
 
-		fputc(reg01_bits, f_dat);  // key/fn8
-		fputc(reg00_bits, f_dat);  // fn
-		fputc(e->info.tl, f_dat);  // tl
-		fputc(e->info.panpot, f_dat);  // panpot
+	for (Entry *e = conv.entries; e < conv.entries + conv.entry_count; e++)
+	{
+		// Binary Data
 		const uint32_t start_address = e->start_address;
 		const uint32_t end_address = e->end_address;
 		const uint32_t loop_start = e->loop_start_address;
 		const uint32_t loop_end = e->loop_end_address;
-		fputc((start_address>>16) & 0xFF, f_dat);  // start 0 
-		fputc((start_address>>8) & 0xFF, f_dat);  // start 1
-		fputc(start_address & 0xFF, f_dat);  // start 2
-		// Always put loop info, even if it is derived from the start/end addresses
-		fputc((loop_start>>16) & 0xFF, f_dat);
-		fputc((loop_start>>8) & 0xFF, f_dat);
-		fputc(loop_start & 0xFF, f_dat);
-		fputc((loop_end>>16) & 0xFF, f_dat);
-		fputc((loop_end>>8) & 0xFF, f_dat);
-		fputc(loop_end & 0xFF, f_dat);
-		// end address
-		fputc((end_address>>16) & 0xFF, f_dat);
-		fputc((end_address>>8) & 0xFF, f_dat);
-		fputc(end_address & 0xFF, f_dat);
-
-		// Sixteen bytes written per blob entry.
+		if (rec)
+		{
+			rec->key = conv_entry_key(e, e->fn_reg);
+			rec->fn = e->fn_reg & 0xFF;
+			rec->tl = e->info.tl;
+			rec->pan = e->info.panpot;
+			ymzdat_put_address(rec->start_address, start_address);
+			// Always put loop info, even if it is derived from the start/end addresses
+			ymzdat_put_address(rec->loop_start_address, loop_start);
+			ymzdat_put_address(rec->loop_end_address, loop_end);
+			ymzdat_put_address(rec->end_address, end_address);
+			rec++;
+		}
 
 		// Write inc entry
-		fprintf(f_inc, "; Entry $%03X \"%s\"\n", e->id, e->info.symbol);
-		fprintf(f_inc, "%s_INDEX = $%04X\n", e->info.symbol_upper, e->id);
+		outbuf_printf(&inc, "; Entry $%03X \"%s\"\n", e->id, e->info.symbol);
+		outbuf_printf(&inc, "%s_INDEX = $%04X\n", e->info.symbol_upper, e->id);
 		blob_bytes += YMZ_BLOB_ENTRY_SIZE;
-		fprintf(f_inc, "%s_BLOB_OFFS = $%04X\n", e->info.symbol_upper, e->id*YMZ_BLOB_ENTRY_SIZE);
-		fprintf(f_inc, "%s_DATA_OFFS = $%05X\n", e->info.symbol_upper, e->info.data_offs);
-		fprintf(f_inc, "%s_SAMPLING_RATE = %d\n", e->info.symbol_upper, e->info.sample_rate);
-		fprintf(f_inc, "%s_FN_REG = $%02X\n", e->info.symbol_upper, e->fn_reg);
-		fprintf(f_inc, "%s_SAMPLES = $%05X\n", e->info.symbol_upper, e->length);
-		fprintf(f_inc, "%s_CHANNELS = $%05X\n", e->info.symbol_upper, e->channels-1);
-		fprintf(f_inc, "%s_START_ADDRESS = $%05X\n", e->info.symbol_upper, start_address);
-		fprintf(f_inc, "%s_END_ADDRESS = $%05X\n", e->info.symbol_upper, end_address);
+		outbuf_printf(&inc, "%s_BLOB_OFFS = $%04X\n", e->info.symbol_upper, e->id*YMZ_BLOB_ENTRY_SIZE);
+		outbuf_printf(&inc, "%s_DATA_OFFS = $%05X\n", e->info.symbol_upper, e->info.data_offs);
+		outbuf_printf(&inc, "%s_SAMPLING_RATE = %d\n", e->info.symbol_upper, e->info.sample_rate);
+		outbuf_printf(&inc, "%s_FN_REG = $%02X\n", e->info.symbol_upper, e->fn_reg);
+		outbuf_printf(&inc, "%s_SAMPLES = $%05X\n", e->info.symbol_upper, e->length);
+		outbuf_printf(&inc, "%s_CHANNELS = $%05X\n", e->info.symbol_upper, e->channels-1);
+		outbuf_printf(&inc, "%s_START_ADDRESS = $%05X\n", e->info.symbol_upper, start_address);
+		outbuf_printf(&inc, "%s_END_ADDRESS = $%05X\n", e->info.symbol_upper, end_address);
 		if (e->info.loop)
 		{
-			fprintf(f_inc, "%s_LOOP_START_ADDRESS = $%05X\n", e->info.symbol_upper, loop_start);
-			fprintf(f_inc, "%s_LOOP_END_ADDRESS = $%05X\n", e->info.symbol_upper, loop_end);
+			outbuf_printf(&inc, "%s_LOOP_START_ADDRESS = $%05X\n", e->info.symbol_upper, loop_start);
+			outbuf_printf(&inc, "%s_LOOP_END_ADDRESS = $%05X\n", e->info.symbol_upper, loop_end);
 		}
-		fprintf(f_inc, "\n");
+		outbuf_printf(&inc, "\n");
 
 		// Write header entry
-		fprintf(f_hdr, "#define %s_OFFS 0x%X\n", e->info.symbol_upper, e->id*YMZ_BLOB_ENTRY_SIZE);
+		outbuf_printf(&hdr, "#define %s_OFFS 0x%X\n", e->info.symbol_upper, e->id*YMZ_BLOB_ENTRY_SIZE);
 
 		// The header is more sparse, just referencing call IDs and predeclaring the blob.
-
-		// Pack YMZ data
-		fwrite(e->data, sizeof(uint8_t), e->data_bytes, f_ymz);
-		e = e->next;
 	}
 
-	fprintf(f_hdr, "\n");
-	fprintf(f_hdr, "// ┌───────────────────────────────────────────────────────────────────────────┐\n");
-	fprintf(f_hdr, "// │                   YMZ280B DATA BLOB FORWARD DECLARATION                   │\n");
-	fprintf(f_hdr, "// └───────────────────────────────────────────────────────────────────────────┘\n");
-	fprintf(f_hdr, "\n");
+	// Instruments' keymaps go in a blob of their own.
+	if (!conv_write_keymaps(&conv, &key, &inc, &hdr)) ret = -1;
+
+	outbuf_printf(&hdr, "\n");
+	outbuf_printf(&hdr, "// ┌───────────────────────────────────────────────────────────────────────────┐\n");
+	outbuf_printf(&hdr, "// │                   YMZ280B DATA BLOB FORWARD DECLARATION                   │\n");
+	outbuf_printf(&hdr, "// └───────────────────────────────────────────────────────────────────────────┘\n");
+	outbuf_printf(&hdr, "\n");
+
+	// Objects carrying the .ymz take it from the file just written.
+	MapFile ymz_map;
+	memset(&ymz_map, 0, sizeof(ymz_map));
+	if ((conv.object_m68k || conv.object_host) && conv.object_ymz && ymz_bytes > 0)
+	{
+		snprintf(fname_buf, sizeof(fname_buf), "%s.ymz", conv.out);
+		if (!mapfile_open(&ymz_map, fname_buf))
+		{
+			fprintf(stderr, "[ELF] Couldn't read back %s\n", fname_buf);
+			conv.object_ymz = false;
+			ret = -1;
+		}
+	}
 
 	// C forward declaration of the blob.
 	if (blob_bytes > 0)
 	{
-		// Replace slashes in name with underscores to make palette name
-		char *sym_buf = malloc(strlen(conv.out)+1);
-		strcpy(sym_buf, conv.out);
-		char *sym_buf_walk = sym_buf;
-		while (*sym_buf_walk)
+		outbuf_printf(&hdr, "// YMZdat block forward declaration.\n");
+		outbuf_printf(&hdr, "extern const uint8_t %s_dat[0x%X];\n", sym_buf, blob_bytes);
+		if (key.len > 0)
+		{
+			outbuf_printf(&hdr, "// YMZkey block forward declaration.\n");
+			outbuf_printf(&hdr, "extern const uint8_t %s_key[0x%X];\n", sym_buf, (unsigned int)key.len);
+		}
+		if ((conv.object_m68k || conv.object_host) && conv.object_ymz)
+		{
+			outbuf_printf(&hdr, "// YMZ280B sample data, in the objects only.\n");
+			outbuf_printf(&hdr, "extern const uint8_t %s_ymz[0x%X];\n", sym_buf, (unsigned int)ymz_map.size);
+		}
+	}
+	outbuf_printf(&hdr, "\n");
+
+	// DAT, INC assembly header and H C header, and keymaps if there are any
+	static const char *const out_ext[] = {"dat", "inc", "h", "key"};
+	const OutBuf *out_buf[] = {&dat, &inc, &hdr, &key};
+	for (int i = 0; i < (key.len > 0 ? 4 : 3); i++)
+	{
+		snprintf(fname_buf, sizeof(fname_buf), "%s.%s", conv.out, out_ext[i]);
+		if (!outbuf_save(out_buf[i], fname_buf))
+		{
+			fprintf(stderr, "Couldn't write %s\n", fname_buf);
+			ret = -1;
+		}
+	}
+
+	// Linkable objects holding the blobs the .h declares.
+	for (int t = 0; t < 2; t++)
+	{
+		const ElfTarget target = t ? ELF_TARGET_HOST : ELF_TARGET_M68K;
+		if (!(t ? conv.object_host : conv.object_m68k)) continue;
+		// Named as in the .h.
+		static const char *const blob_names[] = {"dat", "key", "ymz"};
+		const void *blob_data[] = {dat.data, key.data, ymz_map.data};
+		const size_t blob_len[] = {dat.len, key.len, ymz_map.size};
+		const bool blob_wanted[] = {true, key.len > 0, conv.object_ymz};
+		char symbols[3][300];
+		ElfBlob blobs[3];
+		int blob_count = 0;
+		for (int i = 0; i < 3 && blob_bytes > 0; i++)
+		{
+			if (!blob_wanted[i]) continue;
+			snprintf(symbols[i], sizeof(symbols[i]), "%s_%s", sym_buf, blob_names[i]);
+			blobs[blob_count].symbol = symbols[i];
+			blobs[blob_count].data = blob_data[i];
+			blobs[blob_count].size = blob_len[i];
+			blob_count++;
+		}
+
+		OutBuf obj;
+		outbuf_init(&obj);
+		elfobj_write(&obj, target, blobs, blob_count);
+		snprintf(fname_buf, sizeof(fname_buf), "%s_%s.o", conv.out, t ? "host" : "m68k");
+		if (obj.failed || !outbuf_save(&obj, fname_buf))
 		{
-			if (*sym_buf_walk == '/') *sym_buf_walk = '_';
-			sym_buf_walk++;
+			fprintf(stderr, "Couldn't write %s\n", fname_buf);
+			ret = -1;
 		}
+		outbuf_free(&obj);
+	}
+	mapfile_close(&ymz_map);
+	free(sym_buf);
 
-		fprintf(f_hdr, "// YMZdat block forward declaration.\n");
-		fprintf(f_hdr, "extern const uint8_t %s_dat[0x%X];\n", sym_buf, blob_bytes);
+	outbuf_free(&dat);
+	outbuf_free(&inc);
+	outbuf_free(&hdr);
+	outbuf_free(&key);
 
-		free(sym_buf);
+	// The lock file describes the .ymz, so a plan leaves it alone.
+	if (conv.lock_fname && !plan && layout_ok && lock_ok)
+	{
+		OutBuf lock;
+		outbuf_init(&lock);
+		lockfile_begin(&lock);
+		for (Entry *e = conv.entries; e < conv.entries + conv.entry_count; e++)
+		{
+			if (e->payload_of != e->id || e->data_bytes == 0) continue;
+			lockfile_put(&lock, e->info.symbol_upper, e->info.data_offs, e->data_bytes);
+		}
+		if (!outbuf_save(&lock, conv.lock_fname))
+		{
+			fprintf(stderr, "Couldn't write %s\n", conv.lock_fname);
+			ret = -1;
+		}
+		outbuf_free(&lock);
 	}
-	fprintf(f_hdr, "\n");
 
 done:
-	if (f_ymz) fclose(f_ymz);
-	if (f_dat) fclose(f_dat);
-	if (f_inc) fclose(f_inc);
-	if (f_hdr) fclose(f_hdr);
 	conv_shutdown(&conv);
 
 	return ret;
@@ -0,0 +1,65 @@
+#include "mapfile.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool mapfile_open(MapFile *m, const char *fname)
+{
+	memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+	(void)fname;
+	return false;
+#else
+	const int fd = open(fname, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+	    (unsigned long long)st.st_size > (size_t)-1)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping holds its own reference to the file.
+	close(fd);
+	if (data == MAP_FAILED) return false;
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	m->data = data;
+	m->size = st.st_size;
+	return true;
+#endif
+}
+
+void mapfile_release(MapFile *m, size_t offs)
+{
+#ifndef _WIN32
+	if (!m->data) return;
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	if (offs > m->size) offs = m->size;
+	offs -= offs % page;
+	if (offs <= m->released) return;
+	madvise((uint8_t *)m->data + m->released, offs - m->released, MADV_DONTNEED);
+	m->released = offs;
+#else
+	(void)m;
+	(void)offs;
+#endif
+}
+
+void mapfile_close(MapFile *m)
+{
+#ifndef _WIN32
+	if (m->data) munmap((void *)m->data, m->size);
+#endif
+	memset(m, 0, sizeof(*m));
+}
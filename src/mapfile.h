@@ -0,0 +1,27 @@
+#pragma once
+
+// Read-only memory mapping of a whole input file.
+//
+// Sources are mapped rather than read through stdio, so their bytes are
+// served from the page cache without being copied into private buffers.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct MapFile
+{
+	const void *data;
+	size_t size;
+	size_t released;  // Bytes before this have been dropped from memory.
+} MapFile;
+
+// Maps `fname`, hinting that it will be read front to back. Returns false,
+// leaving `m` empty, if the file can't be mapped; that includes empty files
+// and systems without mmap(), where callers fall back to reading it.
+bool mapfile_open(MapFile *m, const char *fname);
+
+// Drops the pages wholly before `offs` from this process's memory, for a
+// file read front to back. They are read back in if touched again.
+void mapfile_release(MapFile *m, size_t offs);
+
+void mapfile_close(MapFile *m);
@@ -0,0 +1,117 @@
+#include "outbuf.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+static atomic_uint s_tmp_counter;
+
+void outbuf_init(OutBuf *b)
+{
+	memset(b, 0, sizeof(*b));
+}
+
+void outbuf_free(OutBuf *b)
+{
+	free(b->data);
+	outbuf_init(b);
+}
+
+static bool outbuf_reserve(OutBuf *b, size_t len)
+{
+	if (b->failed) return false;
+	if (len <= b->cap - b->len) return true;
+
+	size_t cap = b->cap ? b->cap : 4096;
+	while (cap - b->len < len) cap *= 2;
+	uint8_t *data = realloc(b->data, cap);
+	if (!data)
+	{
+		fprintf(stderr, "[OUT] Couldn't allocate %zu bytes of output\n", cap);
+		b->failed = true;
+		return false;
+	}
+	b->data = data;
+	b->cap = cap;
+	return true;
+}
+
+uint8_t *outbuf_write(OutBuf *b, const void *data, size_t len)
+{
+	if (!outbuf_reserve(b, len)) return NULL;
+	uint8_t *p = b->data + b->len;
+	if (data) memcpy(p, data, len);
+	b->len += len;
+	return p;
+}
+
+void outbuf_printf(OutBuf *b, const char *fmt, ...)
+{
+	// Most lines fit in what's left; otherwise grow to the exact size and retry.
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		const size_t room = b->cap - b->len;
+		va_list ap;
+		va_start(ap, fmt);
+		const int n = vsnprintf(room ? (char *)b->data + b->len : NULL, room, fmt, ap);
+		va_end(ap);
+		if (n < 0)
+		{
+			b->failed = true;
+			return;
+		}
+		if ((size_t)n < room)
+		{
+			b->len += n;
+			return;
+		}
+		if (!outbuf_reserve(b, (size_t)n + 1)) return;
+	}
+}
+
+void outbuf_temp_name(char *buf, size_t size, const char *fname)
+{
+	snprintf(buf, size, "%s.%ld.%u.tmp", fname, (long)getpid(), atomic_fetch_add(&s_tmp_counter, 1));
+}
+
+bool outbuf_save(const OutBuf *b, const char *fname)
+{
+	if (b->failed) return false;
+
+	char tmp_fname[1024];
+	outbuf_temp_name(tmp_fname, sizeof(tmp_fname), fname);
+	const int fd = open(tmp_fname, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+	if (fd < 0) return false;
+
+	bool ok = true;
+	const uint8_t *p = b->data;
+	size_t len = b->len;
+	while (ok && len > 0)
+	{
+		const ssize_t wrote = write(fd, p, len);
+		if (wrote < 0 && errno == EINTR) continue;
+		if (wrote <= 0) ok = false;
+		else
+		{
+			p += wrote;
+			len -= wrote;
+		}
+	}
+	if (close(fd) != 0) ok = false;
+
+	// rename() replaces atomically, so readers see either the old file or the new one.
+	if (!ok || rename(tmp_fname, fname) != 0)
+	{
+		remove(tmp_fname);
+		return false;
+	}
+	return true;
+}
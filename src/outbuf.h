@@ -0,0 +1,37 @@
+#pragma once
+
+// Output files assembled in memory and put in place atomically.
+//
+// Each file is built up in an OutBuf, written out with a single write to a
+// temporary name beside the destination, and renamed over it. An interrupted
+// build leaves either the previous file or the new one, never half of one.
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct OutBuf
+{
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+	bool failed;  // An allocation failed; the contents are incomplete.
+} OutBuf;
+
+void outbuf_init(OutBuf *b);
+void outbuf_free(OutBuf *b);
+
+// Appends `len` bytes. Returns a pointer to them, to be filled in if `data`
+// is NULL, or NULL if the buffer couldn't grow.
+uint8_t *outbuf_write(OutBuf *b, const void *data, size_t len);
+
+void outbuf_printf(OutBuf *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Writes the buffer to `fname` via a temporary file. Returns false, leaving
+// any existing `fname` untouched, on failure.
+bool outbuf_save(const OutBuf *b, const char *fname);
+
+// Makes a temporary name beside `fname` for a file that will be renamed over
+// it, unique per process and call.
+void outbuf_temp_name(char *buf, size_t size, const char *fname);
@@ -0,0 +1,121 @@
+#include "pack.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+
+typedef struct PackJob
+{
+	const uint8_t *const *data;
+	const uint32_t *len;
+	int *host;
+
+	// Payloads that could get a host, by hash of the whole payload.
+	int *slots;  // Payload index; -1 is free.
+	uint64_t *hashes;
+	uint32_t slot_mask;
+} PackJob;
+
+// Whether payload `a` makes a better host than `b`: longer, or as long and
+// earlier.
+static bool pack_better(const PackJob *job, int a, int b)
+{
+	if (job->len[a] != job->len[b]) return job->len[a] > job->len[b];
+	return a < b;
+}
+
+static int pack_cmp_u32(const void *a, const void *b)
+{
+	const uint32_t x = *(const uint32_t *)a;
+	const uint32_t y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static uint32_t pack_slot(const PackJob *job, uint64_t hash)
+{
+	return (uint32_t)(hash ^ (hash >> 32)) & job->slot_mask;
+}
+
+// Offers payload `q` as host to every payload that its first `len` bytes,
+// hashing to `hash`, are all of.
+static void pack_offer(PackJob *job, int q, uint32_t len, uint64_t hash)
+{
+	for (uint32_t slot = pack_slot(job, hash); job->slots[slot] >= 0;
+	     slot = (slot + 1) & job->slot_mask)
+	{
+		const int p = job->slots[slot];
+		if (p == q || job->hashes[p] != hash || job->len[p] != len) continue;
+		if (!pack_better(job, q, p)) continue;
+		if (job->host[p] >= 0 && !pack_better(job, q, job->host[p])) continue;
+		if (memcmp(job->data[p], job->data[q], len) != 0) continue;
+		job->host[p] = q;
+	}
+}
+
+bool pack_find_prefixes(const uint8_t *const *data, const uint32_t *len, const bool *fixed,
+                        int count, int *host)
+{
+	for (int i = 0; i < count; i++) host[i] = -1;
+
+	PackJob job;
+	memset(&job, 0, sizeof(job));
+	job.data = data;
+	job.len = len;
+	job.host = host;
+
+	uint32_t cap = 16;
+	while (cap < (uint32_t)count * 2) cap *= 2;
+	job.slots = malloc(sizeof(*job.slots) * cap);
+	job.hashes = malloc(sizeof(*job.hashes) * (count ? count : 1));
+	uint32_t *lengths = malloc(sizeof(*lengths) * (count ? count : 1));
+	if (!job.slots || !job.hashes || !lengths)
+	{
+		free(job.slots);
+		free(job.hashes);
+		free(lengths);
+		return false;
+	}
+	job.slot_mask = cap - 1;
+	for (uint32_t i = 0; i < cap; i++) job.slots[i] = -1;
+
+	// Index every payload that could get a host, and note the lengths a
+	// prefix has to be hashed at.
+	int length_count = 0;
+	for (int p = 0; p < count; p++)
+	{
+		if (fixed[p] || len[p] == 0) continue;
+		job.hashes[p] = hash64(data[p], len[p], 0);
+		uint32_t slot = pack_slot(&job, job.hashes[p]);
+		while (job.slots[slot] >= 0) slot = (slot + 1) & job.slot_mask;
+		job.slots[slot] = p;
+		lengths[length_count++] = len[p];
+	}
+	qsort(lengths, length_count, sizeof(*lengths), pack_cmp_u32);
+	int distinct = 0;
+	for (int i = 0; i < length_count; i++)
+	{
+		if (distinct == 0 || lengths[distinct - 1] != lengths[i]) lengths[distinct++] = lengths[i];
+	}
+
+	// Hash each payload once from the start, checking its prefix at each of
+	// those lengths on the way.
+	for (int q = 0; q < count; q++)
+	{
+		if (len[q] == 0) continue;
+		Hash64 h;
+		hash64_init(&h, 0);
+		uint32_t pos = 0;
+		for (int i = 0; i < distinct && lengths[i] <= len[q]; i++)
+		{
+			hash64_update(&h, data[q] + pos, lengths[i] - pos);
+			pos = lengths[i];
+			pack_offer(&job, q, pos, hash64_final(&h));
+		}
+	}
+
+	free(job.slots);
+	free(job.hashes);
+	free(lengths);
+	return true;
+}
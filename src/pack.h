@@ -0,0 +1,22 @@
+#pragma once
+
+// Prefix sharing between encoded payloads.
+//
+// A payload that is a byte-exact prefix of a longer one can be played from
+// the longer one's storage with an earlier end address. Each payload is
+// hashed whole, and every payload is hashed incrementally, taking the hash of
+// its prefix at each payload length there is; a prefix whose hash matches a
+// whole payload of the same length is compared byte for byte. Each payload
+// is read through twice, however many others share a prefix with it.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// For each of `count` payloads, sets host[i] to a payload starting with all
+// of payload i, or to -1 if there is none. The host is the longest such
+// payload, the first of them if several are identical, so it never has a
+// host itself. Payloads with `fixed[i]` set can host but never get a host;
+// empty payloads take no part. Returns false if out of memory, with every
+// host[i] set to -1.
+bool pack_find_prefixes(const uint8_t *const *data, const uint32_t *len, const bool *fixed,
+                        int count, int *host);
@@ -0,0 +1,73 @@
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct PoolJob
+{
+	PoolFunc func;
+	void *user;
+	int count;
+	atomic_int next;  // Next unclaimed item index.
+} PoolJob;
+
+int pool_cpu_count(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n > 0) return (int)n;
+#endif
+	return 1;
+}
+
+static void *pool_worker(void *arg)
+{
+	PoolJob *job = (PoolJob *)arg;
+	while (true)
+	{
+		const int idx = atomic_fetch_add(&job->next, 1);
+		if (idx >= job->count) break;
+		job->func(job->user, idx);
+	}
+	return NULL;
+}
+
+void pool_run(int jobs, int count, PoolFunc func, void *user)
+{
+	if (count <= 0) return;
+	if (jobs > count) jobs = count;
+	if (jobs < 1) jobs = 1;
+
+	PoolJob job;
+	job.func = func;
+	job.user = user;
+	job.count = count;
+	atomic_init(&job.next, 0);
+
+	// The calling thread counts as one worker.
+	pthread_t *threads = NULL;
+	int spawned = 0;
+	if (jobs > 1)
+	{
+		threads = malloc(sizeof(*threads) * (jobs - 1));
+		for (int i = 0; threads && i < jobs - 1; i++)
+		{
+			if (pthread_create(&threads[i], NULL, pool_worker, &job) != 0)
+			{
+				fprintf(stderr, "[POOL] Couldn't start worker thread; continuing with %d\n",
+				        spawned + 1);
+				break;
+			}
+			spawned++;
+		}
+	}
+
+	pool_worker(&job);
+
+	for (int i = 0; i < spawned; i++) pthread_join(threads[i], NULL);
+	free(threads);
+}
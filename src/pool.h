@@ -0,0 +1,15 @@
+#pragma once
+
+// Minimal parallel-for over a fixed number of work items.
+
+#include <stdint.h>
+
+typedef void (*PoolFunc)(void *user, int idx);
+
+// Returns the number of online CPUs, or 1 if that can't be determined.
+int pool_cpu_count(void);
+
+// Calls func(user, i) for every i in [0, count), spread over up to `jobs`
+// threads (the calling thread included). Items are handed out in ascending
+// order, but may complete in any order. Returns once all items are done.
+void pool_run(int jobs, int count, PoolFunc func, void *user);
@@ -0,0 +1,133 @@
+#include "romset.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "checksum.h"
+
+// Bytes of each chip made at a time.
+#define ROMSET_CHUNK 0x10000
+
+const char *romset_params_problem(const RomSetParams *p)
+{
+	if (p->chip_size == 0) return NULL;
+	if ((p->chip_size & (p->chip_size - 1)) || p->chip_size > ALLOC_ADDRESS_LIMIT)
+	{
+		return "rom_chip_size must be a power of two, up to 16MiB";
+	}
+	if (p->interleave < 1 || p->interleave > 16) return "rom_interleave must be from 1 to 16";
+	if (p->word != 1 && p->word != 2) return "rom_word must be 1 or 2";
+	if (p->chip_size < (uint32_t)p->word) return "rom_chip_size is smaller than rom_word";
+	return NULL;
+}
+
+// Fills `buf` with the `n` bytes from address `addr`.
+static void romset_fetch(uint8_t *buf, uint32_t n, uint64_t addr, const uint8_t *data, uint64_t len,
+                         uint32_t base)
+{
+	memset(buf, 0, n);
+	const uint64_t lo = (addr > base) ? addr : base;
+	const uint64_t hi = (addr + n < base + len) ? addr + n : base + len;
+	if (lo < hi) memcpy(buf + (lo - addr), data + (lo - base), hi - lo);
+}
+
+bool romset_write(const RomSetParams *p, const char *out, const uint8_t *data, uint64_t len,
+                  uint32_t base, OutBuf *manifest)
+{
+	const int interleave = p->interleave;
+	const int word = p->word;
+	const uint64_t bank_size = (uint64_t)p->chip_size * interleave;
+	uint64_t cover = p->size;
+	if (cover < base + len) cover = base + len;
+	const uint64_t banks = (cover + bank_size - 1) / bank_size;
+	const uint32_t chunk = (p->chip_size < ROMSET_CHUNK) ? p->chip_size : ROMSET_CHUNK;
+
+	uint8_t *src = malloc((size_t)chunk * interleave);
+	OutBuf *chips = malloc(sizeof(*chips) * interleave);
+	uint8_t **dst = malloc(sizeof(*dst) * interleave);
+	Sha1 *sha = malloc(sizeof(*sha) * interleave);
+	uint32_t *crc = malloc(sizeof(*crc) * interleave);
+	if (!src || !chips || !dst || !sha || !crc)
+	{
+		fprintf(stderr, "[ROM] Out of memory\n");
+		free(src);
+		free(chips);
+		free(dst);
+		free(sha);
+		free(crc);
+		return false;
+	}
+
+	const char *slash = strrchr(out, '/');
+	const char *out_name = slash ? slash + 1 : out;
+	outbuf_printf(manifest, "; FILE SIZE CRC32 SHA1\n");
+
+	bool ok = true;
+	for (uint64_t bank = 0; bank < banks && ok; bank++)
+	{
+		for (int c = 0; c < interleave; c++)
+		{
+			outbuf_init(&chips[c]);
+			sha1_init(&sha[c]);
+			crc[c] = 0;
+		}
+
+		// One pass over the bank's addresses, dealing each unit to its chip.
+		for (uint64_t offs = 0; offs < p->chip_size && ok; offs += chunk)
+		{
+			romset_fetch(src, chunk * interleave, bank * bank_size + offs * interleave, data, len, base);
+			for (int c = 0; c < interleave; c++)
+			{
+				dst[c] = outbuf_write(&chips[c], NULL, chunk);
+				if (!dst[c]) ok = false;
+			}
+			if (!ok) break;
+			const uint8_t *s = src;
+			for (uint32_t pos = 0; pos < chunk; pos += word)
+			{
+				for (int c = 0; c < interleave; c++)
+				{
+					dst[c][pos] = *s++;
+					if (word == 2) dst[c][pos + 1] = *s++;
+				}
+			}
+			for (int c = 0; c < interleave; c++)
+			{
+				crc[c] = crc32_update(crc[c], dst[c], chunk);
+				sha1_update(&sha[c], dst[c], chunk);
+			}
+		}
+
+		for (int c = 0; c < interleave; c++)
+		{
+			const unsigned long long n = bank * interleave + c;
+			char fname[512];
+			snprintf(fname, sizeof(fname), "%s_rom%llu.bin", out, n);
+			if (!ok || chips[c].failed || !outbuf_save(&chips[c], fname))
+			{
+				fprintf(stderr, "[ROM] Couldn't write %s\n", fname);
+				ok = false;
+			}
+			uint8_t digest[20];
+			sha1_final(&sha[c], digest);
+			outbuf_printf(manifest, "%s_rom%llu.bin %u %08x ", out_name, n, p->chip_size, crc[c]);
+			for (int i = 0; i < 20; i++) outbuf_printf(manifest, "%02x", digest[i]);
+			outbuf_printf(manifest, "\n");
+			outbuf_free(&chips[c]);
+		}
+	}
+	if (ok)
+	{
+		printf("[ROM] %llu chips of $%X bytes, %d to a bank\n", (unsigned long long)(banks * interleave),
+		       p->chip_size, interleave);
+	}
+
+	free(src);
+	free(chips);
+	free(dst);
+	free(sha);
+	free(crc);
+	return ok;
+}
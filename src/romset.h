@@ -0,0 +1,32 @@
+#pragma once
+
+// Sample data split across ROM chips.
+//
+// Boards hold the chip's address space in a set of same-sized ROMs. Banks
+// of `interleave` chips each cover `chip_size * interleave` addresses, one
+// after another; within a bank, successive `word`-byte units go to its chips
+// in turn. Every chip image is written whole, with a CRC-32 and SHA-1 of it
+// worked out on the way.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "outbuf.h"
+
+typedef struct RomSetParams
+{
+	uint32_t chip_size;  // A power of two; 0 if no chips are wanted.
+	int interleave;      // Chips in each bank.
+	int word;            // Bytes per unit: 1 or 2.
+	uint32_t size;       // Addresses to cover; 0 to cover the data's end.
+} RomSetParams;
+
+// Problem with the parameters, or NULL if there is none.
+const char *romset_params_problem(const RomSetParams *p);
+
+// Writes chip images <out>_romN.bin, N from 0, holding `len` bytes of
+// `data` from address `base` and zeros everywhere else, and lists them in
+// `manifest` as FILE SIZE CRC32 SHA1. Returns false, having said why, if a
+// chip couldn't be written.
+bool romset_write(const RomSetParams *p, const char *out, const uint8_t *data, uint64_t len,
+                  uint32_t base, OutBuf *manifest);
@@ -0,0 +1,200 @@
+#include "segenc.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+#include "3rdparty/adpcm/ymz_codec.h"
+
+// Samples between recorded encoder states. The fix-up pass compares states at
+// this granularity, so it bounds how far past the meeting point it re-encodes.
+// Must be even, so every checkpoint falls on a byte boundary.
+#define SEGENC_CHECKPOINT 256
+
+typedef struct SegEncState
+{
+	int16_t history;
+	int16_t step_size;
+} SegEncState;
+
+typedef struct SegEncJob
+{
+	const int16_t *pcm;
+	uint8_t *out;
+	long len;
+	long seg_len;             // Samples per segment; even. The last one may be shorter.
+	int segments;
+	SegEncState *start;       // State each segment was encoded from.
+	SegEncState *end;         // State each segment ends in, as of the last round.
+	SegEncState *checkpoint;  // State after each checkpoint, per segment.
+	int checkpoints;          // Checkpoints per segment (stride of `checkpoint`).
+	int *pending;             // Segments to fix up this round.
+	atomic_long fixup_samples;
+} SegEncJob;
+
+static SegEncState segenc_state(const ymz_encoder *enc)
+{
+	SegEncState st = {enc->history, enc->step_size};
+	return st;
+}
+
+static bool segenc_state_eq(SegEncState a, SegEncState b)
+{
+	return a.history == b.history && a.step_size == b.step_size;
+}
+
+static long segenc_end(const SegEncJob *job, int idx)
+{
+	const long end = (idx + 1) * job->seg_len;
+	return end < job->len ? end : job->len;
+}
+
+// The state segment `idx` was recorded to end in.
+static SegEncState segenc_end_state(const SegEncJob *job, int idx)
+{
+	const long samples = segenc_end(job, idx) - idx * job->seg_len;
+	return job->checkpoint[(long)idx * job->checkpoints + (samples - 1) / SEGENC_CHECKPOINT];
+}
+
+static void segenc_segment_job(void *user, int idx)
+{
+	SegEncJob *job = (SegEncJob *)user;
+	const long start = idx * job->seg_len;
+	const long end = segenc_end(job, idx);
+
+	ymz_encoder enc;
+	ymz_encoder_init(&enc);
+
+	// Warm up on the samples in front of the segment. Near the start of the
+	// sample this covers everything before it, making the estimate exact.
+	long warm = start - SEGENC_WARMUP;
+	if (warm < 0) warm = 0;
+	uint8_t scratch[SEGENC_CHECKPOINT / 2];
+	while (warm < start)
+	{
+		const long n = start - warm < SEGENC_CHECKPOINT ? start - warm : SEGENC_CHECKPOINT;
+		ymz_encoder_run(&enc, job->pcm + warm, scratch, n);
+		warm += n;
+	}
+	job->start[idx] = segenc_state(&enc);
+
+	SegEncState *cp = job->checkpoint + (long)idx * job->checkpoints;
+	for (long pos = start; pos < end; pos += SEGENC_CHECKPOINT)
+	{
+		const long n = end - pos < SEGENC_CHECKPOINT ? end - pos : SEGENC_CHECKPOINT;
+		ymz_encoder_run(&enc, job->pcm + pos, job->out + pos / 2, n);
+		*cp++ = segenc_state(&enc);
+	}
+}
+
+// Re-encodes the head of segment `idx` from the state the previous segment
+// ended in, until it meets the recorded states. Checkpoints passed on the way
+// are rewritten, so they always describe what is in the output buffer.
+static void segenc_fixup_job(void *user, int idx)
+{
+	SegEncJob *job = (SegEncJob *)user;
+	idx = job->pending[idx];
+	const long start = idx * job->seg_len;
+	const long end = segenc_end(job, idx);
+
+	const SegEncState real = job->end[idx - 1];
+	job->start[idx] = real;
+
+	ymz_encoder enc;
+	ymz_encoder_init(&enc);
+	enc.history = real.history;
+	enc.step_size = real.step_size;
+
+	SegEncState *cp = job->checkpoint + (long)idx * job->checkpoints;
+	long samples = 0;
+	for (long pos = start; pos < end; pos += SEGENC_CHECKPOINT, cp++)
+	{
+		const long n = end - pos < SEGENC_CHECKPOINT ? end - pos : SEGENC_CHECKPOINT;
+		ymz_encoder_run(&enc, job->pcm + pos, job->out + pos / 2, n);
+		samples += n;
+		const SegEncState st = segenc_state(&enc);
+		// Once the runs meet, the recorded output and states from here on stand.
+		if (segenc_state_eq(st, *cp)) break;
+		*cp = st;
+	}
+	atomic_fetch_add(&job->fixup_samples, samples);
+}
+
+void segenc_encode(const int16_t *pcm, uint8_t *out, long len, int jobs, bool fast,
+                   SegEncStats *stats)
+{
+	SegEncStats local;
+	if (!stats) stats = &local;
+	memset(stats, 0, sizeof(*stats));
+
+	// A few segments per thread evens out threads that start late.
+	long segments = len / SEGENC_MIN_SEGMENT;
+	if (segments > (long)jobs * 4) segments = (long)jobs * 4;
+	if (jobs <= 1 || segments <= 1)
+	{
+		stats->segments = 1;
+		ymz_encode((int16_t *)pcm, out, len);
+		return;
+	}
+
+	SegEncJob job;
+	job.pcm = pcm;
+	job.out = out;
+	job.len = len;
+	job.seg_len = ((len + segments - 1) / segments + 1) & ~1L;
+	job.segments = (int)((len + job.seg_len - 1) / job.seg_len);
+	job.checkpoints = (int)((job.seg_len + SEGENC_CHECKPOINT - 1) / SEGENC_CHECKPOINT);
+	job.start = malloc(sizeof(*job.start) * job.segments);
+	job.end = malloc(sizeof(*job.end) * job.segments);
+	job.pending = malloc(sizeof(*job.pending) * job.segments);
+	job.checkpoint = malloc(sizeof(*job.checkpoint) * job.segments * job.checkpoints);
+	atomic_init(&job.fixup_samples, 0);
+	if (!job.start || !job.end || !job.pending || !job.checkpoint)
+	{
+		fprintf(stderr, "[SEGENC] Couldn't allocate segment state; encoding serially\n");
+		stats->segments = 1;
+		ymz_encode((int16_t *)pcm, out, len);
+		goto done;
+	}
+	stats->segments = job.segments;
+
+	pool_run(jobs, job.segments, segenc_segment_job, &job);
+
+	// The first round fixes up every segment that started from the wrong
+	// state, all at once. A segment whose head never meets the recorded run
+	// changes its end state, so the one after it is still wrong afterwards.
+	// Only the first of those is known to follow correct data, so later
+	// rounds take one segment at a time; that keeps the worst case, where
+	// runs never meet, at about twice the work of a serial encode.
+	while (true)
+	{
+		int pending = 0;
+		for (int i = 0; i < job.segments; i++)
+		{
+			job.end[i] = segenc_end_state(&job, i);
+			if (i > 0 && !segenc_state_eq(job.end[i - 1], job.start[i])) job.pending[pending++] = i;
+		}
+		if (pending == 0) break;
+		if (stats->rounds > 0)
+		{
+			if (fast)
+			{
+				stats->inexact = pending;
+				break;
+			}
+			pending = 1;
+		}
+		stats->fixups += pending;
+		stats->rounds++;
+		pool_run(jobs, pending, segenc_fixup_job, &job);
+	}
+	stats->fixup_samples = atomic_load(&job.fixup_samples);
+
+done:
+	free(job.start);
+	free(job.end);
+	free(job.pending);
+	free(job.checkpoint);
+}
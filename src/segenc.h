@@ -0,0 +1,42 @@
+#pragma once
+
+// Segment-parallel YMZ280B ADPCM encoding of a single long sample.
+//
+// The sample is cut into segments that are encoded concurrently. Each segment
+// after the first starts from an estimated encoder state, found by running
+// the encoder over the SEGENC_WARMUP samples in front of it. Fix-up rounds
+// then re-encode the head of every segment whose estimate differs from the
+// state the previous segment ended in, until the two runs meet again. From
+// that point on the encoder is deterministic, so the rest of the segment is
+// already correct. Rounds repeat until every segment starts from the state its
+// predecessor ends in, and the output is identical to ymz_encode().
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Samples encoded ahead of a segment to estimate its start state.
+#define SEGENC_WARMUP 4096
+
+// Shortest segment worth handing to its own thread.
+#define SEGENC_MIN_SEGMENT 65536
+
+typedef struct SegEncStats
+{
+	int segments;
+	int rounds;          // Fix-up rounds run.
+	int fixups;          // Segment heads re-encoded, over all rounds.
+	long fixup_samples;  // Samples re-encoded by the fix-up rounds.
+	int inexact;         // Segments left starting from the wrong state (`fast` only).
+} SegEncStats;
+
+// Encodes `len` samples like ymz_encode(), using up to `jobs` threads.
+// `out` needs room for len/2 bytes; a trailing odd nibble is dropped.
+//
+// With `fast` set only one fix-up round is run. The output then still matches
+// ymz_encode() unless the head of some segment never met the recorded run over
+// that segment's whole length. The segment after each such one is left
+// encoded from the wrong start state and differs from a serial encode up to
+// the point where the states meet; stats->inexact counts them, and
+// `ymztool bench WAV adpcm_segment` reports the decoded error.
+void segenc_encode(const int16_t *pcm, uint8_t *out, long len, int jobs, bool fast,
+                   SegEncStats *stats);
@@ -0,0 +1,87 @@
+#include "strtab.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+
+void strtab_init(StrTab *t, Arena *arena)
+{
+	memset(t, 0, sizeof(*t));
+	t->arena = arena;
+}
+
+void strtab_free(StrTab *t)
+{
+	free(t->strs);
+	free(t->hashes);
+	free(t->index);
+	memset(t, 0, sizeof(*t));
+}
+
+// The index slot holding `str`, or the free slot it would go in.
+static uint32_t strtab_slot(const StrTab *t, const char *str, uint64_t hash)
+{
+	uint32_t slot = hash & t->index_mask;
+	while (t->index[slot] != 0)
+	{
+		const uint32_t id = t->index[slot] - 1;
+		if (t->hashes[id] == hash && strcmp(t->strs[id], str) == 0) break;
+		slot = (slot + 1) & t->index_mask;
+	}
+	return slot;
+}
+
+// Grows the id arrays, and the index so that it stays at most half full.
+static bool strtab_grow(StrTab *t)
+{
+	const uint32_t cap = t->cap ? t->cap * 2 : 64;
+	const char **strs = realloc(t->strs, sizeof(*strs) * cap);
+	if (!strs) return false;
+	t->strs = strs;
+	uint64_t *hashes = realloc(t->hashes, sizeof(*hashes) * cap);
+	if (!hashes) return false;
+	t->hashes = hashes;
+
+	uint32_t *index = calloc((size_t)cap * 2, sizeof(*index));
+	if (!index) return false;
+	free(t->index);
+	t->index = index;
+	t->index_mask = cap * 2 - 1;
+	t->cap = cap;
+	for (uint32_t id = 0; id < t->count; id++)
+	{
+		t->index[strtab_slot(t, t->strs[id], t->hashes[id])] = id + 1;
+	}
+	return true;
+}
+
+uint32_t strtab_intern(StrTab *t, const char *str)
+{
+	const size_t len = strlen(str);
+	const uint64_t hash = hash64(str, len, 0);
+	if (t->count > 0)
+	{
+		const uint32_t slot = strtab_slot(t, str, hash);
+		if (t->index[slot] != 0) return t->index[slot] - 1;
+	}
+	if (t->count == t->cap && !strtab_grow(t)) return STRTAB_NONE;
+
+	char *text = arena_alloc(t->arena, len + 1);
+	if (!text) return STRTAB_NONE;
+	memcpy(text, str, len + 1);
+
+	const uint32_t id = t->count++;
+	t->strs[id] = text;
+	t->hashes[id] = hash;
+	t->index[strtab_slot(t, text, hash)] = id + 1;
+	return id;
+}
+
+uint32_t strtab_find(const StrTab *t, const char *str)
+{
+	if (t->count == 0) return STRTAB_NONE;
+	const uint32_t slot = strtab_slot(t, str, hash64(str, strlen(str), 0));
+	return t->index[slot] != 0 ? t->index[slot] - 1 : STRTAB_NONE;
+}
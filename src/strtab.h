@@ -0,0 +1,44 @@
+#pragma once
+
+// Interned strings.
+//
+// Each distinct string is stored once and given a small id, in the order
+// first seen. Looking a string up hashes it once, so finding whether it has
+// been seen, and under which id, doesn't depend on how many there are. The
+// text lives in an arena and never moves, so pointers to it stay valid as
+// the table grows, and two interned strings are equal exactly when their
+// pointers are.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+#define STRTAB_NONE UINT32_MAX
+
+typedef struct StrTab
+{
+	Arena *arena;       // Holds the text.
+	const char **strs;  // By id.
+	uint64_t *hashes;   // By id.
+	uint32_t count;
+	uint32_t cap;
+	uint32_t *index;    // Open-addressed by hash: id + 1, or 0 if free.
+	uint32_t index_mask;
+} StrTab;
+
+void strtab_init(StrTab *t, Arena *arena);
+
+// Frees the table's index; the text goes with the arena.
+void strtab_free(StrTab *t);
+
+// Returns the id of `str`, adding it if new, or STRTAB_NONE if out of memory.
+uint32_t strtab_intern(StrTab *t, const char *str);
+
+// Returns the id of `str`, or STRTAB_NONE if it was never interned.
+uint32_t strtab_find(const StrTab *t, const char *str);
+
+static inline const char *strtab_str(const StrTab *t, uint32_t id)
+{
+	return t->strs[id];
+}
@@ -0,0 +1,586 @@
+#include "trellis.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+#include "segenc.h"
+#include "3rdparty/adpcm/ymz_codec.h"
+
+// Search settings behind the effort levels. The beam buys most of the
+// quality; lookahead-N widens it along with the lookahead, 4 paths per sample
+// of lookahead, so each step up the scale costs more and sounds better.
+#define TRELLIS_BRANCH 3
+#define TRELLIS_FULL_BEAM 512
+#define TRELLIS_FULL_BLOCK 256
+#define TRELLIS_LOOKAHEAD_BEAM_PER 4
+#define TRELLIS_LOOKAHEAD_BEAM_MAX 256
+#define TRELLIS_LOOKAHEAD_MAX 4096
+
+// Samples searched ahead of a segment to estimate its start state.
+#define TRELLIS_WARMUP 2048
+
+// Samples between recorded states along the output. Joins are looked for at
+// this granularity. Must be even.
+#define TRELLIS_CHECKPOINT 16
+
+#define TRELLIS_DEAD UINT64_MAX
+
+typedef struct TrellisState
+{
+	int16_t history;
+	int16_t step_size;
+} TrellisState;
+
+// Where a survivor came from: its slot one sample earlier, and the code taken.
+typedef struct TrellisLink
+{
+	uint16_t parent;
+	uint8_t code;
+} TrellisLink;
+
+typedef struct TrellisCand
+{
+	uint64_t cost;
+	int32_t history;
+	int32_t step_size;
+	uint16_t parent;
+	uint8_t code;
+} TrellisCand;
+
+// The surviving paths at one sample, one slot each.
+typedef struct TrellisSlots
+{
+	uint64_t *cost;   // TRELLIS_DEAD for unused slots.
+	int32_t *history;
+	int32_t *step_size;
+	uint16_t *tag;    // Slot of this path's ancestor at the end of the first block.
+} TrellisSlots;
+
+// One search in progress. Decisions are committed a block at a time, once the
+// search has reached the end of the following block.
+typedef struct Trellis
+{
+	int beam;    // Survivors kept per sample.
+	int branch;  // Codes tried per survivor, nearest to the source first.
+	int block;
+
+	const int16_t *pcm;
+	uint8_t *out;              // NULL while only estimating a state.
+	long out_samples;          // Samples with room in `out` (even).
+	TrellisState *checkpoint;  // State at every TRELLIS_CHECKPOINT'th sample of the output.
+
+	long committed;            // Samples before this are settled.
+	TrellisState base;         // State at `committed`.
+	int rows;                  // Samples searched past `committed`.
+	TrellisSlots cur, next;
+	TrellisLink *links;        // 2*block rows of `beam` links.
+	TrellisCand *cand;
+	uint8_t *codes;            // Traceback scratch, 2*block codes.
+	uint32_t *table;           // State -> candidate, for merging paths.
+	uint32_t *table_gen;
+	uint32_t table_mask;
+	int table_shift;           // Keeps the top bits of the hash.
+	uint32_t gen;
+} Trellis;
+
+bool trellis_parse_effort(const char *value, int *effort)
+{
+	if (strcmp(value, "greedy") == 0)
+	{
+		*effort = TRELLIS_EFFORT_GREEDY;
+		return true;
+	}
+	if (strcmp(value, "trellis") == 0)
+	{
+		*effort = TRELLIS_EFFORT_FULL;
+		return true;
+	}
+	if (strncmp(value, "lookahead-", 10) == 0)
+	{
+		char *end;
+		const long n = strtol(value + 10, &end, 10);
+		if (*end != '\0' || n < 1 || n > TRELLIS_LOOKAHEAD_MAX) return false;
+		*effort = (int)n;
+		return true;
+	}
+	return false;
+}
+
+const char *trellis_effort_name(int effort, char *buf, size_t size)
+{
+	if (effort == TRELLIS_EFFORT_GREEDY) snprintf(buf, size, "greedy");
+	else if (effort == TRELLIS_EFFORT_FULL) snprintf(buf, size, "trellis");
+	else snprintf(buf, size, "lookahead-%d", effort);
+	return buf;
+}
+
+static void trellis_free(Trellis *tr)
+{
+	free(tr->cur.cost);
+	free(tr->next.cost);
+	free(tr->links);
+	free(tr->cand);
+	free(tr->codes);
+	free(tr->table);
+	free(tr->table_gen);
+}
+
+static bool trellis_slots_alloc(TrellisSlots *slots, int beam)
+{
+	// One allocation per set of slots; cost is first and most aligned.
+	const size_t bytes = (sizeof(uint64_t) + 2 * sizeof(int32_t) + sizeof(uint16_t)) * beam;
+	uint8_t *p = malloc(bytes);
+	if (!p) return false;
+	slots->cost = (uint64_t *)p;
+	slots->history = (int32_t *)(slots->cost + beam);
+	slots->step_size = slots->history + beam;
+	slots->tag = (uint16_t *)(slots->step_size + beam);
+	return true;
+}
+
+static bool trellis_init(Trellis *tr, int effort, const int16_t *pcm)
+{
+	memset(tr, 0, sizeof(*tr));
+	tr->branch = TRELLIS_BRANCH;
+	if (effort == TRELLIS_EFFORT_FULL)
+	{
+		tr->beam = TRELLIS_FULL_BEAM;
+		tr->block = TRELLIS_FULL_BLOCK;
+	}
+	else
+	{
+		tr->beam = effort < TRELLIS_LOOKAHEAD_BEAM_MAX / TRELLIS_LOOKAHEAD_BEAM_PER ?
+		           effort * TRELLIS_LOOKAHEAD_BEAM_PER : TRELLIS_LOOKAHEAD_BEAM_MAX;
+		tr->block = (effort + 1) & ~1;
+	}
+	tr->pcm = pcm;
+
+	const int cands = tr->beam * tr->branch;
+	uint32_t table_size = 1;
+	tr->table_shift = 32;
+	while (table_size < 2u * cands)
+	{
+		table_size <<= 1;
+		tr->table_shift--;
+	}
+	tr->table_mask = table_size - 1;
+
+	const bool ok = trellis_slots_alloc(&tr->cur, tr->beam) &&
+	                trellis_slots_alloc(&tr->next, tr->beam) &&
+	                (tr->links = malloc(sizeof(*tr->links) * 2 * tr->block * tr->beam)) &&
+	                (tr->cand = malloc(sizeof(*tr->cand) * cands)) &&
+	                (tr->codes = malloc(2 * tr->block)) &&
+	                (tr->table = malloc(sizeof(*tr->table) * table_size)) &&
+	                (tr->table_gen = calloc(table_size, sizeof(*tr->table_gen)));
+	if (!ok)
+	{
+		fprintf(stderr, "[TRELLIS] Couldn't allocate search state\n");
+		trellis_free(tr);
+	}
+	return ok;
+}
+
+// Starts searching at `pos` from a single known state.
+static void trellis_reset(Trellis *tr, long pos, TrellisState start)
+{
+	tr->committed = pos;
+	tr->base = start;
+	tr->rows = 0;
+	for (int i = 0; i < tr->beam; i++) tr->cur.cost[i] = TRELLIS_DEAD;
+	tr->cur.cost[0] = 0;
+	tr->cur.history[0] = start.history;
+	tr->cur.step_size[0] = start.step_size;
+	tr->cur.tag[0] = 0;
+}
+
+static int trellis_best(const Trellis *tr)
+{
+	int best = 0;
+	for (int i = 1; i < tr->beam; i++)
+	{
+		if (tr->cur.cost[i] < tr->cur.cost[best]) best = i;
+	}
+	return best;
+}
+
+// Moves the `count` cheapest candidates to the front (quickselect).
+static void trellis_select(TrellisCand *cand, int n, int count)
+{
+	int lo = 0, hi = n - 1;
+	while (lo < hi)
+	{
+		const uint64_t pivot = cand[(lo + hi) / 2].cost;
+		int i = lo, j = hi;
+		while (i <= j)
+		{
+			while (cand[i].cost < pivot) i++;
+			while (cand[j].cost > pivot) j--;
+			if (i <= j)
+			{
+				const TrellisCand t = cand[i];
+				cand[i++] = cand[j];
+				cand[j--] = t;
+			}
+		}
+		if (count - 1 <= j) hi = j;
+		else if (count - 1 >= i) lo = i;
+		else break;
+	}
+}
+
+// Extends every surviving path by one sample.
+static void trellis_step(Trellis *tr)
+{
+	const int target = tr->pcm[tr->committed + tr->rows];
+	int n = 0;
+
+	if (++tr->gen == 0)
+	{
+		memset(tr->table_gen, 0, sizeof(*tr->table_gen) * (tr->table_mask + 1));
+		tr->gen = 1;
+	}
+
+	for (int s = 0; s < tr->beam; s++)
+	{
+		const uint64_t cost = tr->cur.cost[s];
+		if (cost == TRELLIS_DEAD) continue;
+
+		// Try every code, keeping the `branch` nearest to the source.
+		TrellisCand local[16];
+		int kept = 0;
+		for (unsigned int code = 0; code < 16; code++)
+		{
+			int history = tr->cur.history[s];
+			int step_size = tr->cur.step_size[s];
+			const int err = ymz_step(code, &history, &step_size) - target;
+			TrellisCand c;
+			c.cost = cost + (uint64_t)((int64_t)err * err);
+			c.history = history;
+			c.step_size = step_size;
+			c.parent = s;
+			c.code = code;
+
+			int at = kept < tr->branch ? kept++ : tr->branch;
+			if (at == tr->branch && c.cost >= local[at - 1].cost) continue;
+			if (at == tr->branch) at--;
+			while (at > 0 && local[at - 1].cost > c.cost)
+			{
+				local[at] = local[at - 1];
+				at--;
+			}
+			local[at] = c;
+		}
+
+		// Paths reaching the same state have the same future; keep the cheaper.
+		for (int i = 0; i < kept; i++)
+		{
+			const TrellisCand *c = &local[i];
+			const uint32_t key = (uint32_t)(uint16_t)c->history << 16 | (uint32_t)c->step_size;
+			uint32_t h = (key * 0x9E3779B1u) >> tr->table_shift;
+			while (true)
+			{
+				h &= tr->table_mask;
+				if (tr->table_gen[h] != tr->gen)
+				{
+					tr->table_gen[h] = tr->gen;
+					tr->table[h] = n;
+					tr->cand[n++] = *c;
+					break;
+				}
+				TrellisCand *o = &tr->cand[tr->table[h]];
+				if (o->history == c->history && o->step_size == c->step_size)
+				{
+					if (c->cost < o->cost) *o = *c;
+					break;
+				}
+				h++;
+			}
+		}
+	}
+
+	if (n > tr->beam) trellis_select(tr->cand, n, tr->beam);
+	if (n > tr->beam) n = tr->beam;
+
+	const int row = tr->rows++;
+	TrellisLink *links = tr->links + (long)row * tr->beam;
+	for (int i = 0; i < n; i++)
+	{
+		const TrellisCand *c = &tr->cand[i];
+		tr->next.cost[i] = c->cost;
+		tr->next.history[i] = c->history;
+		tr->next.step_size[i] = c->step_size;
+		tr->next.tag[i] = (row == tr->block - 1) ? i : tr->cur.tag[c->parent];
+		links[i].parent = c->parent;
+		links[i].code = c->code;
+	}
+	for (int i = n; i < tr->beam; i++) tr->next.cost[i] = TRELLIS_DEAD;
+
+	const TrellisSlots t = tr->cur;
+	tr->cur = tr->next;
+	tr->next = t;
+}
+
+// Writes the codes for the next `count` samples and advances the settled state.
+static void trellis_emit(Trellis *tr, const uint8_t *codes, int count)
+{
+	int history = tr->base.history;
+	int step_size = tr->base.step_size;
+	for (int i = 0; i < count; i++)
+	{
+		const long pos = tr->committed + i;
+		const uint8_t code = codes[i];
+		ymz_step(code, &history, &step_size);
+		if (tr->out && pos < tr->out_samples)
+		{
+			uint8_t *b = tr->out + pos / 2;
+			*b = (pos & 1) ? ((*b & 0xF0) | code) : ((*b & 0x0F) | (code << 4));
+		}
+		if (tr->checkpoint && (pos + 1) % TRELLIS_CHECKPOINT == 0)
+		{
+			TrellisState *cp = &tr->checkpoint[(pos + 1) / TRELLIS_CHECKPOINT];
+			cp->history = history;
+			cp->step_size = step_size;
+		}
+	}
+	tr->committed += count;
+	tr->base.history = history;
+	tr->base.step_size = step_size;
+}
+
+// Follows `slot` back from the latest row to the first, collecting its codes.
+static void trellis_trace(Trellis *tr, int slot)
+{
+	for (int row = tr->rows - 1; row >= 0; row--)
+	{
+		const TrellisLink *link = &tr->links[(long)row * tr->beam + slot];
+		tr->codes[row] = link->code;
+		slot = link->parent;
+	}
+}
+
+// Settles the first block once the search is a block past it. Only paths
+// descending from the chosen end of that block are kept.
+static void trellis_commit_block(Trellis *tr)
+{
+	const int best = trellis_best(tr);
+	const int node = tr->cur.tag[best];
+	trellis_trace(tr, best);
+	trellis_emit(tr, tr->codes, tr->block);
+
+	for (int i = 0; i < tr->beam; i++)
+	{
+		if (tr->cur.tag[i] != node) tr->cur.cost[i] = TRELLIS_DEAD;
+		tr->cur.tag[i] = i;
+	}
+	memmove(tr->links, tr->links + (long)tr->block * tr->beam,
+	        sizeof(*tr->links) * tr->block * tr->beam);
+	tr->rows -= tr->block;
+}
+
+// Settles everything searched so far along the path ending in `slot`.
+static void trellis_finish(Trellis *tr, int slot)
+{
+	trellis_trace(tr, slot);
+	trellis_emit(tr, tr->codes, tr->rows);
+	tr->rows = 0;
+}
+
+// Searches up to `end`. With `join` set, stops early once a path reaches the
+// state recorded at a checkpoint, and settles along that path. Returns true if
+// it joined.
+static bool trellis_run(Trellis *tr, long end, const TrellisState *join)
+{
+	while (tr->committed + tr->rows < end)
+	{
+		trellis_step(tr);
+		const long pos = tr->committed + tr->rows;
+		if (join && pos % TRELLIS_CHECKPOINT == 0)
+		{
+			const TrellisState want = join[pos / TRELLIS_CHECKPOINT];
+			for (int i = 0; i < tr->beam; i++)
+			{
+				if (tr->cur.cost[i] != TRELLIS_DEAD && tr->cur.history[i] == want.history &&
+				    tr->cur.step_size[i] == want.step_size)
+				{
+					trellis_finish(tr, i);
+					return true;
+				}
+			}
+		}
+		if (tr->rows == 2 * tr->block) trellis_commit_block(tr);
+	}
+	trellis_finish(tr, trellis_best(tr));
+	return false;
+}
+
+typedef struct TrellisJob
+{
+	const int16_t *pcm;
+	uint8_t *out;
+	long len;
+	long seg_len;
+	int segments;
+	int effort;
+	TrellisState *start;       // State each segment was searched from.
+	TrellisState *end;         // State each segment ends in.
+	TrellisState *checkpoint;
+	bool *ok;
+} TrellisJob;
+
+static void trellis_segment_job(void *user, int idx)
+{
+	TrellisJob *job = (TrellisJob *)user;
+	const long start = idx * job->seg_len;
+	long end = start + job->seg_len;
+	if (end > job->len) end = job->len;
+
+	Trellis tr;
+	if (!trellis_init(&tr, job->effort, job->pcm))
+	{
+		job->ok[idx] = false;
+		return;
+	}
+
+	// Estimate the start state by searching the samples in front.
+	TrellisState st = {0, 127};
+	const long warm = start > TRELLIS_WARMUP ? start - TRELLIS_WARMUP : 0;
+	if (warm < start)
+	{
+		trellis_reset(&tr, warm, st);
+		trellis_run(&tr, start, NULL);
+		st = tr.base;
+	}
+	job->start[idx] = st;
+
+	tr.out = job->out;
+	tr.out_samples = job->len & ~1L;
+	tr.checkpoint = job->checkpoint;
+	trellis_reset(&tr, start, st);
+	trellis_run(&tr, end, NULL);
+	job->end[idx] = tr.base;
+	job->ok[idx] = true;
+	trellis_free(&tr);
+}
+
+bool trellis_encode(const int16_t *pcm, uint8_t *out, long len, int effort, int jobs,
+                    TrellisStats *stats)
+{
+	TrellisStats local;
+	if (!stats) stats = &local;
+	memset(stats, 0, sizeof(*stats));
+
+	if (effort == TRELLIS_EFFORT_GREEDY)
+	{
+		SegEncStats seg;
+		segenc_encode(pcm, out, len, jobs, false, &seg);
+		stats->segments = seg.segments;
+		return true;
+	}
+
+	TrellisJob job;
+	job.pcm = pcm;
+	job.out = out;
+	job.len = len;
+	job.seg_len = TRELLIS_SEGMENT;
+	job.segments = (int)((len + job.seg_len - 1) / job.seg_len);
+	job.effort = effort;
+	job.start = malloc(sizeof(*job.start) * (job.segments + 1));
+	job.end = malloc(sizeof(*job.end) * (job.segments + 1));
+	job.ok = malloc(sizeof(*job.ok) * (job.segments + 1));
+	job.checkpoint = malloc(sizeof(*job.checkpoint) * (len / TRELLIS_CHECKPOINT + 1));
+	bool ok = job.start && job.end && job.ok && job.checkpoint;
+	if (!ok)
+	{
+		fprintf(stderr, "[TRELLIS] Couldn't allocate segment state\n");
+		goto done;
+	}
+	stats->segments = job.segments;
+
+	pool_run(jobs, job.segments, trellis_segment_job, &job);
+	for (int i = 0; i < job.segments; i++)
+	{
+		if (!job.ok[i]) ok = false;
+	}
+	if (!ok) goto done;
+
+	// The checkpoint on a boundary holds the state the segment after it was
+	// searched from, which is what its codes follow on from.
+	for (int i = 1; i < job.segments; i++) job.checkpoint[i * job.seg_len / TRELLIS_CHECKPOINT] = job.start[i];
+
+	// Join the segments up in order. Where a segment started from the wrong
+	// state, the search runs again from the real one, across as many segments
+	// as it takes, until it meets a state the first searches passed through.
+	Trellis tr;
+	TrellisState real = job.segments > 0 ? job.end[0] : (TrellisState){0, 127};
+	for (int i = 1; i < job.segments;)
+	{
+		if (job.start[i].history == real.history && job.start[i].step_size == real.step_size)
+		{
+			real = job.end[i];
+			i++;
+			continue;
+		}
+		if (stats->fixups == 0 && !trellis_init(&tr, effort, pcm))
+		{
+			ok = false;
+			break;
+		}
+		stats->fixups++;
+
+		const long start = i * job.seg_len;
+		tr.out = out;
+		tr.out_samples = len & ~1L;
+		tr.checkpoint = job.checkpoint;
+		trellis_reset(&tr, start, real);
+		if (!trellis_run(&tr, len, job.checkpoint))
+		{
+			// Searched to the end without meeting; nothing is left to join.
+			stats->fixup_samples += len - start;
+			break;
+		}
+
+		// Carry on from the first search of the segment it joined in.
+		const long joined = tr.committed;
+		stats->fixup_samples += joined - start;
+		i = joined / job.seg_len;
+		if (i >= job.segments) break;
+		if (joined % job.seg_len == 0)
+		{
+			real = job.start[i];
+		}
+		else
+		{
+			real = job.end[i];
+			i++;
+		}
+	}
+	if (stats->fixups > 0) trellis_free(&tr);
+
+done:
+	free(job.start);
+	free(job.end);
+	free(job.ok);
+	free(job.checkpoint);
+	return ok;
+}
+
+double trellis_snr(const int16_t *pcm, const uint8_t *adpcm, long len)
+{
+	// Decoded the way the encoders model the chip.
+	int history = 0;
+	int step_size = 127;
+	double signal = 0, noise = 0;
+	len &= ~1L;
+	for (long i = 0; i < len; i++)
+	{
+		const unsigned int code = (i & 1) ? (adpcm[i / 2] & 15) : (adpcm[i / 2] >> 4);
+		const double err = ymz_step(code, &history, &step_size) - pcm[i];
+		signal += (double)pcm[i] * pcm[i];
+		noise += err * err;
+	}
+	if (noise == 0) return INFINITY;
+	return 10.0 * log10(signal / noise);
+}
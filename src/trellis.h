@@ -0,0 +1,53 @@
+#pragma once
+
+// Search-based YMZ280B ADPCM encoding.
+//
+// ymz_encode() picks each code greedily for the sample at hand. Here a pruned
+// Viterbi search keeps the best few hundred encoder states alive at every
+// sample, merging paths that reach the same state, and only settles on a code
+// once the search has looked far enough ahead. The cost is the squared error
+// of the decoded signal against the source.
+//
+// Long samples are cut into fixed-length segments searched in parallel, each
+// starting from a state estimated by searching the stretch in front of it.
+// Where that estimate was wrong, the search is run again from the real state,
+// on into later segments if need be, until one of its paths reaches a state
+// the first searches passed through, and the two are joined there. The result
+// is always a valid stream, and depends only on the source and effort, never
+// on the number of threads; only the codes before each join can differ from a
+// serial search.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Effort levels. Positive values are lookahead-N: N samples of lookahead.
+#define TRELLIS_EFFORT_GREEDY 0
+#define TRELLIS_EFFORT_FULL -1
+
+// Samples per segment. Fixed, so that the output doesn't depend on how many
+// threads there are; a multiple of the checkpoint interval.
+#define TRELLIS_SEGMENT 32768
+
+typedef struct TrellisStats
+{
+	int segments;
+	int fixups;          // Segments searched again from the real start state.
+	long fixup_samples;  // Samples searched again before the paths joined.
+} TrellisStats;
+
+// Parses "greedy", "lookahead-N" or "trellis". Returns false if `value` is
+// none of those.
+bool trellis_parse_effort(const char *value, int *effort);
+
+// Formats an effort level the way trellis_parse_effort() takes it.
+const char *trellis_effort_name(int effort, char *buf, size_t size);
+
+// Encodes `len` samples into `out`, which needs room for len/2 bytes; a
+// trailing odd nibble is dropped, as with ymz_encode(). Uses up to `jobs`
+// threads. Returns false if the search couldn't allocate its state.
+bool trellis_encode(const int16_t *pcm, uint8_t *out, long len, int effort, int jobs,
+                    TrellisStats *stats);
+
+// Signal-to-noise ratio, in dB, of an encoded stream against its source.
+double trellis_snr(const int16_t *pcm, const uint8_t *adpcm, long len);